@@ -21,6 +21,7 @@
  *****************************************************************/
 
 #include "application.hpp"
+#include "threadpool.hpp"
 #include <boost/foreach.hpp>
 
 #define STR(s) _xstr_(s)
@@ -49,6 +50,10 @@ Application::Application( const char name[] ): m_name( name )
 	parameters["dImageIO"].setDescription( "Debugging level for the ImageIO module" );
 	parameters["dImageIO"].hidden() = true;
 
+	parameters["threads"] = uint16_t( 0 );
+	parameters["threads"].setDescription( "Number of threads used for parallel operations (0 means one per processor, default is taken from ISIS_THREADS)" );
+	parameters["threads"].hidden() = true;
+
 	parameters["help"] = false;
 	parameters["help"].setDescription( "Print help" );
 	BOOST_FOREACH( ParameterMap::reference ref, parameters ) //none of these is needed
@@ -97,6 +102,10 @@ bool Application::init( int argc, char **argv, bool exitOnError )
 		setLog<ImageIoLog>( LLMap[parameters["dImageIO"]->as<Selection>()] );
 	}
 
+	if( parameters["threads"].isSet() ) {
+		ThreadPool::get().setThreads( parameters["threads"]->as<uint16_t>() );
+	}
+
 	if ( err ) {
 		printHelp();
 
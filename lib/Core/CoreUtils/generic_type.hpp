@@ -41,12 +41,12 @@ protected:
 	template<typename T> T &m_cast_to() {
 		LOG_IF( getTypeID() != T::staticID, Debug, error ) << "using " << getTypeName() << " at " << this << " as " << T::staticName() << " aborting ...";
 		assert( getTypeID() == T::staticID );
-		return *dynamic_cast<T *>( this );// @todo maybe Mac doesn't like that (http://www.cocoabuilder.com/archive/xcode/247376-rtti-dynamic-cast-across-shared-module-boundaries.html)
+		return *static_cast<T *>( this ); // the type was checked above, so there is no need for an (expensive) dynamic_cast
 	}
 	template<typename T> const T &m_cast_to()const {
 		LOG_IF( getTypeID() != T::staticID, Debug, error ) << "using " << getTypeName() << " at " << this << " as " << T::staticName() << " aborting ...";
 		assert( getTypeID() == T::staticID );
-		return *dynamic_cast<const T *>( this );// @todo maybe Mac doesn't like that (http://www.cocoabuilder.com/archive/xcode/247376-rtti-dynamic-cast-across-shared-module-boundaries.html)
+		return *static_cast<const T *>( this ); // the type was checked above, so there is no need for an (expensive) dynamic_cast
 	}
 
 public:
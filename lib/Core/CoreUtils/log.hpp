@@ -15,10 +15,18 @@
 
 #include <string>
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/version.hpp>
 #include "message.hpp"
 #include "singletons.hpp"
+#include "log_modules.hpp"
 #include <limits.h>
 
+#if BOOST_VERSION >= 105300
+#include <boost/atomic.hpp>
+#define ISIS_LOG_ATOMIC_LEVEL 1
+#endif
+
 /// @cond _internal
 namespace isis
 {
@@ -31,13 +39,35 @@ namespace util
 namespace _internal
 {
 
+/// the compile time limit of the log level of MODULE (MODULE::maxLevel, or no limit if the module doesn't define it)
+template<class MODULE> class LogMaxLevel
+{
+	template<int> struct Probe;
+	template<class M> static char test( Probe<M::maxLevel> * );
+	template<class M> static long test( ... );
+public:
+	template<class M, bool HAS_MAX> struct Get {enum {value = INT_MAX};};
+	template<class M> struct Get<M, true> {enum {value = M::maxLevel};};
+	enum {value = Get<MODULE, sizeof( test<MODULE>( 0 ) ) == sizeof( char )>::value};
+};
+
+#ifdef ISIS_LOG_ATOMIC_LEVEL
+typedef boost::atomic<int> LogLevelStore;
+inline int loadLevel( const LogLevelStore &store ) {return store.load( boost::memory_order_relaxed );}
+#else
+// without boost::atomic rely on loads and stores of an aligned int being atomic (as they are on all supported platforms)
+typedef volatile int LogLevelStore;
+inline int loadLevel( const LogLevelStore &store ) {return store;}
+#endif
+
 template<class MODULE> class Log
 {
 	friend class util::Singletons;
 	boost::shared_ptr<MessageHandlerBase> m_handle;
-	static boost::shared_ptr<MessageHandlerBase> &getHandle() {
-		boost::shared_ptr<util::_internal::MessageHandlerBase> &handle = Singletons::get < Log<MODULE>, INT_MAX - 1 > ().m_handle;
-		return handle;
+	boost::mutex m_mutex; // guards m_handle
+	static LogLevelStore s_level; // level of m_handle (0 if there is none), so LOG can check it without creating a Message
+	static Log &get() {
+		return Singletons::get < Log<MODULE>, INT_MAX - 1 > ();
 	}
 	Log(): m_handle( new DefaultMsgPrint( warning ) ) {}
 public:
@@ -45,13 +75,26 @@ public:
 		setHandler( boost::shared_ptr<MessageHandlerBase>( enable ? new HANDLE_CLASS( enable ) : 0 ) );
 	}
 	static void setHandler( boost::shared_ptr<MessageHandlerBase> handler ) {
-		getHandle() = handler;
+		Log &me = get();
+		boost::mutex::scoped_lock lock( me.m_mutex );
+		me.m_handle = handler;
+		s_level = handler ? handler->m_level : 0;
+	}
+	/// \returns true if a message of the given level would be committed by the current handler
+	static bool enabled( LogLevel level ) {
+		return int( level ) <= loadLevel( s_level );
 	}
 	static Message send( const char file[], const char object[], int line, LogLevel level ) {
-		boost::shared_ptr<util::_internal::MessageHandlerBase> &handle = getHandle();
+		Log &me = get();
+		boost::shared_ptr<MessageHandlerBase> handle;
+		{
+			boost::mutex::scoped_lock lock( me.m_mutex );
+			handle = me.m_handle;
+		}
 		return Message( object, MODULE::name(), file, line, level, handle );
 	}
 };
+template<class MODULE> LogLevelStore Log<MODULE>::s_level( warning ); // the level of the default handler
 
 }
 }
@@ -62,10 +105,14 @@ public:
 #define ENABLE_LOG(MODULE,HANDLE_CLASS,set)\
 	if(!MODULE::use);else isis::util::_internal::Log<MODULE>::enable<HANDLE_CLASS>(set)
 
+// the level is checked against the compile time limit of the module and the level of its handler before a Message is created
+#define LOG_ENABLED(MODULE,LEVEL)\
+	(MODULE::use && int(LEVEL) <= int(isis::util::_internal::LogMaxLevel<MODULE>::value) && isis::util::_internal::Log<MODULE>::enabled(LEVEL))
+
 #define LOG(MODULE,LEVEL)\
-	if(!MODULE::use);else isis::util::_internal::Log<MODULE>::send(__FILE__,__FUNCTION__,__LINE__,LEVEL)
+	if(!LOG_ENABLED(MODULE,LEVEL));else isis::util::_internal::Log<MODULE>::send(__FILE__,__FUNCTION__,__LINE__,LEVEL)
 
 #define LOG_IF(PRED,MODULE,LEVEL)\
-	if(!(MODULE::use && (PRED)));else isis::util::_internal::Log<MODULE>::send(__FILE__,__FUNCTION__,__LINE__,LEVEL)
+	if(!(LOG_ENABLED(MODULE,LEVEL) && (PRED)));else isis::util::_internal::Log<MODULE>::send(__FILE__,__FUNCTION__,__LINE__,LEVEL)
 
 #endif
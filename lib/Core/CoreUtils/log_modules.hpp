@@ -1,17 +1,33 @@
 #ifndef LOG_MOUDLES_HPP_INCLUDED
 #define LOG_MOUDLES_HPP_INCLUDED
 
+/*
+ * The highest log level of the runtime-/debug-modules which is compiled in.
+ * LOG statements of a higher level are removed by the compiler. Release builds (NDEBUG) drop debug messages above warning.
+ */
+#ifndef _LOG_MAX_LEVEL
+#define _LOG_MAX_LEVEL 4 // verbose_info
+#endif
+
+#ifndef _DEBUG_MAX_LEVEL
+#ifdef NDEBUG
+#define _DEBUG_MAX_LEVEL 2 // warning
+#else
+#define _DEBUG_MAX_LEVEL 4 // verbose_info
+#endif
+#endif
+
 /// @cond _hidden
 namespace isis
 {
-struct CoreLog {static const char *name() {return "Core";}; enum {use = _ENABLE_LOG};};
-struct CoreDebug {static const char *name() {return "CoreDebug";}; enum {use = _ENABLE_DEBUG};};
+struct CoreLog {static const char *name() {return "Core";}; enum {use = _ENABLE_LOG, maxLevel = _LOG_MAX_LEVEL};};
+struct CoreDebug {static const char *name() {return "CoreDebug";}; enum {use = _ENABLE_DEBUG, maxLevel = _DEBUG_MAX_LEVEL};};
 
-struct ImageIoLog {static const char *name() {return "ImageIO";}; enum {use = _ENABLE_LOG};};
-struct ImageIoDebug {static const char *name() {return "ImageIODebug";}; enum {use = _ENABLE_DEBUG};};
+struct ImageIoLog {static const char *name() {return "ImageIO";}; enum {use = _ENABLE_LOG, maxLevel = _LOG_MAX_LEVEL};};
+struct ImageIoDebug {static const char *name() {return "ImageIODebug";}; enum {use = _ENABLE_DEBUG, maxLevel = _DEBUG_MAX_LEVEL};};
 
-struct DataLog {static const char *name() {return "Data";}; enum {use = _ENABLE_LOG};};
-struct DataDebug {static const char *name() {return "DataDebug";}; enum {use = _ENABLE_DEBUG};};
+struct DataLog {static const char *name() {return "Data";}; enum {use = _ENABLE_LOG, maxLevel = _LOG_MAX_LEVEL};};
+struct DataDebug {static const char *name() {return "DataDebug";}; enum {use = _ENABLE_DEBUG, maxLevel = _DEBUG_MAX_LEVEL};};
 }
 /// @endcond
 
@@ -17,6 +17,7 @@
 #define BOOST_FILESYSTEM_VERSION 2 //@todo switch to 3 as soon as we drop support for boost < 1.44
 #include <boost/filesystem/path.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp> //we need the to_string functions for the automatic conversion
+#include <boost/thread/mutex.hpp>
 
 #ifndef WIN32
 #include <signal.h>
@@ -28,6 +29,13 @@ namespace util
 {
 namespace _internal
 {
+/// serializes the commits of all messages (they might come from any thread, and all handlers print to the same streams)
+boost::mutex &commitMutex()
+{
+	static boost::mutex *mutex = new boost::mutex; // never deleted, messages might still be send when static objects are destructed
+	return *mutex;
+}
+
 const char *logLevelNames( LogLevel level )
 {
 	switch( level ) {
@@ -91,11 +99,16 @@ Message::Message( const Message &src ) //we need a custom copy-constructor, beca
 
 Message::~Message()
 {
-	if ( shouldCommit() ) {
-		commitTo.lock()->commit( *this );
+	const boost::shared_ptr<MessageHandlerBase> handler( commitTo.lock() ); // keep the handler, even if its replaced meanwhile
+
+	if ( handler && shouldCommit() ) {
+		{
+			boost::mutex::scoped_lock lock( commitMutex() );
+			handler->commit( *this );
+		}
 		str( "" );
 		clear();
-		commitTo.lock()->requestStop( m_level );
+		handler->requestStop( m_level );
 	}
 }
 
@@ -152,6 +165,7 @@ void DefaultMsgPrint::commit( const _internal::Message &mesg )
 
 void DefaultMsgPrint::setStream( ::std::ostream &_o )
 {
+	boost::mutex::scoped_lock lock( _internal::commitMutex() );
 	o->flush();
 	o = &_o;
 }
@@ -12,6 +12,9 @@
 
 #include "propmap.hpp"
 #include <boost/foreach.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <string.h>
 
 namespace isis
 {
@@ -44,8 +47,214 @@ continousFind( ForwardIterator &current, const ForwardIterator end, const T &com
 	else
 		return true;//not(current <> compare) makes compare == current
 }
+
+/// @cond _internal
+/*
+ * Binary encoding of the values for PropertyMap::writeBinary / PropertyMap::readBinary.
+ * Scalars are written as they are in memory (host byte order), everything with a variable length is prefixed by its length.
+ * If this changes, PropertyMap::binaryVersion has to be increased.
+ */
+namespace binary
+{
+static const char magic[4] = {'i', 's', 'P', 'M'};
+static const uint16_t byteOrderMark = 0x0102;
+
+template<typename T> void write( std::ostream &out, const T &val ) {out.write( reinterpret_cast<const char *>( &val ), sizeof( T ) );}
+template<typename T> bool read( std::istream &in, T &val ) {return in.read( reinterpret_cast<char *>( &val ), sizeof( T ) );}
+
+template<typename T> void write( std::ostream &out, const std::basic_string<char, T> &val )
+{
+	write( out, uint32_t( val.length() ) );
+	out.write( val.data(), val.length() );
+}
+template<typename T> bool read( std::istream &in, std::basic_string<char, T> &val )
+{
+	uint32_t len;
+
+	if( !read( in, len ) )
+		return false;
+
+	val.resize( len );
+	return len == 0 || in.read( &val[0], len );
+}
+
+template<typename T> void write( std::ostream &out, const std::list<T> &val )
+{
+	write( out, uint32_t( val.size() ) );
+
+	for( typename std::list<T>::const_iterator i = val.begin(); i != val.end(); ++i )
+		write( out, *i );
+}
+template<typename T> bool read( std::istream &in, std::list<T> &val )
+{
+	uint32_t len;
+
+	if( !read( in, len ) )
+		return false;
+
+	for( val.clear(); len; len-- ) {
+		val.push_back( T() );
+
+		if( !read( in, val.back() ) )
+			return false;
+	}
+
+	return true;
+}
+
+template<typename T> void write( std::ostream &out, const FixedVector<T, 4> &val )
+{
+	for( size_t i = 0; i < 4; i++ )
+		write( out, val[i] );
+}
+template<typename T> bool read( std::istream &in, FixedVector<T, 4> &val )
+{
+	for( size_t i = 0; i < 4; i++ )
+		if( !read( in, val[i] ) )
+			return false;
+
+	return true;
+}
+
+// selections are stored as their entries (name and number) and the number of the currently set entry
+void write( std::ostream &out, const Selection &val )
+{
+	const std::list<istring> entries = val.getEntries();
+	write( out, uint32_t( entries.size() ) );
+	BOOST_FOREACH( const istring & entry, entries ) {
+		Selection probe( val );
+		probe.set( entry.c_str() );
+		write( out, entry );
+		write( out, int32_t( probe ) );
+	}
+	write( out, int32_t( val ) );
+}
+bool read( std::istream &in, Selection &val )
+{
+	std::map<int32_t, std::string> entries;
+	uint32_t len;
+	int32_t current;
+
+	if( !read( in, len ) )
+		return false;
+
+	for( ; len; len-- ) {
+		std::string entry;
+		int32_t number;
+
+		if( !read( in, entry ) || !read( in, number ) )
+			return false;
+
+		entries[number] = entry;
+	}
+
+	if( !read( in, current ) )
+		return false;
+
+	val = Selection( entries );
+
+	if( current )
+		val.set( entries[current].c_str() );
+
+	return true;
+}
+
+// dates are stored as their day number, timestamps additionally store the ticks since midnight
+// the special dates get day numbers no valid date can have (those are between 1400-Jan-01 and 9999-Dec-31)
+static const uint32_t notADateDay = 0, negInfinityDay = 1, posInfinityDay = 0xFFFFFFFF;
+
+void write( std::ostream &out, const boost::gregorian::date &val )
+{
+	if( val.is_not_a_date() )
+		write( out, notADateDay );
+	else if( val.is_neg_infinity() )
+		write( out, negInfinityDay );
+	else if( val.is_pos_infinity() )
+		write( out, posInfinityDay );
+	else
+		write( out, uint32_t( val.day_number() ) );
+}
+bool read( std::istream &in, boost::gregorian::date &val )
+{
+	uint32_t days;
+
+	if( !read( in, days ) )
+		return false;
+
+	switch( days ) {
+	case notADateDay:
+		val = boost::gregorian::date( boost::date_time::not_a_date_time );
+		break;
+	case negInfinityDay:
+		val = boost::gregorian::date( boost::date_time::neg_infin );
+		break;
+	case posInfinityDay:
+		val = boost::gregorian::date( boost::date_time::pos_infin );
+		break;
+	default:
+		try {
+			val = boost::gregorian::date( boost::gregorian::gregorian_calendar::from_day_number( days ) );
+		} catch( const std::out_of_range &e ) { // bad_year, bad_month and bad_day_of_month
+			LOG( Runtime, error ) << "Got invalid day number " << days << " (" << e.what() << ")";
+			return false;
+		}
+	}
+
+	return true;
+}
+// special timestamps are stored as the special date of the same kind
+void write( std::ostream &out, const boost::posix_time::ptime &val )
+{
+	write( out, val.date() );
+	write( out, int64_t( val.is_special() ? 0 : val.time_of_day().ticks() ) );
+}
+bool read( std::istream &in, boost::posix_time::ptime &val )
+{
+	boost::gregorian::date date;
+	int64_t ticks;
+
+	if( !read( in, date ) || !read( in, ticks ) )
+		return false;
+
+	if( date.is_special() )
+		val = boost::posix_time::ptime( date.as_special() );
+	else
+		val = boost::posix_time::ptime( date, boost::posix_time::time_duration( 0, 0, 0, ticks ) );
+
+	return true;
+}
+
+/// writes the value if its of type T (used with mpl::for_each over all types)
+struct value_writer {
+	std::ostream &m_out;
+	const ValueBase &m_val;
+	value_writer( std::ostream &out, const ValueBase &val ): m_out( out ), m_val( val ) {}
+	template<typename T> void operator()( T ) {
+		if( m_val.getTypeID() == Value<T>::staticID )
+			write( m_out, m_val.castTo<T>() );
+	}
+};
+/// reads a value into dst if id is the id of type T (used with mpl::for_each over all types - which copies the functor, so ok is a reference)
+struct value_reader {
+	std::istream &m_in;
+	const unsigned short m_id;
+	PropertyValue &m_dst;
+	bool &m_ok;
+	value_reader( std::istream &in, unsigned short id, PropertyValue &dst, bool &ok ): m_in( in ), m_id( id ), m_dst( dst ), m_ok( ok ) {}
+	template<typename T> void operator()( T ) {
+		if( m_id == Value<T>::staticID ) {
+			T val;
+
+			if( ( m_ok = read( m_in, val ) ) )
+				m_dst = Value<T>( val ); // don't assign val directly, a bool would be taken as "needed"-flag
+		}
+	}
+};
+}
+/// @endcond
 }
 const PropertyMap::mapped_type PropertyMap::emptyEntry;//dummy to be able to return an empty Property
+const uint16_t PropertyMap::binaryVersion;
 
 
 ///////////////////////////////////////////////////////////////////
@@ -540,6 +749,114 @@ std::ostream &PropertyMap::print( std::ostream &out, bool label )const
 	return out;
 }
 
+void PropertyMap::writeBinary( std::ostream &out )const
+{
+	out.write( _internal::binary::magic, sizeof( _internal::binary::magic ) );
+	_internal::binary::write( out, binaryVersion );
+	_internal::binary::write( out, _internal::binary::byteOrderMark );
+	writeBinaryTree( out );
+}
+
+bool PropertyMap::readBinary( std::istream &in )
+{
+	char magic[sizeof( _internal::binary::magic )];
+	uint16_t version, bom;
+
+	if( !in.read( magic, sizeof( magic ) ) || memcmp( magic, _internal::binary::magic, sizeof( magic ) ) != 0 ) {
+		LOG( Runtime, error ) << "The data is not a binary PropertyMap";
+		return false;
+	}
+
+	if( !_internal::binary::read( in, version ) || !_internal::binary::read( in, bom ) )
+		return false;
+
+	if( version > binaryVersion ) {
+		LOG( Runtime, error ) << "Can't read binary PropertyMap of version " << version << " (latest known version is " << binaryVersion << ")";
+		return false;
+	}
+
+	if( bom != _internal::binary::byteOrderMark ) {
+		LOG( Runtime, error ) << "Can't read binary PropertyMap written with different byte order";
+		return false;
+	}
+
+	return readBinaryTree( in );
+}
+
+void PropertyMap::writeBinaryTree( std::ostream &out )const
+{
+	_internal::binary::write( out, uint32_t( size() ) );
+	BOOST_FOREACH( const_reference ref, static_cast<const Container &>( *this ) ) {
+		_internal::binary::write( out, ref.first );
+
+		if( ref.second.is_leaf() ) {
+			const PropertyValue &val = ref.second.getLeaf();
+			_internal::binary::write( out, uint8_t( val.isNeeded() ? 1 : 0 ) );
+
+			if( val.isEmpty() ) {
+				_internal::binary::write( out, uint16_t( 0 ) );
+			} else {
+				_internal::binary::write( out, uint16_t( val->getTypeID() ) );
+				boost::mpl::for_each<_internal::types>( _internal::binary::value_writer( out, *val ) );
+			}
+		} else {
+			_internal::binary::write( out, uint8_t( 2 ) ); // marks a branch
+			ref.second.getBranch().writeBinaryTree( out );
+		}
+	}
+}
+
+bool PropertyMap::readBinaryTree( std::istream &in )
+{
+	uint32_t entries;
+
+	if( !_internal::binary::read( in, entries ) )
+		return false;
+
+	iterator at = begin();
+
+	for( ; entries; entries-- ) {
+		key_type key;
+		uint8_t kind;
+
+		if( !_internal::binary::read( in, key ) || !_internal::binary::read( in, kind ) )
+			return false;
+
+		// the entries were written in order, so the last inserted entry is a good hint
+		at = Container::insert( at, std::make_pair( key, mapped_type() ) );
+
+		// an existing property is replaced, so is a branch which is read as property (and vice versa)
+		// only a branch which is read as branch is merged with the read one
+		if( kind != 2 || at->second.is_leaf() )
+			at->second = mapped_type();
+
+		if( kind == 2 ) {
+			if( !at->second.getBranch().readBinaryTree( in ) )
+				return false;
+		} else {
+			uint16_t id;
+			PropertyValue &val = at->second.getLeaf();
+
+			if( !_internal::binary::read( in, id ) )
+				return false;
+
+			if( id ) {
+				bool ok = false;
+				boost::mpl::for_each<_internal::types>( _internal::binary::value_reader( in, id, val, ok ) );
+
+				if( !ok ) {
+					LOG( Runtime, error ) << "Failed to read the binary value of " << MSubject( key ) << " (type id " << id << ")";
+					return false;
+				}
+			}
+
+			val.needed() = ( kind == 1 );
+		}
+	}
+
+	return true;
+}
+
 bool PropertyMap::trueP::operator()( const PropertyMap::value_type &/*ref*/ ) const
 {
 	return true;
@@ -102,6 +102,10 @@ private:
 
 	/// internal recursion-function for remove
 	bool recursiveRemove( util::PropertyMap &root, const propPathIterator at, const propPathIterator pathEnd );
+
+	/// internal recursion-functions for writeBinary/readBinary
+	void writeBinaryTree( std::ostream &out )const;
+	bool readBinaryTree( std::istream &in );
 protected:
 	/////////////////////////////////////////////////////////////////////////////////////////
 	// rw-backends
@@ -361,6 +365,26 @@ public:
 	 * \param label print the type of the property (see Value::toString())
 	 */
 	std::ostream &print( std::ostream &out, bool label = false )const;
+
+	/// version of the binary representation written by writeBinary
+	static const uint16_t binaryVersion = 1;
+	/**
+	 * Write the PropertyMap into a compact binary representation.
+	 * The representation starts with a short header (magic, binaryVersion and a byte order mark),
+	 * followed by the tree. The values are written in their binary form (in host byte order), so there are no string conversions.
+	 * All types known to util::Value are supported, needed flags and empty properties are kept.
+	 * \param out the output stream to use
+	 */
+	void writeBinary( std::ostream &out )const;
+	/**
+	 * Read properties written by writeBinary into the PropertyMap.
+	 * Existing properties with the same name are replaced (also if they are empty in the stream).
+	 * A branch of the same name as a read property is replaced by it, and vice versa. Existing branches are merged with read ones.
+	 * Data written by a newer version or on a host with different byte order is rejected.
+	 * \param in the input stream to use
+	 * \returns false if the header is not valid, the stream ended early or contained an unknown type
+	 */
+	bool readBinary( std::istream &in );
 };
 }
 /** @} */
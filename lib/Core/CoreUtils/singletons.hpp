@@ -6,6 +6,9 @@
 #include <string>
 #include <iostream>
 #include <typeinfo>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/bind.hpp>
 
 namespace isis
 {
@@ -27,6 +30,8 @@ namespace util
  * Singletons::get < MyClass, INT_MAX - 1 >
  * \endcode
  * This generates a Singleton of MyClass with highest priority
+ *
+ * Requesting singletons is thread safe. Concurrent first requests for the same type create only one object.
  */
 class Singletons
 {
@@ -39,15 +44,23 @@ class Singletons
 
 	typedef std::multimap<int, SingletonBase *const> prioMap;
 	prioMap map;
+	boost::mutex m_mutex; // guards map
 	Singletons();
 	virtual ~Singletons();
 	template<typename T> Singleton<T> *create( int priority ) {
-		Singleton<T>* ret( new Singleton<T> );
+		Singleton<T>* ret( new Singleton<T> ); // don't lock while creating, T might request other singletons
+		boost::mutex::scoped_lock lock( m_mutex );
 		map.insert( map.find( priority ), std::make_pair( priority, ret ) );
 		return ret;
 	}
+	template<typename T> static void createInto( Singleton<T> **s, int priority ) {
+		*s = getMaster().create<T>( priority );
+	}
 	template<typename T> static Singleton<T>& request( int priority ) {
-		static Singleton<T> *s = getMaster().create<T>( priority );
+		// both are statically initialized, so they're there before any thread can get here
+		static Singleton<T> *s = 0;
+		static boost::once_flag once = BOOST_ONCE_INIT;
+		boost::call_once( once, boost::bind( &Singletons::createInto<T>, &s, priority ) );
 		//ok this might become a dead ref as well. But its no complex object, and therefore won't be "destructed".
 		return *s;
 	}
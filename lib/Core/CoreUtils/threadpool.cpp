@@ -0,0 +1,205 @@
+#include "threadpool.hpp"
+#include "singletons.hpp"
+#include "common.hpp"
+#include "message.hpp"
+#include <boost/thread/tss.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
+#include <stdlib.h>
+#include <climits>
+#include <algorithm>
+
+namespace isis
+{
+namespace util
+{
+
+namespace _internal
+{
+void noCleanup( ThreadPool * ) {} // the pool is not owned by the threads
+boost::thread_specific_ptr<ThreadPool> runningIn( noCleanup ); // the pool the current thread is working for (if any)
+
+/// marks the current thread as working for a pool as long as it exists
+struct RunningIn {
+	ThreadPool *m_previous;
+	RunningIn( ThreadPool *pool ): m_previous( runningIn.get() ) {runningIn.reset( pool );}
+	~RunningIn() {runningIn.reset( m_previous );}
+};
+}
+
+ThreadPool::ThreadPool(): m_threads( 0 ), m_stop( false )
+{
+	const char *env_threads = getenv( "ISIS_THREADS" );
+	size_t threads = 0;
+
+	if( env_threads ) {
+		try {
+			threads = boost::lexical_cast<size_t>( env_threads );
+		} catch( const boost::bad_lexical_cast & ) {
+			LOG( Runtime, warning ) << "Ignoring invalid value " << util::MSubject( env_threads ) << " of ISIS_THREADS";
+		}
+	}
+
+	setThreads( threads );
+}
+
+ThreadPool::~ThreadPool()
+{
+	stopWorkers();
+}
+
+ThreadPool &ThreadPool::get()
+{
+	return Singletons::get<ThreadPool, INT_MAX - 2>();
+}
+
+bool ThreadPool::inWorker()
+{
+	return _internal::runningIn.get() != NULL;
+}
+
+size_t ThreadPool::getThreads()const
+{
+	return m_threads;
+}
+
+void ThreadPool::setThreads( size_t threads )
+{
+	if( threads == 0 )
+		threads = std::max<unsigned int>( boost::thread::hardware_concurrency(), 1 );
+
+	if( threads != m_threads ) {
+		stopWorkers(); // they'll be started with the new size by the next parallel_for
+		m_threads = threads;
+		LOG( Debug, info ) << "Using " << m_threads << " threads for parallel operations";
+	}
+}
+
+void ThreadPool::startWorkers()
+{
+	LOG( Debug, info ) << "Starting " << m_threads - 1 << " worker threads";
+	m_stop = false;
+
+	for( size_t t = 1; t < m_threads; t++ ) // the thread calling parallel_for is the first one
+		m_workers.push_back( boost::shared_ptr<boost::thread>( new boost::thread( boost::bind( &ThreadPool::worker, this ) ) ) );
+}
+
+void ThreadPool::stopWorkers()
+{
+	{
+		boost::mutex::scoped_lock lock( m_mutex );
+		m_stop = true;
+	}
+	m_newJob.notify_all();
+
+	for( std::list<boost::shared_ptr<boost::thread> >::iterator i = m_workers.begin(); i != m_workers.end(); ++i )
+		( *i )->join();
+
+	m_workers.clear();
+}
+
+void ThreadPool::runPortion( _internal::ThreadJob &job, boost::unique_lock<boost::mutex> &lock )
+{
+	const size_t begin = job.next, end = std::min( job.next + job.grain, job.end );
+	job.next = end;
+	job.running++;
+
+	if( job.next >= job.end ) // all indices are handed out, so nobody else needs to see this job anymore
+		m_jobs.remove( &job );
+
+	lock.unlock();
+	size_t i = begin;
+	std::string error;
+
+	try {
+		for( ; i < end; i++ )
+			job.run( i );
+	} catch( const std::exception &e ) {
+		error = e.what();
+	} catch( ... ) {
+		error = "unknown exception";
+	}
+
+	lock.lock();
+
+	if( i < end ) {
+		if( !job.failed || i < job.errorIndex ) {
+			job.errorIndex = i;
+			job.error = error;
+		}
+
+		job.failed = true;
+
+		if( job.next < job.end ) { // skip the rest
+			job.next = job.end;
+			m_jobs.remove( &job );
+		}
+	}
+
+	if( --job.running == 0 && job.next >= job.end )
+		m_jobDone.notify_all();
+}
+
+void ThreadPool::worker()
+{
+	_internal::RunningIn mark( this );
+	boost::unique_lock<boost::mutex> lock( m_mutex );
+
+	for( ;; ) {
+		while( !m_stop && m_jobs.empty() )
+			m_newJob.wait( lock );
+
+		if( m_stop )
+			return;
+
+		runPortion( *m_jobs.front(), lock );
+	}
+}
+
+void ThreadPool::runSerial( _internal::ThreadJob &job )
+{
+	size_t i = job.next;
+
+	try {
+		for( ; i < job.end; i++ )
+			job.run( i );
+	} catch( const std::exception &e ) {
+		job.error = e.what();
+	} catch( ... ) {
+		job.error = "unknown exception";
+	}
+
+	if( i < job.end ) {
+		LOG( Runtime, error ) << "Loop failed at index " << i << " with " << util::MSubject( job.error );
+		throw std::runtime_error( job.error );
+	}
+}
+
+void ThreadPool::run( _internal::ThreadJob &job )
+{
+	boost::unique_lock<boost::mutex> lock( m_mutex );
+
+	if( m_workers.size() + 1 < m_threads )
+		startWorkers();
+
+	m_jobs.push_back( &job );
+	m_newJob.notify_all();
+
+	{
+		_internal::RunningIn mark( this );
+
+		while( job.next < job.end ) // help with our own job, until all of it is handed out
+			runPortion( job, lock );
+	}
+
+	while( job.running )
+		m_jobDone.wait( lock );
+
+	if( job.failed ) {
+		LOG( Runtime, error ) << "Parallel loop failed at index " << job.errorIndex << " with " << util::MSubject( job.error );
+		throw std::runtime_error( job.error );
+	}
+}
+
+}
+}
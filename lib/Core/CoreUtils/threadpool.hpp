@@ -0,0 +1,148 @@
+/****************************************************************
+ *
+ * Copyright (C) ISIS Dev-Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *****************************************************************/
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <list>
+#include <algorithm>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace isis
+{
+namespace util
+{
+namespace _internal
+{
+/// a range of indices handed out to the threads of a ThreadPool in portions of grain indices
+class ThreadJob: boost::noncopyable
+{
+public:
+	size_t next, end, grain;
+	size_t running; // amount of threads currently working on portions of this job
+	bool failed;
+	size_t errorIndex; // the lowest index an exception was thrown for
+	std::string error;
+	ThreadJob( size_t begin, size_t _end, size_t _grain ): next( begin ), end( _end ), grain( _grain ), running( 0 ), failed( false ), errorIndex( _end ) {}
+	virtual void run( size_t index ) = 0;
+	virtual ~ThreadJob() {}
+};
+template<typename OP> class ThreadJobOp: public ThreadJob
+{
+	OP &m_op;
+public:
+	ThreadJobOp( OP &op, size_t begin, size_t end, size_t grain ): ThreadJob( begin, end, grain ), m_op( op ) {}
+	void run( size_t index ) {m_op( index );}
+};
+}
+
+/**
+ * Pool of worker threads shared by all parallel operations of isis.
+ *
+ * The pool runs parallel_for on index ranges (e.g. the index of a chunk in a list of chunks).
+ * The indices are handed out in portions from a shared queue of running loops, the thread calling parallel_for takes part
+ * in its own loop. So a pool of n threads uses n-1 workers, and a single threaded pool never spawns any thread.
+ *
+ * Calls to parallel_for from inside a loop of the pool (nested parallelism) run serially in the calling thread, so the pool
+ * never runs more than its size of threads.
+ *
+ * The size is taken from the environment variable ISIS_THREADS, if its not set the number of processors is used.
+ * Applications can change it using the parameter "-threads".
+ *
+ * \code
+ * util::ThreadPool::get().parallel_for( 0, chunks.size(), op ); // calls op(i) for every i in [0,chunks.size())
+ * \endcode
+ */
+class ThreadPool: boost::noncopyable
+{
+	size_t m_threads;
+	bool m_stop;
+	std::list<boost::shared_ptr<boost::thread> > m_workers;
+	std::list<_internal::ThreadJob *> m_jobs;
+	boost::mutex m_mutex;
+	boost::condition_variable m_newJob, m_jobDone;
+
+	void startWorkers();
+	void stopWorkers();
+	void worker();
+	/// take the next portion of job and run it (m_mutex must be locked by lock)
+	void runPortion( _internal::ThreadJob &job, boost::unique_lock<boost::mutex> &lock );
+	void run( _internal::ThreadJob &job );
+	/// run all of job in the calling thread (with the same error handling as run)
+	static void runSerial( _internal::ThreadJob &job );
+protected:
+	ThreadPool();
+	virtual ~ThreadPool();
+public:
+	/// \returns the pool used by isis
+	static ThreadPool &get();
+	/// \returns true if the calling thread currently runs a loop of any ThreadPool
+	static bool inWorker();
+
+	/// \returns the number of threads loops are run with (including the calling thread)
+	size_t getThreads()const;
+	/**
+	 * Set the number of threads loops are run with.
+	 * Must not be called while parallel_for is running.
+	 * \param threads the number of threads, 0 means the number of processors
+	 */
+	void setThreads( size_t threads );
+
+	/**
+	 * Call op for every index in [begin,end).
+	 * The indices are run in parallel, in no particular order.
+	 * If op throws for an index the remaining indices are skipped, and after all running calls returned the exception of
+	 * the lowest index that threw is rethrown as std::runtime_error (also if the loop runs serially).
+	 * \param begin the first index
+	 * \param end the index after the last index
+	 * \param op the functor called for each index as op(size_t)
+	 * \param grain the amount of indices a thread takes at once, 0 means end-begin will be split in about 8 portions per thread
+	 */
+	template<typename OP> void parallel_for( size_t begin, size_t end, OP &op, size_t grain = 0 ) {
+		if( end <= begin )
+			return;
+
+		if( end - begin == 1 || m_threads < 2 || inWorker() ) { // no point (or no right) to use the workers
+			_internal::ThreadJobOp<OP> job( op, begin, end, end - begin );
+			runSerial( job );
+		} else {
+			if( grain == 0 )
+				grain = std::max<size_t>( ( end - begin ) / ( m_threads * 8 ), 1 );
+
+			_internal::ThreadJobOp<OP> job( op, begin, end, grain );
+			run( job );
+		}
+	}
+	/// \copydoc parallel_for
+	template<typename OP> void parallel_for( size_t begin, size_t end, const OP &op, size_t grain = 0 ) {
+		OP copy( op );
+		parallel_for( begin, end, copy, grain );
+	}
+};
+
+}
+}
+
+#endif // THREADPOOL_HPP
@@ -17,6 +17,9 @@
 #include "chunk.hpp"
 #include <boost/foreach.hpp>
 #include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "../CoreUtils/threadpool.hpp"
 
 namespace isis
 {
@@ -315,5 +318,272 @@ void Chunk::swapAlong( const dimensions dim ) const
 
 	}
 }
+namespace _internal
+{
+/// \returns true if props have all properties needed to place the voxels in scanner space
+bool hasGeometry( const util::PropertyMap &props )
+{
+	return props.hasProperty( "indexOrigin" ) && props.hasProperty( "rowVec" ) && props.hasProperty( "columnVec" ) && props.hasProperty( "voxelSize" );
+}
+/// get rowVec, columnVec and sliceVec from props (sliceVec is computed from the other two if its missing)
+void getDirections( const util::PropertyMap &props, util::fvector4 vecs[3] )
+{
+	vecs[0] = props.getPropertyAs<util::fvector4>( "rowVec" );
+	vecs[1] = props.getPropertyAs<util::fvector4>( "columnVec" );
+
+	if( props.hasProperty( "sliceVec" ) ) {
+		vecs[2] = props.getPropertyAs<util::fvector4>( "sliceVec" );
+	} else {
+		vecs[2][0] = vecs[0][1] * vecs[1][2] - vecs[0][2] * vecs[1][1];
+		vecs[2][1] = vecs[0][2] * vecs[1][0] - vecs[0][0] * vecs[1][2];
+		vecs[2][2] = vecs[0][0] * vecs[1][1] - vecs[0][1] * vecs[1][0];
+	}
+}
+void setDirections( util::PropertyMap &props, const util::fvector4 vecs[3] )
+{
+	props.setPropertyAs( "rowVec", vecs[0] );
+	props.setPropertyAs( "columnVec", vecs[1] );
+	props.setPropertyAs( "sliceVec", vecs[2] );
+}
+
+/// \returns true if the voxels of the given type can be copied as unsigned integers of the same size (they are integers themselves)
+bool isIntegralType( unsigned short typeID )
+{
+	return typeID == ValuePtr<bool>::staticID ||
+		   typeID == ValuePtr<int8_t>::staticID || typeID == ValuePtr<uint8_t>::staticID ||
+		   typeID == ValuePtr<int16_t>::staticID || typeID == ValuePtr<uint16_t>::staticID ||
+		   typeID == ValuePtr<int32_t>::staticID || typeID == ValuePtr<uint32_t>::staticID ||
+		   typeID == ValuePtr<int64_t>::staticID || typeID == ValuePtr<uint64_t>::staticID;
+}
+
+/// copies the slices of a ChunkView into contiguous memory (used by ChunkView::materialize)
+class MaterializeWorker
+{
+	static const size_t blockSize = 64;
+	const ChunkView &m_view;
+	const util::FixedVector<size_t, 4> m_size;
+	const uint8_t *const m_src;
+	uint8_t *const m_dst;
+	const size_t m_elSize;
+	const bool m_integral; // other types (e.g. float or complex) might have a different alignment, so they are copied bytewise
+
+	template<typename T> void copyBlock( const size_t idx[], size_t ymax, size_t xmin, size_t xmax, uint8_t *dst )const {
+		const ptrdiff_t stride = m_view.getStride( rowDim );
+		size_t line_idx[] = {0, idx[1], idx[2], idx[3]};
+
+		for( ; line_idx[1] < ymax; line_idx[1]++ ) {
+			const T *const line = reinterpret_cast<const T *>( m_src ) + m_view.getMemoryIndex( line_idx );
+			T *const to = reinterpret_cast<T *>( dst ) + line_idx[1] * m_size[0];
+
+			for( size_t x = xmin; x < xmax; x++ )
+				to[x] = line[( ptrdiff_t )x * stride];
+		}
+	}
+	void copyBlockBytes( const size_t idx[], size_t ymax, size_t xmin, size_t xmax, uint8_t *dst )const {
+		const ptrdiff_t stride = m_view.getStride( rowDim ) * ( ptrdiff_t )m_elSize;
+		size_t line_idx[] = {0, idx[1], idx[2], idx[3]};
+
+		for( ; line_idx[1] < ymax; line_idx[1]++ ) {
+			const uint8_t *const line = m_src + m_view.getMemoryIndex( line_idx ) * m_elSize;
+			uint8_t *const to = dst + line_idx[1] * m_size[0] * m_elSize;
+
+			for( size_t x = xmin; x < xmax; x++ )
+				memcpy( to + x * m_elSize, line + ( ptrdiff_t )x * stride, m_elSize );
+		}
+	}
+public:
+	MaterializeWorker( const ChunkView &view, const uint8_t *src, uint8_t *dst ):
+		m_view( view ), m_size( view.getSizeAsVector() ), m_src( src ), m_dst( dst ), m_elSize( view.bytesPerVoxel() ), m_integral( isIntegralType( view.getTypeID() ) ) {}
+	void operator()( size_t slice ) {
+		const size_t idx[] = {0, 0, slice % m_size[2], slice / m_size[2]};
+		uint8_t *const dst = m_dst + slice * m_size[0] * m_size[1] * m_elSize;
+
+		if( m_view.getStride( rowDim ) == 1 ) { // the lines are contiguous - copy them as a whole
+			size_t line_idx[] = {0, 0, idx[2], idx[3]};
+
+			for( ; line_idx[1] < m_size[1]; line_idx[1]++ )
+				memcpy( dst + line_idx[1] * m_size[0] * m_elSize, m_src + m_view.getMemoryIndex( line_idx ) * m_elSize, m_size[0] * m_elSize );
+
+			return;
+		}
+
+		// otherwise copy the slice in blocks, so the lines of the source (which might be columns of the view) stay in the cache
+		for( size_t by = 0; by < m_size[1]; by += blockSize ) {
+			const size_t block_idx[] = {0, by, idx[2], idx[3]};
+			const size_t ymax = std::min<size_t>( by + blockSize, m_size[1] );
+
+			for( size_t bx = 0; bx < m_size[0]; bx += blockSize ) {
+				const size_t xmax = std::min<size_t>( bx + blockSize, m_size[0] );
+
+				switch( m_integral ? m_elSize : 0 ) {
+				case 1:
+					copyBlock<uint8_t>( block_idx, ymax, bx, xmax, dst );
+					break;
+				case 2:
+					copyBlock<uint16_t>( block_idx, ymax, bx, xmax, dst );
+					break;
+				case 4:
+					copyBlock<uint32_t>( block_idx, ymax, bx, xmax, dst );
+					break;
+				case 8:
+					copyBlock<uint64_t>( block_idx, ymax, bx, xmax, dst );
+					break;
+				default:
+					copyBlockBytes( block_idx, ymax, bx, xmax, dst );
+				}
+			}
+		}
+	}
+};
+}
+
+ChunkView Chunk::getView()const
+{
+	const util::FixedVector<size_t, 4> size = getSizeAsVector();
+	ptrdiff_t strides[dims];
+	strides[0] = 1;
+
+	for( unsigned short i = 1; i < dims; i++ )
+		strides[i] = strides[i - 1] * size[i - 1];
+
+	ChunkView ret( *this, &size[0], 0, strides );
+	static_cast<util::PropertyMap &>( ret ) = static_cast<const util::PropertyMap &>( *this );
+	return ret;
+}
+
+ChunkView Chunk::getView( const size_t start[], const size_t size[], const size_t step[] )const
+{
+	return getView().getView( start, size, step );
+}
+
+ChunkView::ChunkView( const ValuePtrReference &data, const size_t size[], ptrdiff_t offset, const ptrdiff_t strides[] ):
+	_internal::ChunkBase( size[0], size[1], size[2], size[3] ), m_data( data ), m_offset( offset )
+{
+	std::copy( strides, strides + dims, m_strides );
+}
+
+size_t ChunkView::bytesPerVoxel()const
+{
+	return m_data->bytesPerElem();
+}
+std::string ChunkView::getTypeName()const
+{
+	return m_data->getTypeName();
+}
+unsigned short ChunkView::getTypeID()const
+{
+	return m_data->getTypeID();
+}
+
+bool ChunkView::isContiguous()const
+{
+	const util::FixedVector<size_t, 4> size = getSizeAsVector();
+	ptrdiff_t expected = 1;
+
+	for( unsigned short i = 0; i < dims; i++ ) {
+		if( size[i] > 1 && m_strides[i] != expected )
+			return false;
+
+		expected *= size[i];
+	}
+
+	return true;
+}
+
+void ChunkView::flip( dimensions dim )
+{
+	const size_t size = getDimSize( dim );
+	m_offset += ( ptrdiff_t )( size - 1 ) * m_strides[dim]; // start at the other end
+	m_strides[dim] = -m_strides[dim]; // and go backwards
+
+	if( dim < timeDim && _internal::hasGeometry( *this ) ) {
+		const util::fvector4 voxelSize = getPropertyAs<util::fvector4>( "voxelSize" );
+		util::fvector4 voxelGap;
+
+		if( hasProperty( "voxelGap" ) )
+			voxelGap = getPropertyAs<util::fvector4>( "voxelGap" );
+
+		util::fvector4 vecs[3];
+		_internal::getDirections( *this, vecs );
+		util::fvector4 &origin = propertyValue( "indexOrigin" )->castTo<util::fvector4>();
+		origin = origin + vecs[dim] * ( ( voxelSize[dim] + voxelGap[dim] ) * ( size - 1 ) );
+		vecs[dim] = vecs[dim] * -1.f;
+		_internal::setDirections( *this, vecs );
+	}
+}
+
+ChunkView ChunkView::getView( const size_t start[], const size_t size[], const size_t step[] )const
+{
+	static const size_t one[] = {1, 1, 1, 1};
+
+	if( !step )
+		step = one;
+
+	ptrdiff_t strides[dims];
+
+	for( unsigned short i = 0; i < dims; i++ ) {
+		if( size[i] == 0 || step[i] == 0 ) {
+			LOG( Runtime, error ) << "Can't get a view of size " << util::FixedVector<size_t, 4>( size ) << " and step " << util::FixedVector<size_t, 4>( step );
+			throw( std::invalid_argument( "size and step of a view must not be zero" ) );
+		}
+
+		// written so that it can't wrap around: start + (size-1)*step must be smaller than the size of the dimension
+		const size_t dimSize = getDimSize( i );
+
+		if( start[i] >= dimSize || ( size[i] - 1 ) > ( dimSize - 1 - start[i] ) / step[i] ) {
+			LOG( Runtime, error )
+					<< "The view from " << util::FixedVector<size_t, 4>( start ) << " of size " << util::FixedVector<size_t, 4>( size )
+					<< " and step " << util::FixedVector<size_t, 4>( step ) << " is out of range (" << getSizeAsString() << ")";
+			throw( std::out_of_range( "the view is out of range" ) );
+		}
+
+		strides[i] = m_strides[i] * ( ptrdiff_t )step[i];
+	}
+
+	ChunkView ret( m_data, size, getMemoryIndex( start ), strides );
+	static_cast<util::PropertyMap &>( ret ) = static_cast<const util::PropertyMap &>( *this );
+
+	// move the indexOrigin to the first voxel of the view, and widen the voxel distance by step
+	if( _internal::hasGeometry( ret ) ) {
+		const util::fvector4 voxelSize = ret.getPropertyAs<util::fvector4>( "voxelSize" );
+		util::fvector4 voxelGap;
+
+		if( ret.hasProperty( "voxelGap" ) )
+			voxelGap = ret.getPropertyAs<util::fvector4>( "voxelGap" );
+
+		util::fvector4 vecs[3];
+		_internal::getDirections( ret, vecs );
+		util::fvector4 &origin = ret.propertyValue( "indexOrigin" )->castTo<util::fvector4>();
+		bool stepped = false;
+
+		for( unsigned short i = 0; i < 3; i++ ) {
+			const float distance = voxelSize[i] + voxelGap[i];
+			origin = origin + vecs[i] * ( distance * start[i] );
+
+			if( step[i] > 1 ) {
+				voxelGap[i] = distance * step[i] - voxelSize[i];
+				stepped = true;
+			}
+		}
+
+		if( stepped )
+			ret.setPropertyAs( "voxelGap", voxelGap );
+	}
+
+	return ret;
+}
+
+Chunk ChunkView::materialize()const
+{
+	const util::FixedVector<size_t, 4> size = getSizeAsVector();
+	const ValuePtrReference dst = m_data->cloneToNew( getVolume() );
+	const boost::shared_ptr<void> src_addr = m_data->getRawAddress().lock(), dst_addr = dst->getRawAddress().lock();
+	_internal::MaterializeWorker worker( *this, static_cast<const uint8_t *>( src_addr.get() ), static_cast<uint8_t *>( dst_addr.get() ) );
+	util::ThreadPool::get().parallel_for( 0, size[2] * size[3], worker );
+
+	Chunk ret( dst, size[0], size[1], size[2], size[3] );
+	static_cast<util::PropertyMap &>( ret ) = static_cast<const util::PropertyMap &>( *this );
+	return ret;
+}
 }
 }
@@ -30,6 +30,7 @@ namespace data
 {
 
 class Chunk;
+class ChunkView;
 
 namespace _internal
 {
@@ -62,6 +63,7 @@ public:
 class Chunk : public _internal::ChunkBase, protected ValuePtrReference
 {
 	friend class Image;
+	friend class ChunkView;
 	friend class std::vector<Chunk>;
 protected:
 	/**
@@ -142,6 +144,76 @@ public:
 		return foreachVoxel<TYPE>( op, util::FixedVector<size_t, 4>() );
 	}
 
+	/**
+	 * Run a functor on every Voxel in the chunk (statically dispatched).
+	 * Works like foreachVoxel(VoxelOp<TYPE> &,util::FixedVector<size_t, 4>), but op can be of any type providing
+	 * bool operator()( TYPE &vox, const util::FixedVector<size_t, 4> &pos ). So the call can be inlined.
+	 * If the data of the chunk are not of type TYPE, behaviour is undefined.
+	 * \param op the functor
+	 * \param offset offset to be added to the voxel position before op is called
+	 * \returns amount of operations which returned false - so 0 is good!
+	 */
+	template <typename TYPE, typename OP> size_t foreachVoxelInlined( OP &op, const util::FixedVector<size_t, 4> &offset ) {
+		const util::FixedVector<size_t, 4> end = getSizeAsVector() + offset;
+		util::FixedVector<size_t, 4> pos;
+		TYPE *vox = &asValuePtr<TYPE>()[0];
+		size_t ret = 0;
+
+		for( pos[timeDim] = offset[timeDim]; pos[timeDim] < end[timeDim]; pos[timeDim]++ )
+			for( pos[sliceDim] = offset[sliceDim]; pos[sliceDim] < end[sliceDim]; pos[sliceDim]++ )
+				for( pos[columnDim] = offset[columnDim]; pos[columnDim] < end[columnDim]; pos[columnDim]++ )
+					for( pos[rowDim] = offset[rowDim]; pos[rowDim] < end[rowDim]; pos[rowDim]++ ) {
+						if( op( *( vox++ ), pos ) == false )
+							++ret;
+					}
+
+		return ret;
+	}
+	/**
+	 * Run a functor on every Voxel in the chunk (statically dispatched).
+	 * \copydetails Chunk::foreachVoxelInlined(OP &,const util::FixedVector<size_t, 4> &)
+	 */
+	template <typename TYPE, typename OP> size_t foreachVoxelInlined( OP &op ) {
+		return foreachVoxelInlined<TYPE, OP>( op, util::FixedVector<size_t, 4>() );
+	}
+
+	/**
+	 * Run a functor on the value of every voxel in the chunk, regardless of its position.
+	 * op has to provide operator()( TYPE &vox ) (its return value is ignored).
+	 * As there is no position to track, this is a plain loop over the memory which the compiler can inline and vectorize.
+	 * If the data of the chunk are not of type TYPE, behaviour is undefined.
+	 */
+	template <typename TYPE, typename OP> void foreachValue( OP &op ) {
+		TYPE *const vox = &asValuePtr<TYPE>()[0];
+		const size_t volume = getVolume();
+
+		for( size_t i = 0; i < volume; i++ )
+			op( vox[i] );
+	}
+	/// \copydoc Chunk::foreachValue
+	template <typename TYPE, typename OP> void foreachValue( OP &op )const {
+		const TYPE *const vox = &getValuePtr<TYPE>()[0];
+		const size_t volume = getVolume();
+
+		for( size_t i = 0; i < volume; i++ )
+			op( vox[i] );
+	}
+
+	/**
+	 * Run a functor on the memory of the chunk as a whole.
+	 * op has to provide operator()( TYPE *begin, TYPE *end ), which is called once with the voxels of the chunk (in the order of their linear index).
+	 * If the data of the chunk are not of type TYPE, behaviour is undefined.
+	 */
+	template <typename TYPE, typename OP> void foreachSpan( OP &op ) {
+		TYPE *const begin = &asValuePtr<TYPE>()[0];
+		op( begin, begin + getVolume() );
+	}
+	/// \copydoc Chunk::foreachSpan
+	template <typename TYPE, typename OP> void foreachSpan( OP &op )const {
+		const TYPE *const begin = &getValuePtr<TYPE>()[0];
+		op( begin, begin + getVolume() );
+	}
+
 	_internal::ValuePtrBase &asValuePtrBase() {
 		return operator*();
 	}
@@ -256,6 +328,104 @@ public:
 	  */
 	void swapAlong( const dimensions dim ) const;
 
+	/// \returns a view of the whole chunk (see ChunkView)
+	ChunkView getView()const;
+	/**
+	 * Get a view of a part of the chunk, without copying any data.
+	 * Unlike splice this works along any dimension, so single rows, sagittal slices or subvolumes can be taken out
+	 * of the chunk. The view shares the memory of the chunk, so writing through it will change the chunk.
+	 * indexOrigin and voxelGap of the view are set according to start and step.
+	 * \param start the first voxel of the view
+	 * \param size the size of the view
+	 * \param step the distance (in voxels of this chunk) between two voxels of the view per dimension, NULL means 1 for all
+	 * \throws std::invalid_argument if any size or step is zero
+	 * \throws std::out_of_range if the view doesn't fit into the chunk
+	 */
+	ChunkView getView( const size_t start[], const size_t size[], const size_t step[] = NULL )const;
+};
+
+/**
+ * Non-owning view of a part of the memory of a Chunk.
+ * The voxels of a view are not contiguous in memory, their position is given by an offset and a stride per dimension.
+ * They are accessed through voxel<TYPE> just like in a Chunk. The view keeps the memory of the chunk it was taken from
+ * alive, and writing through the view changes that chunk. A contiguous copy is only made if materialize is called.
+ * \code
+ * const size_t start[] = {x, 0, 0, 0}, size[] = {1, ch.getSizeAsVector()[1], ch.getSizeAsVector()[2], 1};
+ * ChunkView sagittal = ch.getView( start, size ); // no copy
+ * Chunk copy = sagittal.materialize(); // copies only the voxels of the view
+ * \endcode
+ * Flipping a view only changes its offset and strides (see flip), no voxel is moved until the view is materialized.
+ *
+ * A view is not a Chunk. It can't be inserted into an Image, written by the IOFactory or used in any operation taking
+ * a Chunk (like foreachVoxel, convertToType or copyRange) - call materialize to get a Chunk for that.
+ * isisflip flips images this way, Image itself doesn't hold views (see Chunk::swapAlong to flip a chunk in place).
+ */
+class ChunkView : public _internal::ChunkBase
+{
+	friend class Chunk;
+	ValuePtrReference m_data;
+	ptrdiff_t m_offset, m_strides[dims];
+	ChunkView( const ValuePtrReference &data, const size_t size[], ptrdiff_t offset, const ptrdiff_t strides[] );
+	ChunkView() {}; //do not use this
+public:
+	/// \returns the index of the voxel at the given position in the memory of the chunk the view was taken from
+	size_t getMemoryIndex( const size_t idx[] )const {
+		ptrdiff_t ret = m_offset;
+
+		for( unsigned short i = 0; i < dims; i++ )
+			ret += ( ptrdiff_t )idx[i] * m_strides[i];
+
+		assert( ret >= 0 );
+		return ret;
+	}
+	/**
+	 * Gets a reference to the element at a given index.
+	 * \copydetails Chunk::voxel
+	 */
+	template<typename TYPE> TYPE &voxel( size_t nrOfColumns, size_t nrOfRows = 0, size_t nrOfSlices = 0, size_t nrOfTimesteps = 0 ) {
+		const size_t idx[] = {nrOfColumns, nrOfRows, nrOfSlices, nrOfTimesteps};
+		LOG_IF( ! isInRange( idx ), Debug, isis::error )
+				<< "Index " << util::FixedVector<size_t, 4>( idx ) << " is out of range " << getSizeAsString();
+		return m_data->castToValuePtr<TYPE>()[getMemoryIndex( idx )];
+	}
+	/**
+	 * Gets a const reference of the element at a given index.
+	 * \copydetails Chunk::voxel
+	 */
+	template<typename TYPE> const TYPE &voxel( size_t nrOfColumns, size_t nrOfRows = 0, size_t nrOfSlices = 0, size_t nrOfTimesteps = 0 )const {
+		const size_t idx[] = {nrOfColumns, nrOfRows, nrOfSlices, nrOfTimesteps};
+		LOG_IF( ! isInRange( idx ), Debug, isis::error )
+				<< "Index " << util::FixedVector<size_t, 4>( idx ) << " is out of range " << getSizeAsString();
+		const _internal::ValuePtrBase &data = *m_data;
+		return data.castToValuePtr<TYPE>()[getMemoryIndex( idx )];
+	}
+	template<typename T> bool is()const {
+		return m_data->is<T>();
+	}
+	size_t bytesPerVoxel()const;
+	std::string getTypeName()const;
+	unsigned short getTypeID()const;
+
+	/// \returns the distance in memory (in voxels) between two neighbours along the given dimension
+	ptrdiff_t getStride( dimensions dim )const {return m_strides[dim];}
+	/// \returns true if the voxels of the view are stored contiguously (in the order of the dimensions)
+	bool isContiguous()const;
+
+	/**
+	 * Reverse the order of the voxels along the given dimension, without touching any data.
+	 * indexOrigin and the direction vector of the dimension are adapted, so every voxel keeps its position in scanner space.
+	 */
+	void flip( dimensions dim );
+
+	/// \returns a view of a part of this view (see Chunk::getView)
+	ChunkView getView( const size_t start[], const size_t size[], const size_t step[] = NULL )const;
+
+	/**
+	 * Copy the voxels of the view into a new contiguous Chunk of the same type.
+	 * The slices are copied in parallel (see util::ThreadPool), in blocks so that reading along a flipped or stepped
+	 * dimension stays in the cache. The properties of the view are copied as well.
+	 */
+	Chunk materialize()const;
 };
 
 /// Chunk class for memory-based buffers
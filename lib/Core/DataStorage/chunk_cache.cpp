@@ -0,0 +1,522 @@
+/*
+    Copyright (C) 2010  reimer@cbs.mpg.de
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "chunk_cache.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace isis
+{
+namespace data
+{
+namespace _internal
+{
+namespace
+{
+/*
+ * Layout of a cache file:
+ * - the magic string
+ * - offset of the index (uint64_t)
+ * - the voxel data of the chunks which are not stored in the source (each aligned to 16 bytes)
+ * - the index:
+ *   - the key the file was stored with
+ *   - size and modification time of the source
+ *   - the amount of chunks
+ *   - for every chunk: type id, size, where its voxel data is (in_cache or in_source), offset and length of it, and its properties (see PropertyMap::writeBinary)
+ */
+const char magic[] = "isis chunk cache 2\n";
+const size_t alignment = 16;
+enum DataLocation {in_cache = 0, in_source = 1};
+
+template<typename T> void write( std::ostream &out, const T &val ) {out.write( reinterpret_cast<const char *>( &val ), sizeof( T ) );}
+template<typename T> bool read( std::istream &in, T &val ) {return in.read( reinterpret_cast<char *>( &val ), sizeof( T ) );}
+
+void writeString( std::ostream &out, const std::string &str )
+{
+	write( out, uint32_t( str.length() ) );
+	out.write( str.data(), str.length() );
+}
+bool readString( std::istream &in, std::string &str )
+{
+	uint32_t len;
+
+	if( !read( in, len ) )
+		return false;
+
+	str.resize( len );
+	return len == 0 || in.read( &str[0], len );
+}
+
+#ifndef WIN32
+/// the mapped cache file, shared by all chunks restored from it
+struct Mapping {
+	void *m_base;
+	size_t m_length;
+	Mapping( void *base, size_t length ): m_base( base ), m_length( length ) {}
+	~Mapping() {munmap( m_base, m_length );}
+};
+struct MappingDeleter {
+	boost::shared_ptr<Mapping> m_mapping;
+	MappingDeleter( const boost::shared_ptr<Mapping> &mapping ): m_mapping( mapping ) {}
+	void operator()( void *at ) {
+		LOG( Debug, verbose_info ) << "Releasing cached chunk at " << at;
+		m_mapping.reset();
+	}
+};
+
+/// map a whole file privately (so the chunks may change the data)
+boost::shared_ptr<Mapping> mapFile( const std::string &filename, size_t &length )
+{
+	const int file = open( filename.c_str(), O_RDONLY );
+	struct stat st;
+
+	if( file == -1 || fstat( file, &st ) == -1 || st.st_size == 0 ) {
+		if( file != -1 )
+			close( file );
+
+		return boost::shared_ptr<Mapping>();
+	}
+
+	void *const base = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0 );
+	close( file );
+
+	if( base == MAP_FAILED ) {
+		LOG( Runtime, warning ) << "Failed to map " << util::MSubject( filename ) << " (" << strerror( errno ) << ")";
+		return boost::shared_ptr<Mapping>();
+	}
+
+	length = st.st_size;
+	return boost::shared_ptr<Mapping>( new Mapping( base, st.st_size ) );
+}
+
+/**
+ * The mappings of a source file in this process.
+ * Plugins which map their files (e.g. raw, isis, uncompressed dicom) hand out chunks pointing into those mappings, so the cache can just reference the source.
+ * The mappings are looked up once in /proc/self/maps (so this only works on linux).
+ */
+class SourceMappings: boost::noncopyable
+{
+	struct Region {
+		uintptr_t start, end;
+		uint64_t offset;
+		bool shared;
+	};
+	std::vector<Region> m_regions;
+	uint64_t m_file_size;
+	const size_t m_page_size;
+	int m_file, m_pagemap;
+
+	/**
+	 * Writing to a private mapping replaces the written page by an anonymous copy, all other pages still are the pages of the file.
+	 * /proc/self/pagemap tells those apart (bit 61 is set for pages of files, bit 63 and 62 are set for present or swapped pages).
+	 * 
+eturns false if the page may have been changed (or this is not known)
+	 */
+	bool isFilePage( uint64_t entry, bool known )const {
+		return known && ( ( entry & ( 1ULL << 61 ) ) || !( entry & ( 3ULL << 62 ) ) );
+	}
+	/// compare the memory to the file at the given offset
+	bool compare( const char *at, size_t length, uint64_t offset )const {
+		char buffer[4096];
+
+		for( size_t pos = 0; pos < length; pos += sizeof( buffer ) ) {
+			const size_t block = std::min( sizeof( buffer ), length - pos );
+
+			if( pread( m_file, buffer, block, offset + pos ) != ssize_t( block ) || memcmp( buffer, at + pos, block ) != 0 )
+				return false;
+		}
+
+		return true;
+	}
+public:
+	SourceMappings( const boost::filesystem::path &source ): m_file_size( 0 ), m_page_size( sysconf( _SC_PAGESIZE ) ), m_file( -1 ), m_pagemap( -1 ) {
+		struct stat st;
+		std::ifstream maps( "/proc/self/maps" );
+
+		if( !maps || stat( source.file_string().c_str(), &st ) == -1 )
+			return;
+
+		m_file_size = st.st_size;
+
+		for( std::string line; std::getline( maps, line ); ) {
+			// start-end perms offset major:minor inode pathname
+			unsigned long long start, end, offset, inode;
+			unsigned int dev_major, dev_minor;
+			char perms[5];
+
+			if(
+				sscanf( line.c_str(), "%llx-%llx %4s %llx %x:%x %llu", &start, &end, perms, &offset, &dev_major, &dev_minor, &inode ) == 7 &&
+				inode == st.st_ino && makedev( dev_major, dev_minor ) == st.st_dev
+			) {
+				const Region region = {uintptr_t( start ), uintptr_t( end ), offset, perms[3] == 's'};
+				m_regions.push_back( region );
+			}
+		}
+
+		if( !m_regions.empty() ) {
+			m_file = open( source.file_string().c_str(), O_RDONLY );
+			m_pagemap = open( "/proc/self/pagemap", O_RDONLY );
+			LOG_IF( m_pagemap == -1, Debug, info ) << "Can't read /proc/self/pagemap, mapped chunks will be compared to " << util::MSubject( source );
+		}
+	}
+	~SourceMappings() {
+		if( m_file != -1 )
+			close( m_file );
+
+		if( m_pagemap != -1 )
+			close( m_pagemap );
+	}
+	/**
+	 * Find out if the given memory is an unchanged part of a mapping of the source.
+	 * Private mappings may have been modified (e.g. endianess swapped), so the pages which were written to are compared to the file.
+	 * 
+eturns true if the memory is found in the source, offset will then be the position of the memory in the file
+	 */
+	bool find( const void *at, size_t length, uint64_t &offset )const {
+		const uintptr_t addr = reinterpret_cast<uintptr_t>( at );
+		const Region *found = NULL;
+
+		for( std::vector<Region>::const_iterator i = m_regions.begin(); !found && i != m_regions.end(); ++i )
+			if( addr >= i->start && addr < i->end && length <= i->end - addr )
+				found = &*i;
+
+		if( !found || m_file == -1 )
+			return false;
+
+		offset = found->offset + ( addr - found->start );
+
+		if( offset > m_file_size || length > m_file_size - offset )
+			return false;
+
+		if( found->shared ) // shared mappings always show the file
+			return true;
+
+		const uintptr_t first_page = addr / m_page_size, last_page = ( addr + length - 1 ) / m_page_size;
+		std::vector<uint64_t> entries( 512 );
+
+		for( uintptr_t page = first_page; page <= last_page; page += entries.size() ) {
+			const size_t count = std::min<uintptr_t>( entries.size(), last_page - page + 1 );
+			const bool known = m_pagemap != -1 &&
+							   pread( m_pagemap, &entries[0], count * sizeof( uint64_t ), page * sizeof( uint64_t ) ) == ssize_t( count * sizeof( uint64_t ) );
+
+			for( size_t i = 0; i < count; i++ ) {
+				if( isFilePage( entries[i], known ) )
+					continue;
+
+				// only the part of the memory within that page
+				const uintptr_t from = std::max<uintptr_t>( addr, ( page + i ) * m_page_size ), to = std::min<uintptr_t>( addr + length, ( page + i + 1 ) * m_page_size );
+
+				if( !compare( reinterpret_cast<const char *>( from ), to - from, offset + ( from - addr ) ) )
+					return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+class CachedChunk: public Chunk
+{
+public:
+	template<typename TYPE> CachedChunk( TYPE *src, MappingDeleter del, const util::FixedVector<size_t, 4> &size ):
+		Chunk( src, del, size[0], size[1], size[2], size[3] ) {}
+};
+
+/// create a chunk of the type referenced by id (which must be one of the types a ValuePtr can have)
+bool makeChunk( std::list<Chunk> &chunks, unsigned short id, void *data, const MappingDeleter &del, const util::FixedVector<size_t, 4> &size )
+{
+#define CACHED_CHUNK(TYPE) case ValuePtr<TYPE>::staticID: chunks.push_back( CachedChunk( static_cast<TYPE*>( data ), del, size ) ); break
+
+	switch( id ) {
+		CACHED_CHUNK( bool );
+		CACHED_CHUNK( int8_t );
+		CACHED_CHUNK( uint8_t );
+		CACHED_CHUNK( int16_t );
+		CACHED_CHUNK( uint16_t );
+		CACHED_CHUNK( int32_t );
+		CACHED_CHUNK( uint32_t );
+		CACHED_CHUNK( int64_t );
+		CACHED_CHUNK( uint64_t );
+		CACHED_CHUNK( float );
+		CACHED_CHUNK( double );
+		CACHED_CHUNK( util::color24 );
+		CACHED_CHUNK( util::color48 );
+		CACHED_CHUNK( std::complex<float> );
+		CACHED_CHUNK( std::complex<double> );
+	default:
+		return false;
+	}
+
+#undef CACHED_CHUNK
+	return true;
+}
+#endif
+}
+
+void ChunkCache::setDirectory( const boost::filesystem::path &dir )
+{
+#ifdef WIN32
+	LOG_IF( !dir.empty(), Runtime, warning ) << "The chunk cache is not available on this platform";
+#else
+	m_directory = dir;
+
+	if( !dir.empty() ) {
+		try {
+			boost::filesystem::create_directories( dir );
+			LOG( Runtime, info ) << "Using " << util::MSubject( dir ) << " as chunk cache";
+		} catch( const boost::filesystem::filesystem_error &e ) {
+			LOG( Runtime, warning ) << "Failed to create the chunk cache directory " << util::MSubject( dir ) << " (" << e.what() << "), won't use it";
+			m_directory = boost::filesystem::path();
+		}
+	}
+
+#endif
+}
+
+const boost::filesystem::path &ChunkCache::getDirectory()const {return m_directory;}
+bool ChunkCache::isEnabled()const {return !m_directory.empty();}
+
+std::string ChunkCache::makeKey( const boost::filesystem::path &filename, const std::string &suffix_override, const std::string &dialect )const
+{
+	return boost::filesystem::complete( filename ).file_string() + '\n' + suffix_override + '\n' + dialect;
+}
+
+boost::filesystem::path ChunkCache::cacheFile( const std::string &key )const
+{
+	std::ostringstream name;
+	name << std::hex << boost::hash<std::string>()( key ) << ".isiscache";
+	return m_directory / name.str();
+}
+
+size_t ChunkCache::load( std::list<Chunk> &chunks, const boost::filesystem::path &filename, const std::string &suffix_override, const std::string &dialect )const
+{
+#ifdef WIN32
+	return 0;
+#else
+
+	if( !boost::filesystem::is_regular( filename ) )
+		return 0;
+
+	const std::string key = makeKey( filename, suffix_override, dialect );
+	const boost::filesystem::path cache = cacheFile( key );
+	const int file = open( cache.file_string().c_str(), O_RDONLY );
+	struct stat st;
+
+	if( file == -1 ) {
+		LOG( Debug, verbose_info ) << "There is no cache entry for " << util::MSubject( filename );
+		return 0;
+	}
+
+	if( fstat( file, &st ) == -1 || size_t( st.st_size ) < sizeof( magic ) + sizeof( uint64_t ) ) {
+		close( file );
+		return 0;
+	}
+
+	void *const base = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0 );
+	close( file );
+
+	if( base == MAP_FAILED ) {
+		LOG( Runtime, warning ) << "Failed to map the cache file " << util::MSubject( cache ) << " (" << strerror( errno ) << ")";
+		return 0;
+	}
+
+	// the mapping is released when the last chunk using it is gone (or right away if there are none)
+	const MappingDeleter del( boost::shared_ptr<Mapping>( new Mapping( base, st.st_size ) ) );
+	const uint8_t *const bytes = static_cast<uint8_t *>( base );
+	uint64_t index_offset;
+	memcpy( &index_offset, bytes + sizeof( magic ), sizeof( index_offset ) );
+
+	if( memcmp( bytes, magic, sizeof( magic ) ) != 0 || index_offset > uint64_t( st.st_size ) ) {
+		LOG( Runtime, warning ) << util::MSubject( cache ) << " is no valid cache file, ignoring it";
+		return 0;
+	}
+
+	std::istringstream index( std::string( reinterpret_cast<const char *>( bytes ) + index_offset, st.st_size - index_offset ) );
+	std::string stored_key;
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint32_t count;
+
+	if( !readString( index, stored_key ) || !read( index, source_size ) || !read( index, source_mtime ) || !read( index, count ) )
+		return 0;
+
+	if( stored_key != key ) {
+		LOG( Debug, info ) << "Cache entry " << util::MSubject( cache ) << " belongs to another file";
+		return 0;
+	}
+
+	if( source_size != boost::filesystem::file_size( filename ) || source_mtime != boost::filesystem::last_write_time( filename ) ) {
+		LOG( Runtime, info ) << util::MSubject( filename ) << " changed since it was cached";
+		return 0;
+	}
+
+	std::list<Chunk> restored;
+	boost::shared_ptr<MappingDeleter> source_del; // the source is mapped when its needed first
+	size_t source_length = 0;
+
+	for( uint32_t i = 0; i < count; i++ ) {
+		uint16_t id;
+		uint8_t location;
+		uint64_t size[4], offset, length;
+
+		if( !read( index, id ) || !read( index, size ) || !read( index, location ) || !read( index, offset ) || !read( index, length ) ) {
+			LOG( Runtime, warning ) << "Cache entry " << util::MSubject( cache ) << " is broken";
+			return 0;
+		}
+
+		const size_t buff[] = {size_t( size[0] ), size_t( size[1] ), size_t( size[2] ), size_t( size[3] )};
+		const util::FixedVector<size_t, 4> chunk_size( buff );
+		uint8_t *data;
+
+		if( location == in_source ) {
+			if( !source_del ) {
+				const boost::shared_ptr<Mapping> mapping = mapFile( filename.file_string(), source_length );
+
+				if( !mapping )
+					return 0;
+
+				source_del.reset( new MappingDeleter( mapping ) );
+			}
+
+			data = static_cast<uint8_t *>( source_del->m_mapping->m_base ) + offset;
+		} else
+			data = static_cast<uint8_t *>( base ) + offset;
+
+		if( location > in_source || offset + length > ( location == in_source ? source_length : index_offset ) ) {
+			LOG( Runtime, warning ) << "Cache entry " << util::MSubject( cache ) << " is broken";
+			return 0;
+		}
+
+		if( !makeChunk( restored, id, data, location == in_source ? *source_del : del, chunk_size ) ) {
+			LOG( Runtime, warning ) << "Cache entry " << util::MSubject( cache ) << " contains the unknown type id " << id;
+			return 0;
+		}
+
+		if( restored.back().bytesPerVoxel() * restored.back().getVolume() != length || !restored.back().readBinary( index ) ) {
+			LOG( Runtime, warning ) << "Cache entry " << util::MSubject( cache ) << " is broken";
+			return 0;
+		}
+	}
+
+	LOG( Runtime, info ) << "Restored " << count << " chunks of " << util::MSubject( filename ) << " from the cache";
+	chunks.splice( chunks.end(), restored );
+	return count;
+#endif
+}
+
+void ChunkCache::store( std::list<Chunk>::const_iterator begin, std::list<Chunk>::const_iterator end, const boost::filesystem::path &filename, const std::string &suffix_override, const std::string &dialect )const
+{
+#ifndef WIN32
+
+	if( !boost::filesystem::is_regular( filename ) )
+		return;
+
+	try {
+		const std::string key = makeKey( filename, suffix_override, dialect );
+		const boost::filesystem::path cache = cacheFile( key );
+		std::ostringstream tmpname;
+		tmpname << cache.file_string() << ".tmp" << getpid() << '.' << boost::this_thread::get_id(); // another thread may store the same file at the same time
+		const boost::filesystem::path tmp( tmpname.str() );
+		std::ostringstream index;
+		std::ofstream out( tmp.file_string().c_str(), std::ios::binary | std::ios::trunc );
+		const SourceMappings mappings( filename );
+		uint32_t count = 0;
+
+		writeString( index, key );
+		write( index, uint64_t( boost::filesystem::file_size( filename ) ) );
+		write( index, int64_t( boost::filesystem::last_write_time( filename ) ) );
+		write( index, uint32_t( std::distance( begin, end ) ) );
+
+		out.write( magic, sizeof( magic ) );
+		write( out, uint64_t( 0 ) ); // the offset of the index will be written at the end
+
+		for( ; begin != end; ++begin, ++count ) {
+			const Chunk &chunk = *begin;
+			const size_t length = chunk.bytesPerVoxel() * chunk.getVolume();
+			const util::FixedVector<size_t, 4> size = chunk.getSizeAsVector();
+			const boost::shared_ptr<const void> data = chunk.getValuePtrBase().getRawAddress().lock();
+			uint64_t offset;
+			uint8_t location = in_source;
+
+			// if the voxel data are just a mapping of the source, reference them there - otherwise (decoded, decompressed or converted data) copy them into the cache
+			if( !mappings.find( data.get(), length, offset ) ) {
+				location = in_cache;
+				offset = ( ( uint64_t( out.tellp() ) + alignment - 1 ) / alignment ) * alignment;
+				const std::string padding( offset - out.tellp(), '\0' );
+				out.write( padding.data(), padding.length() );
+				out.write( static_cast<const char *>( data.get() ), length );
+			}
+
+			write( index, uint16_t( chunk.getTypeID() ) );
+
+			for( int i = 0; i < 4; i++ )
+				write( index, uint64_t( size[i] ) );
+
+			write( index, location );
+			write( index, offset );
+			write( index, uint64_t( length ) );
+			chunk.writeBinary( index );
+		}
+
+		const uint64_t index_offset = out.tellp();
+		const std::string index_data = index.str();
+		out.write( index_data.data(), index_data.length() );
+		out.seekp( sizeof( magic ) );
+		write( out, index_offset );
+		out.close();
+
+		if( out.fail() ) {
+			LOG( Runtime, warning ) << "Failed to write the cache file " << util::MSubject( tmp );
+			boost::filesystem::remove( tmp );
+			return;
+		}
+
+		if( std::rename( tmp.file_string().c_str(), cache.file_string().c_str() ) != 0 ) { // so concurrent readers never see a half written file
+			LOG( Runtime, warning ) << "Failed to store the cache file " << util::MSubject( cache ) << " (" << strerror( errno ) << ")";
+			boost::filesystem::remove( tmp );
+			return;
+		}
+
+		LOG( Runtime, verbose_info ) << "Stored " << count << " chunks of " << util::MSubject( filename ) << " in the cache file " << util::MSubject( cache );
+	} catch( const boost::filesystem::filesystem_error &e ) {
+		LOG( Runtime, warning ) << "Failed to store " << util::MSubject( filename ) << " in the cache (" << e.what() << ")";
+	}
+#endif
+}
+
+}
+}
+}
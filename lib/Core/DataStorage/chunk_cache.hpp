@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2010  reimer@cbs.mpg.de
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CHUNK_CACHE_HPP
+#define CHUNK_CACHE_HPP
+
+#define BOOST_FILESYSTEM_VERSION 2 //@todo switch to 3 as soon as we drop support for boost < 1.44
+#include <boost/filesystem/path.hpp>
+#include "chunk.hpp"
+
+namespace isis
+{
+namespace data
+{
+/// @cond _internal
+namespace _internal
+{
+/**
+ * On-disk cache for the chunks loaded from files.
+ * For every file the loaded chunks (properties, geometry, type and voxel data) are stored in one cache file.
+ * The cache file is named after a hash of the path, the suffix override and the dialect used for loading,
+ * it also records size and modification time of the file.
+ * As long as the file doesn't change, its chunks are rebuilt from the cache file instead of running the plugin again.
+ * If the voxel data of a chunk are an unchanged mapping of the file itself (as plugins for uncompressed formats do it),
+ * only their position in the file is stored and the file is mapped again when the chunk is restored.
+ * Other voxel data (decompressed, decoded or converted) are copied into the cache file, which is mapped as well.
+ * So in both cases voxel data is only read when its accessed.
+ */
+class ChunkCache
+{
+	boost::filesystem::path m_directory;
+	std::string makeKey( const boost::filesystem::path &filename, const std::string &suffix_override, const std::string &dialect )const;
+	boost::filesystem::path cacheFile( const std::string &key )const;
+public:
+	/**
+	 * Set the directory to store the cache files in.
+	 * It will be created if necessary. An empty path disables the cache (which is the default).
+	 */
+	void setDirectory( const boost::filesystem::path &dir );
+	/// \returns the directory of the cache files (empty if the cache is disabled)
+	const boost::filesystem::path &getDirectory()const;
+	bool isEnabled()const;
+	/**
+	 * Restore the chunks of a file from the cache.
+	 * \returns the amount of chunks added to chunks, 0 if there is no valid entry for the file
+	 */
+	size_t load( std::list<Chunk> &chunks, const boost::filesystem::path &filename, const std::string &suffix_override, const std::string &dialect )const;
+	/**
+	 * Store the chunks loaded from a file in the cache.
+	 * Errors are only reported, they don't affect the chunks.
+	 */
+	void store( std::list<Chunk>::const_iterator begin, std::list<Chunk>::const_iterator end, const boost::filesystem::path &filename, const std::string &suffix_override, const std::string &dialect )const;
+};
+}
+/// @endcond
+}
+}
+
+#endif // CHUNK_CACHE_HPP
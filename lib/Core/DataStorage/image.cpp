@@ -21,10 +21,12 @@
 #include <boost/foreach.hpp>
 #include "../CoreUtils/property.hpp"
 #include <boost/token_iterator.hpp>
+#include "../CoreUtils/threadpool.hpp"
 
 #define _USE_MATH_DEFINES 1
 #include <math.h>
 #include <cmath>
+#include <algorithm>
 
 namespace isis
 {
@@ -68,6 +70,8 @@ Image &Image::operator=( const isis::data::Image &ref )
 	static_cast<_internal::NDimensional< 4 >&>( *this ) = static_cast<const _internal::NDimensional< 4 >&>( ref );
 	//deep copy members
 	chunkVolume = ref.chunkVolume;
+	std::copy( ref.chunkStrides, ref.chunkStrides + dims, chunkStrides );
+	std::copy( ref.voxelStrides, ref.voxelStrides + dims, voxelStrides );
 	clean = ref.clean;
 	set = ref.set;
 	minIndexingDim = ref.minIndexingDim;
@@ -271,6 +275,25 @@ dimensions Image::mapScannerAxesToImageDimension( scannerAxis scannerAxes )
 }
 
 
+void Image::computeStrides()
+{
+	// the chunks fill the lower dimensions of the image completely, so the strides of the image below the
+	// volume of a chunk are strides inside of the chunks, and the others are strides of the lookup table
+	size_t stride = 1;
+
+	for( unsigned short i = 0; i < dims; i++ ) {
+		if( stride < chunkVolume ) {
+			voxelStrides[i] = stride;
+			chunkStrides[i] = 0;
+		} else {
+			voxelStrides[i] = 0;
+			chunkStrides[i] = stride / chunkVolume;
+		}
+
+		stride *= getDimSize( i );
+	}
+}
+
 bool Image::reIndex()
 {
 	if ( set.isEmpty() ) {
@@ -336,6 +359,7 @@ bool Image::reIndex()
 		structure_size[i] = first.getDimSize( i );
 
 	init( structure_size ); // set size of the image
+	computeStrides();
 	//////////////////////////////////////////////////////////////////////////////////////////////////
 	//reconstruct some redundant information, if its missing
 	//////////////////////////////////////////////////////////////////////////////////////////////////
@@ -775,6 +799,65 @@ bool Image::convertToType( short unsigned int ID )
 	return retVal;
 }
 
+namespace _internal
+{
+/// copy-converts the chunk of a lookup table with the given index into its part of a consolidated buffer (used by Image::consolidate)
+struct ConsolidateWorker {
+	const std::vector<boost::shared_ptr<Chunk> > &m_lookup;
+	const std::vector<ValuePtrReference> &m_dst;
+	const scaling_pair &m_scale;
+	std::vector<bool> &m_failed;
+	boost::mutex &m_mutex;
+	ConsolidateWorker( const std::vector<boost::shared_ptr<Chunk> > &lookup, const std::vector<ValuePtrReference> &dst, const scaling_pair &scale, std::vector<bool> &failed, boost::mutex &mutex ):
+		m_lookup( lookup ), m_dst( dst ), m_scale( scale ), m_failed( failed ), m_mutex( mutex ) {}
+	void operator()( size_t i ) {
+		if( !m_lookup[i]->getValuePtrBase().convertTo( *m_dst[i], m_scale ) ) { // vector<bool> is not thread safe
+			boost::mutex::scoped_lock lock( m_mutex );
+			m_failed[i] = true;
+		}
+	}
+};
+}
+
+bool Image::consolidate( unsigned short ID )
+{
+	if( !checkMakeClean() ) {
+		LOG( Runtime, error ) << "Cannot consolidate an image which could not be indexed";
+		return false;
+	}
+
+	if( ID == 0 )
+		ID = getMajorTypeID();
+
+	const scaling_pair scale = getScalingTo( ID );
+	LOG( Debug, info ) << "Computed scaling of the original image data: [" << scale << "]";
+
+	// if the type stays the same, there is no need to zero the new memory - it will be overwritten anyway
+	ValuePtrReference buffer = lookup[0]->getTypeID() == ID ?
+							   lookup[0]->getValuePtrBase().cloneToNew( getVolume() ) :
+							   _internal::ValuePtrBase::createById( ID, getVolume() );
+
+	if( buffer.isEmpty() )
+		return false;
+
+	// the chunks are in image order, so splicing the buffer into chunk sized parts puts each chunk where it belongs
+	const std::vector<ValuePtrReference> parts = lookup.size() > 1 ? buffer->splice( chunkVolume ) : std::vector<ValuePtrReference>( 1, buffer );
+	assert( parts.size() == lookup.size() );
+	std::vector<bool> failed( lookup.size(), false );
+	boost::mutex mutex;
+	LOG( Debug, info ) << "Consolidating " << lookup.size() << " chunks into one block of " << getVolume() << " " << buffer->getTypeName();
+	util::ThreadPool::get().parallel_for( 0, lookup.size(), _internal::ConsolidateWorker( lookup, parts, scale, failed, mutex ) );
+
+	if( std::find( failed.begin(), failed.end(), true ) != failed.end() )
+		return false; // nothing was replaced yet, so the image is unchanged
+
+	// replace the memory of the chunks by their parts of the buffer, they keep their own properties
+	for( size_t i = 0; i < lookup.size(); i++ )
+		static_cast<ValuePtrReference &>( *lookup[i] ) = parts[i];
+
+	return true;
+}
+
 size_t Image::spliceDownTo( dimensions dim ) //rowDim = 0, columnDim, sliceDim, timeDim
 {
 	if( lookup[0]->getRelevantDims() < ( size_t ) dim ) {
@@ -834,13 +917,49 @@ size_t Image::spliceDownTo( dimensions dim ) //rowDim = 0, columnDim, sliceDim,
 	return lookup.size();
 }
 
-size_t Image::foreachChunk( ChunkOp &op, bool copyMetaData )
+namespace _internal
+{
+/// runs a ChunkOp on the chunk of a list with the given index (used by ThreadPool::parallel_for)
+struct ChunkOpWorker {
+	ChunkOp &m_op;
+	std::vector<Chunk> &m_chunks;
+	const std::vector<util::FixedVector<size_t, 4> > &m_positions;
+	std::vector<bool> &m_failed;
+	std::vector<std::string> &m_exceptions; // message of the exception op threw for the chunk (if any)
+	boost::mutex &m_mutex;
+	ChunkOpWorker( ChunkOp &op, std::vector<Chunk> &chunks, const std::vector<util::FixedVector<size_t, 4> > &positions,
+				   std::vector<bool> &failed, std::vector<std::string> &exceptions, boost::mutex &mutex ):
+		m_op( op ), m_chunks( chunks ), m_positions( positions ), m_failed( failed ), m_exceptions( exceptions ), m_mutex( mutex ) {}
+	void operator()( size_t i ) {
+		bool failed = false;
+
+		try {
+			failed = !m_op( m_chunks[i], m_positions[i] );
+		} catch( const std::exception &e ) {
+			failed = true;
+			m_exceptions[i] = e.what();
+		} catch( ... ) {
+			failed = true;
+			m_exceptions[i] = "unknown exception";
+		}
+
+		if( failed ) { // vector<bool> is not thread safe
+			boost::mutex::scoped_lock lock( m_mutex );
+			m_failed[i] = true;
+		}
+	}
+};
+}
+
+size_t Image::foreachChunk( ChunkOp &op, bool copyMetaData, bool parallel )
 {
 	size_t err = 0;
 	checkMakeClean();
 	util::FixedVector<size_t, 4> imgSize = getSizeAsVector();
 	util::FixedVector<size_t, 4> chunkSize = getChunk( 0, 0, 0, 0 ).getSizeAsVector();
 	util::FixedVector<size_t, 4> pos;
+	std::vector<Chunk> chunks; // only used when running in parallel
+	std::vector<util::FixedVector<size_t, 4> > positions;
 
 	for( pos[timeDim] = 0; pos[timeDim] < imgSize[timeDim]; pos[timeDim] += chunkSize[timeDim] ) {
 		for( pos[sliceDim] = 0; pos[sliceDim] < imgSize[sliceDim]; pos[sliceDim] += chunkSize[sliceDim] ) {
@@ -848,13 +967,35 @@ size_t Image::foreachChunk( ChunkOp &op, bool copyMetaData )
 				for( pos[rowDim] = 0; pos[rowDim] < imgSize[rowDim]; pos[rowDim] += chunkSize[rowDim] ) {
 					Chunk ch = getChunk( pos[rowDim], pos[columnDim], pos[sliceDim], pos[timeDim], copyMetaData );
 
-					if( op( ch, pos ) == false )
+					if( parallel ) {
+						chunks.push_back( ch );
+						positions.push_back( pos );
+					} else if( op( ch, pos ) == false )
 						err++;
 				}
 			}
 		}
 	}
 
+	if( parallel ) {
+		std::vector<bool> failed( chunks.size(), false );
+		std::vector<std::string> exceptions( chunks.size() );
+		boost::mutex mutex;
+		_internal::ChunkOpWorker worker( op, chunks, positions, failed, exceptions, mutex );
+		LOG( Debug, info ) << "Running ChunkOp on " << chunks.size() << " chunks in parallel";
+		util::ThreadPool::get().parallel_for( 0, chunks.size(), worker, 1 );
+
+		for( size_t i = 0; i < chunks.size(); i++ ) {
+			if( !exceptions[i].empty() ) {
+				LOG( Runtime, error ) << "ChunkOp failed on the chunk at " << positions[i] << " with " << util::MSubject( exceptions[i] );
+				throw std::runtime_error( exceptions[i] );
+			}
+
+			if( failed[i] )
+				err++;
+		}
+	}
+
 	return err;
 }
 
@@ -17,6 +17,10 @@
 
 #include <set>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/type_traits/remove_const.hpp>
+#include <limits>
+#include <stdexcept>
 #include <vector>
 #include <boost/foreach.hpp>
 #include <boost/numeric/ublas/matrix.hpp>
@@ -61,6 +65,11 @@ protected:
 	std::vector<boost::shared_ptr<Chunk> > lookup;
 private:
 	size_t chunkVolume;
+	// steps in the lookup table and inside the chunks per dimension (0 for dimensions which are not in the lookup table / the chunks)
+	size_t chunkStrides[dims], voxelStrides[dims];
+
+	/// compute chunkStrides and voxelStrides from the size of the image and its chunks (done by reIndex)
+	void computeStrides();
 
 	void deduplicateProperties();
 
@@ -90,8 +99,14 @@ private:
 				<< "Getting data from a empty image will result in undefined behavior.";
 		LOG_IF( !isInRange( idx ), Debug, isis::error )
 				<< "Index " << util::listToString( idx, idx + 4, "|" ) << " is out of range (" << getSizeAsString() << ")";
-		const size_t index = getLinearIndex( idx );
-		return std::make_pair( index / chunkVolume, index % chunkVolume );
+		return uncheckedGet( first, second, third, fourth );
+	}
+	/// \copydoc commonGet without any checks
+	inline std::pair<size_t, size_t> uncheckedGet ( size_t first, size_t second, size_t third, size_t fourth ) const {
+		return std::make_pair(
+				   first * chunkStrides[0] + second * chunkStrides[1] + third * chunkStrides[2] + fourth * chunkStrides[3],
+				   first * voxelStrides[0] + second * voxelStrides[1] + third * voxelStrides[2] + fourth * voxelStrides[3]
+			   );
 	}
 
 
@@ -256,10 +271,83 @@ public:
 	 */
 	template <typename T> const T &voxel( size_t first, size_t second = 0, size_t third = 0, size_t fourth = 0 )const {
 		const std::pair<size_t, size_t> index = commonGet( first, second, third, fourth );
-		const ValuePtr<T> &data = chunkPtrAt( index.first )->getValuePtr<T>();
+		const ValuePtr<T> &data = chunkPtrAt( index.first )->getValuePtrBase().castToValuePtr<T>();
 		return data[index.second];
 	}
 
+	/**
+	 * Get a reference to the voxel value at the given coordinates without any checks.
+	 * Other than voxel() this does not reindex the image, does not check the coordinates and does not check the type.
+	 * So use it only in loops which made sure the image is clean, the coordinates are inside of it and T is the type of its chunks
+	 * (e.g. in a TypedImage).
+	 * \copydetails voxel
+	 */
+	template <typename T> T &voxelUnchecked( size_t first, size_t second = 0, size_t third = 0, size_t fourth = 0 ) {
+		const std::pair<size_t, size_t> index = uncheckedGet( first, second, third, fourth );
+		return static_cast<ValuePtr<T>&>( lookup[index.first]->asValuePtrBase() )[index.second];
+	}
+	/// \copydoc voxelUnchecked
+	template <typename T> const T &voxelUnchecked( size_t first, size_t second = 0, size_t third = 0, size_t fourth = 0 )const {
+		const std::pair<size_t, size_t> index = uncheckedGet( first, second, third, fourth );
+		return static_cast<const ValuePtr<T>&>( lookup[index.first]->getValuePtrBase() )[index.second];
+	}
+
+	/**
+	 * Accessor for voxels of an image which remembers the memory of the last chunk it accessed.
+	 * Successive accesses to voxels in the same chunk (e.g. when running along the rows of a slice) only compute the index in
+	 * that chunk. The accessor is only valid as long as the chunks of the image are not changed.
+	 * Like voxelUnchecked it does not check the coordinates. The type is only checked when it enters a new chunk.
+	 * \code
+	 * data::Image::VoxelAccessor<float> acc = img.getVoxelAccessor<float>();
+	 * for( size_t x = 0; x < img.getDimSize( rowDim ); x++ )
+	 *     acc( x, y, z ) *= 2;
+	 * \endcode
+	 */
+	template<typename T> class VoxelAccessor
+	{
+		typedef typename boost::remove_const<T>::type value_type;
+		const Image *m_image;
+		size_t m_chunkStrides[dims], m_voxelStrides[dims]; // local copies, so the compiler knows they don't change
+		size_t m_chunk;
+		T *m_data;
+		void enter( size_t chunk ) {
+			const _internal::ValuePtrBase &data = m_image->chunkPtrAt( chunk )->getValuePtrBase();
+			m_chunk = chunk;
+			m_data = const_cast<value_type *>( &data.castToValuePtr<value_type>()[0] ); // castToValuePtr checks the type
+		}
+	public:
+		VoxelAccessor( const Image &image ): m_image( &image ), m_chunk( std::numeric_limits<size_t>::max() ), m_data( 0 ) {
+			std::copy( image.chunkStrides, image.chunkStrides + dims, m_chunkStrides );
+			std::copy( image.voxelStrides, image.voxelStrides + dims, m_voxelStrides );
+		}
+		T &operator()( size_t first, size_t second = 0, size_t third = 0, size_t fourth = 0 ) {
+			const size_t chunk = first * m_chunkStrides[0] + second * m_chunkStrides[1] + third * m_chunkStrides[2] + fourth * m_chunkStrides[3];
+
+			if( chunk != m_chunk )
+				enter( chunk );
+
+			return m_data[first * m_voxelStrides[0] + second * m_voxelStrides[1] + third * m_voxelStrides[2] + fourth * m_voxelStrides[3]];
+		}
+	};
+	/// Get an accessor for voxels of type T. The image will be reindexed if necessary.
+	template<typename T> VoxelAccessor<T> getVoxelAccessor() {
+		checkMakeClean();
+		return VoxelAccessor<T>( *this );
+	}
+	/**
+	 * Get an accessor for voxels of type T from a const image.
+	 * Such an image can't be reindexed, so it must be clean (see voxelUnchecked).
+	 * \throws std::logic_error if the image is not clean
+	 */
+	template<typename T> VoxelAccessor<const T> getVoxelAccessor()const {
+		if( ! clean ) {
+			LOG( Runtime, error ) << "Can't get a voxel accessor for a non indexed const image. Run reIndex first.";
+			throw( std::logic_error( "voxel accessor for a non indexed image" ) );
+		}
+
+		return VoxelAccessor<const T>( *this );
+	}
+
 
 	/**
 	 * Get the type of the chunk with "biggest" type.
@@ -519,6 +607,17 @@ public:
 	 */
 	bool convertToType( unsigned short ID );
 
+	/**
+	 * Copy all voxels of the image into one contiguous block of memory.
+	 * The chunks keep their geometry and their own properties, but become views into that block. As they are placed in
+	 * image order, the whole image can be traversed as one span afterwards (see getSpans).
+	 * The chunks are copied in parallel (see util::ThreadPool) and converted into the requested type on the way.
+	 * The conversion is done using the value range of the image (see convertToType).
+	 * \param ID the type of the new block, 0 means the major type of the image
+	 * \returns false if there was an error (the image is left unchanged then)
+	 */
+	bool consolidate( unsigned short ID = 0 );
+
 	/**
 	 * Automatically splice the given dimension and all dimensions above.
 	 * e.g. spliceDownTo(sliceDim) will result in an image made of slices (aka 2d-chunks).
@@ -528,10 +627,15 @@ public:
 	/**
 	 * Run a functor with the base ChunkOp on every cunk in the image.
 	 * This does not check the types of the images. So if your functor needs a specific type, use TypedImage.
+	 * If parallel is true, the chunks are processed by the threads of util::ThreadPool, so op must be safe to be called concurrently
+	 * (for different chunks). The result is the same as in the serial case. If op throws, the remaining chunks are
+	 * still processed and the exception of the first chunk (in image order) which threw is rethrown as std::runtime_error.
 	 * \param op a functor object which inherits ChunkOP
 	 * \param copyMetaData if true the metadata of the image are copied into the chunks before calling the functor
+	 * \param parallel run op on multiple chunks at once
+	 * \returns the amount of chunks op returned false for - so 0 is good
 	 */
-	size_t foreachChunk( ChunkOp &op, bool copyMetaData = false );
+	size_t foreachChunk( ChunkOp &op, bool copyMetaData = false, bool parallel = false );
 
 
 	/**
@@ -540,8 +644,9 @@ public:
 	 * So the result is equivalent to TypedImage\<TYPE\>.
 	 * If these conversion failes no operation is done, and false is returned.
 	 * \param op a functor object which inherits ChunkOp
+	 * \param parallel run op on multiple chunks at once (see foreachChunk)
 	 */
-	template <typename TYPE> size_t foreachVoxel( VoxelOp<TYPE> &op ) {
+	template <typename TYPE> size_t foreachVoxel( VoxelOp<TYPE> &op, bool parallel = false ) {
 		class _proxy: public ChunkOp
 		{
 			VoxelOp<TYPE> &op;
@@ -552,9 +657,143 @@ public:
 			}
 		};
 		_proxy prx( op );
-		return convertToType( data::ValuePtr<TYPE>::staticID ) && foreachChunk( prx, false );
+		return convertToType( data::ValuePtr<TYPE>::staticID ) && foreachChunk( prx, false, parallel );
+	}
+
+	/**
+	 * Run a functor on every voxel in the image (statically dispatched).
+	 * Works like foreachVoxel(VoxelOp<TYPE> &), but op can be of any type providing
+	 * bool operator()( TYPE &vox, const util::FixedVector<size_t, 4> &pos ). So the call can be inlined.
+	 * Chunks which don't have the requested type will be converted.
+	 * \param parallel run op on multiple chunks at once (see foreachChunk)
+	 * \returns amount of operations which returned false (the volume of the image, if the conversion failed)
+	 */
+	template <typename TYPE, typename OP> size_t foreachVoxelInlined( OP &op, bool parallel = false ) {
+		struct _proxy: public ChunkOp {
+			OP &op;
+			size_t errors;
+			boost::mutex mutex;
+			_proxy( OP &_op ): op( _op ), errors( 0 ) {}
+			bool operator()( Chunk &ch, util::FixedVector<size_t, 4 > posInImage ) {
+				const size_t err = ch.foreachVoxelInlined<TYPE, OP>( op, posInImage );
+
+				if( err ) {
+					boost::mutex::scoped_lock lock( mutex );
+					errors += err;
+				}
+
+				return err == 0;
+			}
+		};
+
+		if( !convertToType( data::ValuePtr<TYPE>::staticID ) )
+			return getVolume();
+
+		_proxy prx( op );
+		foreachChunk( prx, false, parallel );
+		return prx.errors;
+	}
+
+	/**
+	 * Run a functor on the value of every voxel in the image, regardless of its position.
+	 * See Chunk::foreachValue. Chunks which don't have the requested type will be converted.
+	 * \param parallel run op on multiple chunks at once (see foreachChunk)
+	 * \returns false if the conversion failed (op was not called then), true otherwise
+	 */
+	template <typename TYPE, typename OP> bool foreachValue( OP &op, bool parallel = false ) {
+		struct _proxy: public ChunkOp {
+			OP &op;
+			_proxy( OP &_op ): op( _op ) {}
+			bool operator()( Chunk &ch, util::FixedVector<size_t, 4 > /*posInImage*/ ) {
+				ch.foreachValue<TYPE, OP>( op );
+				return true;
+			}
+		};
+		_proxy prx( op );
+		return convertToType( data::ValuePtr<TYPE>::staticID ) && foreachChunk( prx, false, parallel ) == 0;
+	}
+
+	/**
+	 * Run a functor on the memory of every chunk of the image.
+	 * See Chunk::foreachSpan. Chunks which don't have the requested type will be converted.
+	 * \param parallel run op on multiple chunks at once (see foreachChunk)
+	 * \returns false if the conversion failed (op was not called then), true otherwise
+	 */
+	template <typename TYPE, typename OP> bool foreachSpan( OP &op, bool parallel = false ) {
+		struct _proxy: public ChunkOp {
+			OP &op;
+			_proxy( OP &_op ): op( _op ) {}
+			bool operator()( Chunk &ch, util::FixedVector<size_t, 4 > /*posInImage*/ ) {
+				ch.foreachSpan<TYPE, OP>( op );
+				return true;
+			}
+		};
+		_proxy prx( op );
+		return convertToType( data::ValuePtr<TYPE>::staticID ) && foreachChunk( prx, false, parallel ) == 0;
+	}
+
+	/// A run of voxels which are contiguous in memory, starting at position and continuing in image order
+	template<typename TYPE> struct Span {
+		TYPE *data;
+		size_t length;
+		util::FixedVector<size_t, 4> position;
+	};
+
+	/**
+	 * Get the memory of the image as contiguous spans in image order.
+	 * Every chunk is a span, if merge is true the spans of successive chunks which lie back to back in memory
+	 * (e.g. slices spliced from one volume) are merged, so each span is a maximal contiguous run of the image.
+	 * Kernels can run directly on the memory of the spans, and the position tells where each of them starts in the image.
+	 * The spans stay valid as long as the chunks of the image are not changed.
+	 * Chunks which don't have the requested type will be converted.
+	 * \param merge merge the spans of chunks which are contiguous in memory
+	 * \returns the spans in image order (empty if the conversion failed)
+	 */
+	template<typename TYPE> std::vector<Span<TYPE> > getSpans( bool merge = true ) {
+		std::vector<Span<TYPE> > ret;
+
+		if( checkMakeClean() && convertToType( data::ValuePtr<TYPE>::staticID ) )
+			collectSpans( ret, merge );
+
+		return ret;
+	}
+	/**
+	 * \copybrief getSpans
+	 * Works like the non-const getSpans, but the chunks are not converted.
+	 * If any of them doesn't have the requested type an error is sent and the result is empty.
+	 */
+	template<typename TYPE> std::vector<Span<const TYPE> > getSpans( bool merge = true )const {
+		std::vector<Span<const TYPE> > ret;
+		LOG_IF( ! clean, Debug, error ) << "Accessing a non indexed image will result in undefined behavior. Run reIndex first.";
+		BOOST_FOREACH( const boost::shared_ptr<Chunk> &ref, lookup ) {
+			if( ref->getTypeID() != data::ValuePtr<TYPE>::staticID ) {
+				LOG( Runtime, error ) << "Cannot get spans of type " << data::ValuePtr<TYPE>::staticName() << " from a chunk of type " << ref->getTypeName();
+				return ret;
+			}
+		}
+		collectSpans( ret, merge );
+		return ret;
 	}
 
+private:
+	/// append the spans of all chunks to spans, which must have the type TYPE (see getSpans)
+	template<typename TYPE> void collectSpans( std::vector<Span<TYPE> > &spans, bool merge )const {
+		typedef typename boost::remove_const<TYPE>::type value_type;
+		size_t pos[dims];
+
+		for( size_t i = 0; i < lookup.size(); i++ ) {
+			TYPE *const data = const_cast<value_type *>( &lookup[i]->getValuePtrBase().castToValuePtr<value_type>()[0] );
+
+			if( merge && !spans.empty() && spans.back().data + spans.back().length == data ) {
+				spans.back().length += chunkVolume;
+			} else {
+				getCoordsFromLinIndex( i * chunkVolume, pos );
+				const Span<TYPE> span = {data, chunkVolume, util::FixedVector<size_t, 4>( pos )};
+				spans.push_back( span );
+			}
+		}
+	}
+public:
 	/// \returns the number of rows of the image
 	size_t getNrOfRows()const;
 	/// \returns the number of columns of the image
@@ -92,6 +92,12 @@ IOFactory::IOFactory(): m_feedback( NULL )
 	}
 
 	findPlugins( std::string( PLUGIN_PATH ) );
+
+	const char *env_cache = getenv( "ISIS_CHUNK_CACHE" );
+
+	if( env_cache ) {
+		m_cache.setDirectory( env_cache );
+	}
 }
 
 bool IOFactory::registerFileFormat( const FileFormatPtr plugin )
@@ -209,12 +215,27 @@ size_t IOFactory::loadFile( std::list<Chunk> &ret, const boost::filesystem::path
 			LOG( Runtime, error ) << "No plugin supporting the requested suffix " << suffix_override << with_dialect << " was found";
 		}
 	} else {
+		if( m_cache.isEnabled() ) {
+			const size_t cached = m_cache.load( ret, filename, suffix_override, dialect );
+
+			if( cached )
+				return cached;
+		}
+
 		BOOST_FOREACH( FileFormatList::const_reference it, formatReader ) {
 			LOG( ImageIoDebug, info )
 					<< "plugin to load file" << with_dialect << " " << util::MSubject( filename ) << ": " << it->getName();
 
 			try {
-				return it->load( ret, filename.file_string(), dialect );
+				const size_t loaded = it->load( ret, filename.file_string(), dialect );
+
+				if( m_cache.isEnabled() && ret.size() > nimgs_old ) {
+					std::list<Chunk>::const_iterator first = ret.end();
+					std::advance( first, -( int )( ret.size() - nimgs_old ) );
+					m_cache.store( first, ret.end(), filename, suffix_override, dialect );
+				}
+
+				return loaded;
 			} catch ( std::runtime_error &e ) {
 				LOG( Runtime, formatReader.size() > 1 ? warning : error )
 						<< "Failed to load " <<  filename << " using " <<  it->getName() << with_dialect << " ( " << e.what() << " )";
@@ -226,6 +247,31 @@ size_t IOFactory::loadFile( std::list<Chunk> &ret, const boost::filesystem::path
 	return ret.size() - nimgs_old;//no plugin of proposed list could load file
 }
 
+size_t IOFactory::loadData( std::list<Chunk> &ret, const ValuePtr<uint8_t> &src, const std::string &filename, std::string dialect )
+{
+	const FileFormatList formatReader = getFileFormatList( filename, "", dialect );
+	const std::string with_dialect = dialect.empty() ?
+									 std::string( "" ) : std::string( " with dialect \"" ) + dialect + "\"";
+
+	if ( formatReader.empty() ) {
+		LOG( Runtime, error ) << "No plugin found to read " << util::MSubject( filename ) << " from memory" << with_dialect;
+	} else {
+		BOOST_FOREACH( FileFormatList::const_reference it, formatReader ) {
+			LOG( ImageIoDebug, info )
+					<< "plugin to load " << src.getLength() << " bytes of " << util::MSubject( filename ) << " from memory" << with_dialect << ": " << it->getName();
+
+			try {
+				return it->load( ret, src, filename, dialect );
+			} catch ( std::runtime_error &e ) {
+				LOG( Runtime, formatReader.size() > 1 ? warning : error )
+						<< "Failed to load " <<  filename << " from memory using " <<  it->getName() << with_dialect << " ( " << e.what() << " )";
+			}
+		}
+		LOG_IF( formatReader.size() > 1, Runtime, error ) << "No plugin was able to load: "   << util::MSubject( filename ) << " from memory" << with_dialect;
+	}
+
+	return 0;
+}
 
 IOFactory::FileFormatList IOFactory::getFileFormatList( std::string filename, std::string suffix_override, std::string dialect )
 {
@@ -306,6 +352,18 @@ size_t IOFactory::load( std::list<data::Chunk> &chunks, const std::string &path,
 	return loaded;
 }
 
+size_t IOFactory::load( std::list<data::Chunk> &chunks, const ValuePtr<uint8_t> &src, const std::string &filename, std::string dialect )
+{
+	std::list<Chunk> loaded;
+	const size_t ret = get().loadData( loaded, src, filename, dialect );
+	BOOST_FOREACH( Chunk & ref, loaded ) {
+		if ( ! ref.hasProperty( "source" ) )
+			ref.setPropertyAs( "source", filename );
+	}
+	chunks.splice( chunks.end(), loaded );
+	return ret;
+}
+
 std::list<data::Image> IOFactory::load( const std::string &path, std::string suffix_override, std::string dialect )
 {
 	std::list<Chunk> chunks;
@@ -385,6 +443,14 @@ bool IOFactory::write( std::list<data::Image> images, const std::string &path, s
 
 	return false;
 }
+void IOFactory::setCacheDirectory( const std::string &dir )
+{
+	get().m_cache.setDirectory( dir );
+}
+boost::filesystem::path IOFactory::getCacheDirectory()
+{
+	return get().m_cache.getDirectory();
+}
 void IOFactory::setProgressFeedback( util::ProgressFeedback *feedback )
 {
 	IOFactory &This = get();
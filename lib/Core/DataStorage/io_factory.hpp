@@ -23,6 +23,7 @@
 #include <boost/filesystem.hpp>
 
 #include "io_interface.h"
+#include "chunk_cache.hpp"
 #include "../CoreUtils/progressfeedback.hpp"
 
 //????
@@ -60,6 +61,17 @@ public:
 	 * @return list of chunks (part of an image)
 	 */
 	static size_t load( std::list<data::Chunk> &chunks, const std::string &path, std::string suffix_override = "", std::string dialect = "" );
+	/**
+	 * Load data from memory into a chunklist.
+	 * The plugins to be used are selected by the suffix of the given filename.
+	 * This is mainly used by proxy plugins, which hand decompressed/extracted data to the actual plugin.
+	 * @param chunks list to store the loaded chunks in
+	 * @param src the memory to load from
+	 * @param filename name of the data (used to select the plugin and as "source" - it does not have to exist)
+	 * @param dialect dialect of the fileformat to load
+	 * @return amount of loaded chunks
+	 */
+	static size_t load( std::list<data::Chunk> &chunks, const ValuePtr<uint8_t> &src, const std::string &filename, std::string dialect = "" );
 
 	static bool write( const data::Image &image, const std::string &path, std::string suffix_override, const std::string &dialect );
 	static bool write( std::list<data::Image> images, const std::string &path, std::string suffix_override, const std::string &dialect );
@@ -69,6 +81,17 @@ public:
 
 	static void setProgressFeedback( util::ProgressFeedback *feedback );
 
+	/**
+	 * Set the directory of the chunk cache.
+	 * If set, the chunks loaded from files are stored there, and later loads of the same file (as long as it did not change)
+	 * restore them from there instead of running the plugin again.
+	 * The cache is disabled by default, it can also be enabled by setting the environment variable ISIS_CHUNK_CACHE.
+	 * \param dir the directory for the cache files (will be created if necessary), an empty string disables the cache
+	 */
+	static void setCacheDirectory( const std::string &dir );
+	/// \returns the directory of the chunk cache (empty if its disabled), plugins may put their own cache files there as well
+	static boost::filesystem::path getCacheDirectory();
+
 	/**
 	 * Get all formats which should be able to read/write the given file.
 	 * \param filename the file which should be red/written
@@ -87,10 +110,12 @@ public:
 protected:
 	size_t loadFile( std::list<Chunk> &ret, const boost::filesystem::path &filename, std::string suffix_override, std::string dialect );
 	size_t loadPath( std::list<Chunk> &ret, const boost::filesystem::path &path, std::string suffix_override, std::string dialect );
+	size_t loadData( std::list<Chunk> &ret, const ValuePtr<uint8_t> &src, const std::string &filename, std::string dialect );
 
 	static IOFactory &get();
 	IOFactory();//shall not be created directly
 	FileFormatList io_formats;
+	_internal::ChunkCache m_cache;
 
 	/*
 	 * each ImageFormat will be registered in a map after plugin has been loaded
@@ -7,8 +7,10 @@
 #include <boost/filesystem.hpp>
 #include <iomanip>
 #include <iostream>
+#include <fstream>
 
 #include "../CoreUtils/log.hpp"
+#include "../CoreUtils/tmpfile.hpp"
 #include "common.hpp"
 #include "io_interface.h"
 
@@ -38,6 +40,30 @@ void FileFormat::write( const std::list<data::Image> &images, const std::string
 	}
 }
 
+int FileFormat::load( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & )
+{
+	const util::TmpFile tmpfile( "", makeBasename( filename ).second );
+	LOG( Debug, info ) << getName() << " cannot load from memory, will write " << src.getLength() << " bytes for " << util::MSubject( filename ) << " into " << util::MSubject( tmpfile.file_string() );
+
+	try {
+		std::ofstream out;
+		out.exceptions( std::ios::failbit | std::ios::badbit );
+		out.open( tmpfile.file_string().c_str(), std::ios::binary );
+		if( src.getLength() )
+			out.write( reinterpret_cast<const char *>( &src[0] ), src.getLength() );
+	} catch( std::ios_base::failure & ) {
+		throwSystemError( errno, std::string( "Failed to write temporary " ) + tmpfile.file_string() );
+	}
+
+	std::list<data::Chunk> loaded;
+	const int ret = load( loaded, tmpfile.file_string(), dialect );
+	BOOST_FOREACH( data::Chunk & ref, loaded ) {
+		ref.setPropertyAs( "source", filename );
+	}
+	chunks.splice( chunks.end(), loaded );
+	return ret;
+}
+
 bool FileFormat::hasOrTell( const util::PropertyMap::KeyType &name, const isis::util::PropertyMap &object, isis::LogLevel level )
 {
 	if ( object.hasProperty( name ) ) {
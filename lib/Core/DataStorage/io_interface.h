@@ -90,8 +90,25 @@ public:
 	 * \param filename the name of the file to load from (the system does NOT check if this file exists)
 	 * \param dialect the dialect to be used when loading the file (use "" to not define a dialect)
 	 * \returns the amount of loaded chunks.
+	 * \note Both load-functions must be reentrant. Proxy plugins (e.g. for tar-archives) call them on the same plugin object from several threads at once.
+	 * So they must not modify the plugin object (or any other shared state) without locking it.
 	 */
-	virtual int load( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & ) = 0; //@todo should be locked
+	virtual int load( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & ) = 0;
+
+	/**
+	 * Load data from memory into the given chunk list.
+	 * This is used by proxy plugins (e.g. for compressed or archived files) to hand data to the actual plugin without storing it in a temporary file.
+	 * The default implementation still writes the data into a temporary file (using the suffix of filename) and loads that.
+	 * Plugins which can read directly from memory should override it.
+	 * I case of an error std::runtime_error will be thrown.
+	 * \param chunks the chunk list where the loaded chunks shall be added to
+	 * \param src the memory to load from (the loaded chunks may keep referencing it)
+	 * \param filename the name the data is known by (it is used to determine the suffix and as "source" - it does not have to exist)
+	 * \param dialect the dialect to be used when loading the data (use "" to not define a dialect)
+	 * \returns the amount of loaded chunks.
+	 * \note This must be reentrant, just like the loading from a file.
+	 */
+	virtual int load( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & );
 
 	/**
 	 * Write a single image to a file.
@@ -2,9 +2,17 @@
 #include <DataStorage/common.hpp>
 #include <CoreUtils/istring.hpp>
 #include <dcmtk/dcmdata/dcdict.h>
+#include <dcmtk/dcmdata/dcistrmb.h>
 #include <dcmtk/dcmimgle/dcmimage.h>
 #include <dcmtk/dcmimage/diregist.h> //for color support
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/foreach.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
 
 namespace isis
 {
@@ -29,8 +37,29 @@ class DicomChunk : public data::Chunk
 			delete m_dcfile;
 		}
 	};
-	template<typename TYPE> DicomChunk(
-		TYPE *dat, Deleter del,
+	/// deleter for pixel data referenced directly in the element of the dicom file
+	struct DatasetDeleter {
+		DcmFileFormat *m_dcfile;
+		std::string m_filename;
+		DatasetDeleter( DcmFileFormat *dcfile, std::string filename ): m_dcfile( dcfile ), m_filename( filename ) {}
+		void operator ()( void *at ) {
+			LOG( Debug, verbose_info ) << "Closing dicom-file " << util::MSubject( m_filename ) << " (pixeldata was at " << at << ")";
+			delete m_dcfile;
+		}
+	};
+	/// deleter for pixel data mapped directly from the dicom file
+	struct MapDeleter {
+		void *m_base;
+		size_t m_length;
+		std::string m_filename;
+		MapDeleter( void *base, size_t length, std::string filename ): m_base( base ), m_length( length ), m_filename( filename ) {}
+		void operator ()( void *at ) {
+			LOG( Debug, verbose_info ) << "Unmapping dicom-file " << util::MSubject( m_filename ) << " (pixeldata was at " << at << ")";
+			munmap( m_base, m_length );
+		}
+	};
+	template<typename TYPE, typename D> DicomChunk(
+		TYPE *dat, D del,
 		size_t width, size_t height ):
 		data::Chunk( dat, del, width, height, 1, 1 ) {
 		LOG( Debug, verbose_info )
@@ -50,13 +79,183 @@ class DicomChunk : public data::Chunk
 			dvoxel.b = source[2][i];
 		}
 
+		return ret;
+	}
+	/// the layout of monochrome pixel data which can be used without going through DicomImage
+	struct PixelFormat {
+		Uint16 rows, columns, allocated;
+		bool is_signed;
+		DcmElement *element;
+	};
+	/**
+	 * Check if the pixel data of a dataset can be used as it is.
+	 * This is only the case if the result equals what DicomImage would generate, so:
+	 * - the pixel data must be uncompressed little endian monochrome data with 8, 16 or 32 bits and without rescaling
+	 * - signed pixel data must use all allocated bits (otherwise DicomImage would extend the sign)
+	 * - unsigned pixel data must use more than half of the allocated bits (otherwise DicomImage would choose a smaller type)
+	 * - the stored bits must be the lowest bits of the allocated ones (HighBit is BitsStored-1), otherwise DicomImage would shift them down
+	 * - there must be only one frame
+	 * Rescaled pixel data still goes through DicomImage. Slope and intercept are stored in the DICOM-branch anyway, but nothing in isis would apply them afterwards.
+	 */
+	static bool getPixelFormat( const std::string &filename, DcmDataset *dcdata, PixelFormat &format ) {
+		const E_TransferSyntax xfer = dcdata->getOriginalXfer();
+		Uint16 samples = 0, stored = 0, highbit = 0, representation = 0;
+		Sint32 frames = 1;
+		Float64 slope = 1, intercept = 0;
+		OFString photometric;
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+		const bool hostOrder = ( xfer == EXS_LittleEndianExplicit || xfer == EXS_LittleEndianImplicit );
+#else
+		const bool hostOrder = false; // the pixel data would have to be swapped
+#endif
+
+		if( !hostOrder )
+			return false;
+
+		if(
+			dcdata->findAndGetUint16( DCM_SamplesPerPixel, samples ).bad() || samples != 1 ||
+			dcdata->findAndGetOFString( DCM_PhotometricInterpretation, photometric ).bad() || photometric.substr( 0, 10 ) != "MONOCHROME" ||
+			dcdata->findAndGetUint16( DCM_Rows, format.rows ).bad() || dcdata->findAndGetUint16( DCM_Columns, format.columns ).bad() ||
+			dcdata->findAndGetUint16( DCM_BitsAllocated, format.allocated ).bad() || dcdata->findAndGetUint16( DCM_BitsStored, stored ).bad() ||
+			dcdata->findAndGetUint16( DCM_HighBit, highbit ).bad() || highbit + 1 != stored ||
+			dcdata->findAndGetUint16( DCM_PixelRepresentation, representation ).bad() ||
+			// DicomImage renders into the smallest type which can hold the stored bits - for unsigned data thats the allocated type only
+			// if more than half of its bits are used (e.g. 12 of 16), with 8 of 16 bits it would become 8bit
+			// the unused upper bits are assumed to be zero (overlays embedded in the pixel data are retired since DICOM 2004)
+			( representation ? stored != format.allocated : stored <= format.allocated / 2 ) ||
+			( format.allocated != 8 && format.allocated != 16 && format.allocated != 32 ) ||
+			dcdata->findAndGetElement( DCM_PixelData, format.element ).bad()
+		) {
+			LOG( Debug, verbose_info ) << "Won't use the pixel data of " << util::MSubject( filename ) << " directly because of its pixel format";
+			return false;
+		}
+
+		format.is_signed = representation;
+		dcdata->findAndGetSint32( DCM_NumberOfFrames, frames );
+		dcdata->findAndGetFloat64( DCM_RescaleSlope, slope );
+		dcdata->findAndGetFloat64( DCM_RescaleIntercept, intercept );
+
+		if( frames != 1 || slope != 1 || intercept != 0 || format.element->getLength() != size_t( format.rows ) * format.columns * format.allocated / 8 ) {
+			LOG( Debug, verbose_info ) << "Won't use the pixel data of " << util::MSubject( filename ) << " directly because its rescaled or has multiple frames";
+			return false;
+		}
+
+		return true;
+	}
+	template<typename D> static data::Chunk *newChunk( void *data, D del, const PixelFormat &format ) {
+		switch( format.allocated ) {
+		case 8:
+			return format.is_signed ? new DicomChunk( ( int8_t * )data, del, format.columns, format.rows ) : new DicomChunk( ( uint8_t * )data, del, format.columns, format.rows );
+		case 16:
+			return format.is_signed ? new DicomChunk( ( int16_t * )data, del, format.columns, format.rows ) : new DicomChunk( ( uint16_t * )data, del, format.columns, format.rows );
+		case 32:
+			return format.is_signed ? new DicomChunk( ( int32_t * )data, del, format.columns, format.rows ) : new DicomChunk( ( uint32_t * )data, del, format.columns, format.rows );
+		}
+
+		return NULL;
+	}
+	/**
+	 * Map the pixel data of an uncompressed dicom file into memory.
+	 * As the data will only be read from the file when its accessed for the first time, loading the file stops after the header.
+	 * The pixel data must be usable as it is (see getPixelFormat) and it must be the last element in the file (that's how we know where it is).
+	 * \returns an empty auto_ptr if the pixel data cannot be mapped
+	 */
+	static std::auto_ptr<data::Chunk> mapChunk( const std::string &filename, DcmDataset *dcdata, const PixelFormat &format ) {
+		std::auto_ptr<data::Chunk> ret;
+
+		if( format.element != dcdata->getElement( dcdata->card() - 1 ) )
+			return ret;
+
+		const size_t length = format.element->getLength();
+		const int file = open( filename.c_str(), O_RDONLY );
+		struct stat st;
+
+		if( file == -1 || fstat( file, &st ) == -1 || size_t( st.st_size ) < length + 8 ) {
+			if( file != -1 )
+				close( file );
+
+			return ret;
+		}
+
+		// mmap needs an page-aligned offset
+		const size_t offset = st.st_size - length, page_offset = offset % sysconf( _SC_PAGESIZE );
+		const size_t map_length = length + page_offset;
+		uint8_t *const mmem = ( uint8_t * )mmap( NULL, map_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, offset - page_offset );
+		close( file ); // the mapping stays valid without the file
+
+		if( mmem == MAP_FAILED ) {
+			LOG( Runtime, warning ) << "Failed to map the pixel data of " << util::MSubject( filename ) << " (" << strerror( errno ) << ")";
+			return ret;
+		}
+
+		// make sure we mapped the right region - the tag of the pixeldata has to be right in front of it
+		static const uint8_t pixeltag[] = {0xE0, 0x7F, 0x10, 0x00};
+		uint8_t *const data = mmem + page_offset;
+		const bool found = ( page_offset >= 8 && memcmp( data - 8, pixeltag, 4 ) == 0 ) || ( page_offset >= 12 && memcmp( data - 12, pixeltag, 4 ) == 0 );
+		MapDeleter del( mmem, map_length, filename );
+
+		if( !found ) {
+			LOG( Debug, warning ) << "Didn't find the pixeldata of " << util::MSubject( filename ) << " where it should be";
+			del( mmem );
+			return ret;
+		}
+
+		ret.reset( newChunk( data, del, format ) );
+		return ret;
+	}
+	/**
+	 * Use the value buffer of the pixel data element of a loaded file.
+	 * The chunk will keep the DcmFileFormat alive, so no copy of the pixel data is made.
+	 * \returns an empty auto_ptr if the pixel data is not available as one buffer
+	 */
+	static std::auto_ptr<data::Chunk> elementChunk( const std::string &filename, std::auto_ptr<DcmFileFormat> &dcfile, const PixelFormat &format ) {
+		std::auto_ptr<data::Chunk> ret;
+		Uint8 *data = NULL;
+
+		if( format.element->getVR() == EVR_OB ) {
+			format.element->getUint8Array( data );
+		} else { // OW is stored in host byte order - which is little endian here (see getPixelFormat)
+			Uint16 *wdata = NULL;
+			format.element->getUint16Array( wdata );
+			data = ( Uint8 * )wdata;
+		}
+
+		if( !data ) {
+			LOG( Debug, verbose_info ) << "Failed to get the pixel data of " << util::MSubject( filename ) << " from its element";
+			return ret;
+		}
+
+		ret.reset( newChunk( data, DatasetDeleter( dcfile.get(), filename ), format ) );
+
+		if( ret.get() )
+			dcfile.release(); // the chunk owns the file now
+
 		return ret;
 	}
 public:
 	//this uses auto_ptr by intention
 	//the ownership of the DcmFileFormat-pointer shall be transfered to this function, because it has to decide if it should be deleted
-	static data::Chunk makeChunk( std::string filename, std::auto_ptr<DcmFileFormat> dcfile, const std::string &dialect ) {
+	static data::Chunk makeChunk( std::string filename, std::auto_ptr<DcmFileFormat> dcfile, const std::string &dialect, bool mappable ) {
 		std::auto_ptr<data::Chunk> ret;
+
+		PixelFormat format;
+
+		if( getPixelFormat( filename, dcfile->getDataset(), format ) ) {
+			DcmDataset *const dcdata = dcfile->getDataset();
+
+			if( mappable ) // try to map the pixel data, the file isn't needed afterwards
+				ret = mapChunk( filename, dcdata, format );
+
+			if( !ret.get() ) // otherwise reference the pixel data in the element
+				ret = elementChunk( filename, dcfile, format );
+
+			if( ret.get() ) {
+				ImageFormat_Dicom::dcmObject2PropMap( dcdata, ret->branch( ImageFormat_Dicom::dicomTagTreeName ), dialect );
+				return *ret;
+			}
+		}
+
 		std::auto_ptr<DicomImage> img( new DicomImage( dcfile.get(), EXS_Unknown ) );
 
 		if ( img->getStatus() == EIS_Normal ) {
@@ -137,7 +336,7 @@ const char ImageFormat_Dicom::unknownTagName[] = "Unknown Tag";
 
 std::string ImageFormat_Dicom::suffixes()const {return std::string( ".ima .dcm" );}
 std::string ImageFormat_Dicom::getName()const {return "Dicom";}
-std::string ImageFormat_Dicom::dialects( const std::string &/*filename*/ )const {return "withExtProtocols nomosaic";}
+std::string ImageFormat_Dicom::dialects( const std::string &/*filename*/ )const {return "withExtProtocols nomosaic minimalCSA minimal";}
 
 
 
@@ -357,8 +556,6 @@ int ImageFormat_Dicom::readMosaic( isis::data::Chunk source, std::list< isis::da
 	std::replace( iType.begin(), iType.end(), std::string( "MOSAIC" ), std::string( "WAS_MOSAIC" ) );
 	util::istring NumberOfImagesInMosaicProp;
 
-	const unsigned short oldSize = dest.size();
-
 	if ( source.hasProperty( prefix + "Unknown Tag(0019,100a)" ) ) {
 		NumberOfImagesInMosaicProp = prefix + "Unknown Tag(0019,100a)";
 	} else if ( source.hasProperty( prefix + "CSAImageHeaderInfo/NumberOfImagesInMosaic" ) ) {
@@ -374,7 +571,7 @@ int ImageFormat_Dicom::readMosaic( isis::data::Chunk source, std::list< isis::da
 	size[0] /= matrixSize;
 	size[1] /= matrixSize;
 	assert( size[3] == 1 );
-	LOG( Debug, info ) << "Decomposing a " << source.getSizeAsString() << " mosaic-image into " << images << " " << size << " slices";
+	LOG( Debug, info ) << "Decomposing a " << source.getSizeAsString() << " mosaic-image into a volume of " << images << " " << size << " slices";
 	// fix the properties of the source (we 'll need them later)
 	util::fvector4 voxelGap;
 
@@ -403,106 +600,119 @@ int ImageFormat_Dicom::readMosaic( isis::data::Chunk source, std::list< isis::da
 		LOG( Debug, info ) << "Computed sliceVec as " << source.propertyValue( "sliceVec" );
 	}
 
-	const util::fvector4 sliceVec = source.getPropertyAs<util::fvector4>( "sliceVec" ).norm() * ( voxelSize[2] + voxelGap[2] );
+	// the whole mosaic becomes one chunk, so the acquisition times of the slices are stored as list (in the order of the slices in the volume)
+	if( source.hasProperty( prefix + "CSAImageHeaderInfo/MosaicRefAcqTimes" ) ) {
+		util::dlist sliceTimes = source.getPropertyAs<util::dlist>( prefix + "CSAImageHeaderInfo/MosaicRefAcqTimes" );
 
-	//store and remove acquisitionTime
-	std::list<double> acqTimeList;
-
-	std::list<double>::const_iterator acqTimeIt;
+		if( sliceTimes.size() == images ) {
+			// MosaicRefAcqTimes are relative to the acquisition of the mosaic
+			const double acqTime = source.hasProperty( "acquisitionTime" ) ? source.getPropertyAs<double>( "acquisitionTime" ) : 0;
+			BOOST_FOREACH( double & time, sliceTimes ) {
+				time += acqTime;
+			}
+			source.setPropertyAs( prefix + "sliceTimes", sliceTimes );
+			LOG( Debug, info ) << "The acquisition times of the slices in the mosaic are " << source.propertyValue( prefix + "sliceTimes" );
+		} else {
+			LOG( Runtime, warning ) << "Ignoring MosaicRefAcqTimes, as it has " << sliceTimes.size() << " entries for " << images << " slices";
+		}
+	}
 
-	bool haveAcqTimeList = source.hasProperty( prefix + "CSAImageHeaderInfo/MosaicRefAcqTimes" );
+	// create the volume and copy the tiles of the mosaic into it
+	dest.push_back( source.cloneToNew( size[0], size[1], images ) );
+	data::Chunk &volume = dest.back();
+	const size_t bytes = source.bytesPerVoxel(), line_bytes = size[0] * bytes, source_line_bytes = line_bytes * matrixSize;
+	const uint8_t *const src = boost::shared_static_cast<uint8_t>( source.asValuePtrBase().getRawAddress().lock() ).get();
+	uint8_t *dst = boost::shared_static_cast<uint8_t>( volume.asValuePtrBase().getRawAddress().lock() ).get();
 
-	float acqTime = 0;
+	for ( size_t slice = 0; slice < images; slice++ ) {
+		const size_t column = slice % matrixSize; //column of the mosaic
+		const size_t row = slice / matrixSize; //row of the mosaic
+		const uint8_t *tile = src + row * size[1] * source_line_bytes + column * line_bytes; // first line of the tile
 
-	if( haveAcqTimeList ) {
-		acqTimeList = source.getPropertyAs<std::list<double> >( prefix + "CSAImageHeaderInfo/MosaicRefAcqTimes" );
-		source.remove( prefix + "CSAImageHeaderInfo/MosaicRefAcqTimes" );
-		acqTimeIt = acqTimeList.begin();
-		LOG( Debug, info ) << "The acquisition time offsets of the slices in the mosaic where " << acqTimeList;
+		for ( size_t line = 0; line < size[1]; line++, tile += source_line_bytes, dst += line_bytes )
+			memcpy( dst, tile, line_bytes );
 	}
 
-	if( source.hasProperty( "acquisitionTime" ) ) {
-		acqTime = source.propertyValue( "acquisitionTime" )->castTo<float>();
+	// and "fix" its properties
+	static_cast<util::PropertyMap &>( volume ) = static_cast<const util::PropertyMap &>( source ); //copy _only_ the Properties of source
+
+	// update fov
+	if ( volume.hasProperty( "fov" ) ) {
+		util::fvector4 &ref = volume.propertyValue( "fov" )->castTo<util::fvector4>();
+		ref[0] /= matrixSize;
+		ref[1] /= matrixSize;
 	}
 
-	// for every slice
-	for ( size_t slice = 0; slice < images; slice++ ) {
-		dest.push_back( source.cloneToNew( size[0], size[1] ) );//create a new chunk at the end of the output
-		data::Chunk &working = dest.back(); // use this as working slice
-
-		// copy the lines into the corresponding slice-chunk
-		for ( size_t line = 0; line < size[1]; line++ ) {
-			const size_t dpos[] = {0, line, 0, 0}; //begin of the target line
-			const size_t column = slice % matrixSize; //column of the mosaic
-			const size_t row = slice / matrixSize; //row of the mosaic
-			const size_t sstart[] = {column *size[0], row *size[1] + line, 0, 0}; //begin of the source line
-			const size_t send[] = {sstart[0] + size[0] - 1, row *size[1] + line, 0, 0}; //end of the source line
-			source.copyRange( sstart, send, working, dpos );
-		}
+	LOG( Debug, verbose_info )
+			<< "New " << volume.getSizeAsString() << " volume at " << volume.propertyValue( "indexOrigin" ).toString( false )
+			<< " with acquisitionNumber " << volume.propertyValue( "acquisitionNumber" ).toString( false );
 
-		// and "fix" its properties
-		static_cast<util::PropertyMap &>( working ) = static_cast<const util::PropertyMap &>( source ); //copy _only_ the Properties of source
-		// update origin
-		util::fvector4 &origin = working.propertyValue( "indexOrigin" )->castTo<util::fvector4>();
-		origin = origin + ( sliceVec * slice );
-
-		// update fov
-		if ( working.hasProperty( "fov" ) ) {
-			util::fvector4 &ref = working.propertyValue( "fov" )->castTo<util::fvector4>();
-			ref[0] /= matrixSize;
-			ref[1] /= matrixSize;
-		}
+	return 1;
+}
 
-		// fix/set acquisitionNumber and acquisitionTime
-		working.propertyValue( "acquisitionNumber" )->castTo<uint32_t>() += slice;
 
-		if( haveAcqTimeList ) {
-			working.setPropertyAs<float>( "acquisitionTime", acqTime +  * ( acqTimeIt++ ) );
-		}
+int ImageFormat_Dicom::load( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &dialect )throw( std::runtime_error & )
+{
 
-		LOG( Debug, verbose_info )
-				<< "New slice " << slice << " at " << working.propertyValue( "indexOrigin" ).toString( false )
-				<< " with acquisitionNumber " << working.propertyValue( "acquisitionNumber" ).toString( false )
-				<< ( haveAcqTimeList ? std::string( " and acquisitionTime " ) + working.propertyValue( "acquisitionTime" ).toString( false ) : "" );
+	std::auto_ptr<DcmFileFormat> dcfile( new DcmFileFormat );
+	// dcmtk reads big values (like the pixel data) only when they are accessed, makeChunk maps them from the file instead if it can
+	OFCondition loaded = dcfile->loadFile( filename.c_str() );
+
+	if ( loaded.good() ) {
+		return readDcmFile( chunks, dcfile, filename, dialect, true );
+	} else {
+		FileFormat::throwGenericError( std::string( "Failed to open file: " ) + loaded.text() );
 	}
 
-	return dest.size() - oldSize;
+	return 0;
 }
 
-
-int ImageFormat_Dicom::load( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &dialect )throw( std::runtime_error & )
+int ImageFormat_Dicom::load( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src, const std::string &filename, const std::string &dialect )throw( std::runtime_error & )
 {
 
 	std::auto_ptr<DcmFileFormat> dcfile( new DcmFileFormat );
-	OFCondition loaded = dcfile->loadFile( filename.c_str() );
+	DcmInputBufferStream buffer;
+	buffer.setBuffer( &src[0], src.getLength() );
+	buffer.setEos(); // there won't be any more data
+
+	dcfile->transferInit();
+	OFCondition loaded = dcfile->read( buffer, EXS_Unknown, EGL_noChange, DCM_MaxReadLength );
+	dcfile->transferEnd();
 
 	if ( loaded.good() ) {
-		data::Chunk chunk = _internal::DicomChunk::makeChunk( filename, dcfile, dialect );
-		//we got a chunk from the file
-		sanitise( chunk, "" );
-		chunk.setPropertyAs( "source", filename );
-		const util::slist iType = chunk.getPropertyAs<util::slist>( util::istring( ImageFormat_Dicom::dicomTagTreeName ) + "/" + "ImageType" );
-
-		if ( std::find( iType.begin(), iType.end(), "MOSAIC" ) != iType.end() ) { // if its a mosaic
-			if( dialect == "nomosaic" ) {
-				LOG( Runtime, info ) << "This seems to be an mosaic image, but dialect \"nomosaic\" was selected";
-				chunks.push_back( chunk );
-				return 1;
-			} else {
-				LOG( Runtime, verbose_info ) << "This seems to be an mosaic image, will decompose it";
-				return readMosaic( chunk, chunks );
-			}
-		} else {
+		dcfile->loadAllDataIntoMemory(); // make sure nothing references the buffer anymore
+		return readDcmFile( chunks, dcfile, filename, dialect, false );
+	} else {
+		FileFormat::throwGenericError( std::string( "Failed to read from memory: " ) + loaded.text() );
+	}
+
+	return 0;
+}
+
+int ImageFormat_Dicom::readDcmFile( std::list<data::Chunk> &chunks, std::auto_ptr<DcmFileFormat> dcfile, const std::string &filename, const std::string &dialect, bool mappable )
+{
+	data::Chunk chunk = _internal::DicomChunk::makeChunk( filename, dcfile, dialect, mappable );
+	//we got a chunk from the file
+	sanitise( chunk, "" );
+	chunk.setPropertyAs( "source", filename );
+	const util::slist iType = chunk.getPropertyAs<util::slist>( util::istring( ImageFormat_Dicom::dicomTagTreeName ) + "/" + "ImageType" );
+
+	if ( std::find( iType.begin(), iType.end(), "MOSAIC" ) != iType.end() ) { // if its a mosaic
+		if( dialect == "nomosaic" ) {
+			LOG( Runtime, info ) << "This seems to be an mosaic image, but dialect \"nomosaic\" was selected";
 			chunks.push_back( chunk );
 			return 1;
+		} else {
+			LOG( Runtime, verbose_info ) << "This seems to be an mosaic image, will decompose it";
+			return readMosaic( chunk, chunks );
 		}
 	} else {
-		FileFormat::throwGenericError( std::string( "Failed to open file: " ) + loaded.text() );
+		chunks.push_back( chunk );
+		return 1;
 	}
-
-	return 0;
 }
 
+
 void ImageFormat_Dicom::write( const data::Image &/*image*/, const std::string &/*filename*/, const std::string &/*dialect*/ ) throw( std::runtime_error & )
 {
 	throw( std::runtime_error( "writing dicom files is not yet supportet" ) );
@@ -30,11 +30,80 @@
 
 #include <dcmtk/dcmdata/dcfilefo.h>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/date_time/gregorian/gregorian_types.hpp>
 
 namespace isis
 {
 namespace image_io
 {
+namespace _internal
+{
+/// skip the spaces DICOM allows around values
+inline const char *skipSpaces( const char *at, const char *end )
+{
+	while ( at < end && *at == ' ' )
+		++at;
+
+	return at;
+}
+
+inline bool isDigit( char c ) {return c >= '0' && c <= '9';}
+
+/**
+ * Locale independent parser for integer strings (IS).
+ * Parses one value beginning at at and moves at behind it (and the spaces after it).
+ * \returns false if there is no valid 32bit integer
+ */
+bool parseNumber( const char *&at, const char *end, int32_t &dest );
+
+/**
+ * Locale independent parser for decimal strings (DS).
+ * Parses one value beginning at at and moves at behind it (and the spaces after it).
+ * Values with up to 15 significant digits and a decimal exponent within +/-22 (which covers everything DS can hold without exponent) are converted exactly.
+ * Others are handed to a stream using the classic locale.
+ * \returns false if there is no valid number
+ */
+bool parseNumber( const char *&at, const char *end, double &dest );
+
+/**
+ * Parse backslash separated DS or IS values.
+ * At most max values are written to out.
+ * \returns the number of values parsed, or 0 if one of them is not a valid number (or there are more than max)
+ */
+template<typename T, typename OUT> size_t parseNumbers( const char *at, const char *end, OUT out, size_t max )
+{
+	for ( size_t cnt = 1; cnt <= max; cnt++ ) {
+		T val;
+
+		if ( !parseNumber( at, end, val ) )
+			return 0;
+
+		*out++ = val;
+
+		if ( at == end )
+			return cnt;
+		else if ( *at != '\\' )
+			return 0;
+
+		++at;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse a date in the format yyyymmdd or yyyy.mm.dd (followed by optional spaces).
+ * \returns false if the string is no valid date
+ */
+bool parseDate( const char *at, const char *end, boost::gregorian::date &dest );
+
+/**
+ * Parse a time in the format hhmmss.frac or hh:mm:ss.frac (followed by optional spaces).
+ * Minutes, seconds and the fraction may be omitted as long as the components right of them are omitted as well.
+ * \returns false if the string is no valid time
+ */
+bool parseTime( const char *at, const char *end, boost::posix_time::time_duration &dest );
+}
 
 class ImageFormat_Dicom: public FileFormat
 {
@@ -59,7 +128,8 @@ class ImageFormat_Dicom: public FileFormat
 	static size_t parseCSAEntry( Uint8 *at, isis::util::PropertyMap &map, const std::string &dialect );
 	static bool parseCSAValue( const std::string &val, const util::istring &name, const util::istring &vr, isis::util::PropertyMap &map );
 	static bool parseCSAValueList( const isis::util::slist &val, const util::istring &name, const util::istring &vr, isis::util::PropertyMap &map );
-	static int readMosaic( data::Chunk source, std::list<data::Chunk> &dest );
+	/// make chunks out of a loaded dicom file (mappable tells, if filename is actually the file the data was loaded from)
+	static int readDcmFile( std::list<data::Chunk> &chunks, std::auto_ptr<DcmFileFormat> dcfile, const std::string &filename, const std::string &dialect, bool mappable );
 protected:
 	std::string suffixes()const;
 public:
@@ -71,10 +141,18 @@ public:
 	static void parseList( DcmElement *elem, const util::istring &name, isis::util::PropertyMap &map );
 	static void dcmObject2PropMap( DcmObject *master_obj, isis::util::PropertyMap &map, const std::string &dialect );
 	static void sanitise( util::PropertyMap &object, std::string dialect );
+	/**
+	 * Decompose a siemens mosaic into a volume chunk.
+	 * The acquisition times of the slices (acquisitionTime plus the offsets from CSAImageHeaderInfo/MosaicRefAcqTimes, in ms)
+	 * are stored as list in DICOM/sliceTimes - in the order of the slices in the volume.
+	 * \returns the amount of chunks added to dest
+	 */
+	static int readMosaic( data::Chunk source, std::list<data::Chunk> &dest );
 	std::string getName()const;
 	std::string dialects( const std::string &filename )const;
 
 	int load( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & );
+	int load( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & );
 	void write( const data::Image &image, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & );
 
 	bool tainted()const;
@@ -4,6 +4,8 @@
 #include <DataStorage/common.hpp>
 #include "dcmtk/dcmdata/dcdict.h"
 #include "dcmtk/dcmdata/dcdicent.h"
+#include <string.h>
+#include <sstream>
 
 namespace isis
 {
@@ -32,6 +34,199 @@ template<typename T> std::list<T> dcmtkListString2list( DcmElement *elem )
 	return util::stringToList<T>( std::string( buff.c_str() ), '\\' );
 }
 
+bool parseNumber( const char *&at, const char *end, int32_t &dest )
+{
+	const char *pos = skipSpaces( at, end );
+	bool negative = false;
+	int64_t val = 0;
+
+	if ( pos < end && ( *pos == '-' || *pos == '+' ) )
+		negative = ( *pos++ == '-' );
+
+	if ( pos == end || !isDigit( *pos ) )
+		return false;
+
+	for ( ; pos < end && isDigit( *pos ); ++pos ) {
+		val = val * 10 + ( *pos - '0' );
+
+		if ( val > ( negative ? 2147483648LL : 2147483647LL ) )
+			return false;
+	}
+
+	dest = negative ? -val : val;
+	at = skipSpaces( pos, end );
+	return true;
+}
+
+bool parseNumber( const char *&at, const char *end, double &dest )
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char *pos = skipSpaces( at, end );
+	const char *const start = pos;
+	bool negative = false, digits = false;
+	int64_t mantissa = 0;
+	int exponent = 0, significant = 0;
+
+	if ( pos < end && ( *pos == '-' || *pos == '+' ) )
+		negative = ( *pos++ == '-' );
+
+	for ( ; pos < end && isDigit( *pos ); ++pos, digits = true ) {
+		if ( significant < 18 ) {
+			mantissa = mantissa * 10 + ( *pos - '0' );
+			significant += ( mantissa != 0 );
+		} else
+			exponent++;
+	}
+
+	if ( pos < end && *pos == '.' ) {
+		for ( ++pos; pos < end && isDigit( *pos ); ++pos, digits = true ) {
+			if ( significant < 18 ) {
+				mantissa = mantissa * 10 + ( *pos - '0' );
+				significant += ( mantissa != 0 );
+				exponent--;
+			}
+		}
+	}
+
+	if ( !digits )
+		return false;
+
+	if ( pos < end && ( *pos == 'e' || *pos == 'E' ) ) {
+		int32_t exp;
+		const char *epos = pos + 1;
+
+		if ( epos == end || *epos == ' ' || !parseNumber( epos, end, exp ) )
+			return false;
+
+		exponent += exp;
+		pos = epos;
+	}
+
+	if ( significant <= 15 && exponent >= -22 && exponent <= 22 ) { // mantissa and the power of ten are exact doubles, so the result is correctly rounded
+		const double val = exponent < 0 ? mantissa / pow10[-exponent] : mantissa * pow10[exponent];
+		dest = negative ? -val : val;
+	} else {
+		std::istringstream in( std::string( start, pos ) );
+		in.imbue( std::locale::classic() );
+
+		if ( !( in >> dest ) )
+			return false;
+	}
+
+	at = skipSpaces( pos, end );
+	return true;
+}
+
+/// parse the backslash separated values of a DS or IS element directly from its string buffer (see parseNumbers for strings)
+template<typename T, typename OUT> size_t parseNumbers( DcmElement *elem, OUT out, size_t max )
+{
+	char *buff = NULL;
+
+	if ( elem->getString( buff ).bad() || !buff )
+		return 0;
+
+	return parseNumbers<T>( buff, buff + strlen( buff ), out, max );
+}
+
+bool parseDate( const char *at, const char *end, boost::gregorian::date &dest )
+{
+	int fields[3] = {0, 0, 0};
+	const int lengths[3] = {4, 2, 2};
+
+	for ( int n = 0; n < 3; n++ ) {
+		if ( n && at < end && *at == '.' )
+			++at;
+
+		for ( int i = 0; i < lengths[n]; i++, ++at ) {
+			if ( at == end || !isDigit( *at ) )
+				return false;
+
+			fields[n] = fields[n] * 10 + ( *at - '0' );
+		}
+	}
+
+	if ( skipSpaces( at, end ) != end )
+		return false;
+
+	try {
+		dest = boost::gregorian::date( fields[0], fields[1], fields[2] );
+	} catch ( const std::out_of_range & ) {
+		return false;
+	}
+
+	return true;
+}
+
+bool parseTime( const char *at, const char *end, boost::posix_time::time_duration &dest )
+{
+	int fields[3] = {0, 0, 0}, n = 0;
+	long frac = 0;
+
+	for ( ; n < 3; n++ ) {
+		const char *pos = ( n && at < end && *at == ':' ) ? at + 1 : at;
+
+		if ( end - pos < 2 || !isDigit( pos[0] ) || !isDigit( pos[1] ) )
+			break;
+
+		fields[n] = ( pos[0] - '0' ) * 10 + pos[1] - '0';
+		at = pos + 2;
+	}
+
+	if ( n == 3 && at < end && *at == '.' ) {
+		long scale = 100000; // the fraction is given as up to 6 digits
+
+		for ( ++at; at < end && isDigit( *at ); ++at, scale /= 10 )
+			frac += ( *at - '0' ) * scale;
+	}
+
+	if ( n == 0 || skipSpaces( at, end ) != end || fields[0] > 23 || fields[1] > 59 || fields[2] > 60 )
+		return false;
+
+	dest = boost::posix_time::hours( fields[0] ) + boost::posix_time::minutes( fields[1] ) + boost::posix_time::seconds( fields[2] ) + boost::posix_time::microseconds( frac );
+	return true;
+}
+
+/// CSA entries which are used by the plugin itself (mosaic, sliceVec, coilChannelMask) or are commonly needed for slice timing and diffusion
+bool isEssentialCSA( const char *name )
+{
+	static const char *const essential[] = {
+		"NumberOfImagesInMosaic", "MosaicRefAcqTimes", "SliceNormalVector", "UsedChannelMask",
+		"B_value", "B_matrix", "DiffusionGradientDirection", "DiffusionDirectionality"
+	};
+
+	for ( size_t i = 0; i < sizeof( essential ) / sizeof( essential[0] ); i++ ) {
+		if ( strcmp( name, essential[i] ) == 0 )
+			return true;
+	}
+
+	return false;
+}
+
+/// dicom tags which are needed by sanitise, readMosaic and for sorting the chunks into images
+bool isEssentialTag( const util::istring &name )
+{
+	static const char *const essential[] = {
+		"ImageType", "InstanceNumber", "ImageOrientationPatient", "ImagePositionPatient", "PixelSpacing",
+		"SliceThickness", "SpacingBetweenSlices", "SeriesNumber", "SeriesDate", "SeriesTime", "SeriesDescription",
+		"AcquisitionDate", "AcquisitionTime", "EchoTime", "RepetitionTime", "FlipAngle", "NumberOfAverages",
+		"DiffusionBValue", "DiffusionGradientOrientation", "TransmitCoilName", "PerformingPhysiciansName",
+		"PatientsName", "PatientsSex", "PatientsAge", "PatientsBirthDate", "PatientsWeight",
+		"CSAImageHeaderInfo", "Unknown Tag(0029,1010)",
+		"Unknown Tag(0019,100a)", "Unknown Tag(0019,100c)", "Unknown Tag(0019,100e)", "Unknown Tag(0019,1015)",
+		"Unknown Tag(0019,1029)", "Unknown Tag(0051,100c)"
+	};
+
+	for ( size_t i = 0; i < sizeof( essential ) / sizeof( essential[0] ); i++ ) {
+		if ( name == essential[i] )
+			return true;
+	}
+
+	return false;
+}
+
 }
 /**
  * Parses the Age String
@@ -93,24 +288,16 @@ void ImageFormat_Dicom::parseAS( DcmElement *elem, const util::istring &name, ut
  */
 void ImageFormat_Dicom::parseDA( DcmElement *elem, const util::istring &name, util::PropertyMap &map )
 {
-	//@todo if we drop support for old yyyy.mm.dd this would be much easier
-	boost::regex reg( "^([[:digit:]]{4})\\.?([[:digit:]]{2})\\.?([[:digit:]]{2})$" );
-	boost::cmatch results;
-	OFString buff;
-	elem->getOFString( buff, 0 );
+	char *buff = NULL;
+	boost::gregorian::date date;
 
-	if ( boost::regex_match( buff.c_str(), results, reg ) ) {
-		const boost::gregorian::date date(
-			boost::lexical_cast<int16_t>( results.str( 1 ) ), //year
-			boost::lexical_cast<int16_t>( results.str( 2 ) ), //month
-			boost::lexical_cast<int16_t>( results.str( 3 ) ) //day of month
-		);
+	if ( elem->getString( buff ).good() && buff && _internal::parseDate( buff, buff + strlen( buff ), date ) ) {
 		LOG( Debug, verbose_info )
 				<< "Parsed date for " << name << "(" <<  buff << ")" << " as " << date;
 		map.propertyValue( name ) = date;
 	} else
 		LOG( Runtime, warning )
-				<< "Cannot parse Date string \"" << buff << "\" in the field \"" << name << "\"";
+				<< "Cannot parse Date string \"" << ( buff ? buff : "" ) << "\" in the field \"" << name << "\"";
 }
 
 /**
@@ -134,39 +321,17 @@ void ImageFormat_Dicom::parseDA( DcmElement *elem, const util::istring &name, ut
  */
 void ImageFormat_Dicom::parseTM( DcmElement *elem, const util::istring &name, util::PropertyMap &map )
 {
-	short shift = 0;
-	OFString buff;
-	bool ok = true;
+	char *buff = NULL;
 	boost::posix_time::time_duration time;
-	elem->getOFString( buff, 0 );
-
-	// Insert the ":" -- make it hh:mm:ss.frac
-	if ( buff.at( 2 ) != ':' ) {
-		buff.insert( 2, 1, ':' );
-		shift++;
-	}
-
-	if ( ( buff.size() > size_t( 4 + shift ) ) && ( buff.at( 4 + shift ) != ':' ) ) {
-		buff.insert( 4 + shift, 1, ':' );
-		shift++;
-	}
 
-	//Try standard-parser for hh:mm:ss.frac
-	try {
-		time = boost::posix_time::duration_from_string( buff.c_str() );
-		ok = not time.is_not_a_date_time();
-	} catch ( std::logic_error e ) {
-		ok = false;
-	}
-
-	if ( ok ) {
+	if ( elem->getString( buff ).good() && buff && _internal::parseTime( buff, buff + strlen( buff ), time ) ) {
 		LOG( Debug, verbose_info )
 				<< "Parsed time for " << name << "(" <<  buff << ")" << " as " << time;
 		map.propertyValue( name ) = boost::posix_time::ptime( boost::gregorian::date( 1400, 1, 1 ), time );
 		//although TM is defined as time of day we dont have a day here, so we fake one
 	} else
 		LOG( Runtime, warning )
-				<< "Cannot parse Time string \"" << buff << "\" in the field \"" << name << "\"";
+				<< "Cannot parse Time string \"" << ( buff ? buff : "" ) << "\" in the field \"" << name << "\"";
 }
 
 void ImageFormat_Dicom::parseScalar( DcmElement *elem, const util::istring &name, util::PropertyMap &map )
@@ -199,8 +364,12 @@ void ImageFormat_Dicom::parseScalar( DcmElement *elem, const util::istring &name
 	}
 	break;
 	case EVR_DS: { //Decimal String (can be floating point)
-		elem->getOFString( buff, 0 );
-		map.setPropertyAs<double>( name, boost::lexical_cast<double>( buff ) );
+		double val;
+
+		if ( _internal::parseNumbers<double>( elem, &val, 1 ) )
+			map.setPropertyAs<double>( name, val );
+		else
+			LOG( Runtime, warning ) << "Cannot parse decimal string in the field " << name;
 	}
 	break;
 	case EVR_SL: { //signed long
@@ -228,8 +397,12 @@ void ImageFormat_Dicom::parseScalar( DcmElement *elem, const util::istring &name
 	}
 	break;
 	case EVR_IS: { //integer string
-		elem->getOFString( buff, 0 );
-		map.setPropertyAs<int32_t>( name, boost::lexical_cast<int32_t>( buff ) );
+		int32_t val;
+
+		if ( _internal::parseNumbers<int32_t>( elem, &val, 1 ) )
+			map.setPropertyAs<int32_t>( name, val );
+		else
+			LOG( Runtime, warning ) << "Cannot parse integer string in the field " << name;
 	}
 	break;
 	case EVR_AE: //Application Entity (string)
@@ -279,10 +452,15 @@ void ImageFormat_Dicom::parseVector( DcmElement *elem, const util::istring &name
 	}
 	break;
 	case EVR_IS: {
-		const util::ilist tokens = _internal::dcmtkListString2list<int>( elem );
+		int32_t buff[4];
+		const size_t cnt = _internal::parseNumbers<int32_t>( elem, buff, 4 );
 		util::ivector4 vector;
-		vector.copyFrom( tokens.begin(), tokens.end() );
-		map.propertyValue( name ) = vector;
+		vector.copyFrom( buff, buff + cnt );
+
+		if ( cnt )
+			map.propertyValue( name ) = vector;
+		else
+			LOG( Runtime, warning ) << "Cannot parse integer strings in the field " << name;
 	}
 	break;
 	case EVR_SL: {
@@ -308,10 +486,15 @@ void ImageFormat_Dicom::parseVector( DcmElement *elem, const util::istring &name
 	}
 	break;
 	case EVR_DS: {
-		const util::dlist tokens = _internal::dcmtkListString2list<double>( elem );
+		double buff[4];
+		const size_t cnt = _internal::parseNumbers<double>( elem, buff, 4 );
 		util::dvector4 vector;
-		vector.copyFrom( tokens.begin(), tokens.end() );
-		map.propertyValue( name ) = vector;
+		vector.copyFrom( buff, buff + cnt );
+
+		if ( cnt )
+			map.propertyValue( name ) = vector;
+		else
+			LOG( Runtime, warning ) << "Cannot parse decimal strings in the field " << name;
 	}
 	break;
 	case EVR_AS:
@@ -357,7 +540,12 @@ void ImageFormat_Dicom::parseList( DcmElement *elem, const util::istring &name,
 	}
 	break;
 	case EVR_IS: {
-		map.propertyValue( name ) = _internal::dcmtkListString2list<int>( elem );
+		util::ilist values;
+
+		if ( _internal::parseNumbers<int32_t>( elem, std::back_inserter( values ), len ) )
+			map.propertyValue( name ) = values;
+		else
+			LOG( Runtime, warning ) << "Cannot parse integer strings in the field " << name;
 	}
 	break;
 	case EVR_SL: {
@@ -379,7 +567,12 @@ void ImageFormat_Dicom::parseList( DcmElement *elem, const util::istring &name,
 	}
 	break;
 	case EVR_DS: {
-		map.propertyValue( name ) = _internal::dcmtkListString2list<double>( elem );
+		util::dlist values;
+
+		if ( _internal::parseNumbers<double>( elem, std::back_inserter( values ), len ) )
+			map.propertyValue( name ) = values;
+		else
+			LOG( Runtime, warning ) << "Cannot parse decimal strings in the field " << name;
 	}
 	break;
 	case EVR_AS:
@@ -431,6 +624,16 @@ size_t ImageFormat_Dicom::parseCSAEntry( Uint8 *at, isis::util::PropertyMap &map
 	const Sint32 nitems = endian<Uint8, Uint32>( at + pos );
 	pos += sizeof( Sint32 );
 
+	// decide once per entry if its values are needed at all, the others are just skipped
+	bool decode = true;
+
+	if ( dialect == "minimalCSA" || dialect == "minimal" ) {
+		decode = _internal::isEssentialCSA( name );
+	} else if ( strcmp( name, "MrPhoenixProtocol" ) == 0 || strcmp( name, "MrEvaProtocol" ) == 0 || strcmp( name, "MrProtocol" ) == 0 ) {
+		decode = ( dialect == "withExtProtocols" );
+		LOG_IF( !decode, Runtime, info ) << "Skipping " << name << " as its not requested by the dialect (use dialect \"withExtProtocols\" to get it)";
+	}
+
 	if ( nitems ) {
 		pos += sizeof( Sint32 ); //77
 		util::slist ret;
@@ -442,9 +645,7 @@ size_t ImageFormat_Dicom::parseCSAEntry( Uint8 *at, isis::util::PropertyMap &map
 
 			if ( !len )continue;
 
-			if( (
-					std::string( "MrPhoenixProtocol" ) != name  && std::string( "MrEvaProtocol" ) != name && std::string( "MrProtocol" ) != name
-				) || dialect == "withExtProtocols" ) {
+			if( decode ) {
 				std::string insert( ( char * )at + pos );
 				const std::string whitespaces( " \t\f\v\n\r" );
 				const std::string::size_type start = insert.find_first_not_of( whitespaces );
@@ -459,8 +660,6 @@ size_t ImageFormat_Dicom::parseCSAEntry( Uint8 *at, isis::util::PropertyMap &map
 					else
 						ret.push_back( insert.substr( start, end + 1 - start ) );//store the text if there is some
 				}
-			} else {
-				LOG( Runtime, info ) << "Skipping " << name << " as its not requested by the dialect (use dialect \"withExtProtocols\" to get it)";
 			}
 
 			pos += (
@@ -546,6 +745,10 @@ void ImageFormat_Dicom::dcmObject2PropMap( DcmObject *master_obj, isis::util::Pr
 
 		if ( name == "PixelData" )
 			continue;//skip the image data
+		else if ( dialect == "minimal" && !_internal::isEssentialTag( name ) ) {
+			LOG( Debug, verbose_info ) << "Skipping " << name << " as its not needed for dialect \"minimal\"";
+			continue;
+		}
 		else if ( name == "CSAImageHeaderInfo" || tag == DcmTagKey( 0x0029, 0x1010 ) ) {
 			LOG( Debug, info ) << "Using " << tag.toString() << " as CSAImageHeaderInfo";
 			DcmElement *elem = dynamic_cast<DcmElement *>( obj );
@@ -112,6 +112,19 @@ class ImageFormat_Nifti : public FileFormat
 			nifti_image_free( m_pNiImage );
 		}
 	};
+	// deleter for nifti images whose data is referencing memory handed in by another plugin
+	struct MemDeleter {
+		nifti_image *m_pNiImage;
+		data::ValuePtr<uint8_t> m_mem;
+		MemDeleter( nifti_image *ni, const data::ValuePtr<uint8_t> &mem ) :
+			m_pNiImage( ni ), m_mem( mem ) {}
+
+		void operator ()( void * ) {
+			LOG( ImageIoDebug, info ) << "Freeing Nifti-Chunk from memory at " << ( void * )&m_mem[0];
+			m_pNiImage->data = NULL; // the data is not ours - so nifti_image_free shall not free it
+			nifti_image_free( m_pNiImage );
+		}
+	};
 protected:
 	std::string suffixes()const {
 		return std::string( ".nii.gz .nii .hdr" );
@@ -143,50 +156,57 @@ public:
 		if ( not ni )
 			throwGenericError( "nifti_image_read() failed" );
 
-		// 0.0 would mean "not in use" - so for better handling use a 1.0
-		float scale = ni->scl_slope ? ni->scl_slope : 1.0;
+		return addChunk( retList, ni, Deleter( ni, filename ) );
+	}
 
-		// TODO: at the moment scaling not supported due to data type changes
-		if ( 1.0 != scale ) {
-			//          throwGenericError( std::string( "Scaling is not supported at the moment. Scale Factor: " ) + util::Value<float>( scale ).toString() );
-			LOG( ImageIoDebug, warning ) << "Scaling is not supported at the moment. Scale Factor: "  + util::Value<float>( scale ).toString();
+	/***********************
+	 * load from memory
+	 ************************/
+	int load( std::list<data::Chunk> &retList, const data::ValuePtr<uint8_t> &src, const std::string &filename, const std::string &dialect )  throw( std::runtime_error & ) {
+		if( src.getLength() >= 2 && src[0] == 0x1f && src[1] == 0x8b ) // gzip magic - leave it to the compression proxy
+			throwGenericError( "Cannot read compressed nifti data from memory" );
+
+		if( src.getLength() < sizeof( nifti_1_header ) )
+			throwGenericError( "Too few data for a nifti header" );
+
+		nifti_1_header header;
+		memcpy( &header, &src[0], sizeof( nifti_1_header ) );
+
+		if( !NIFTI_ONEFILE( header ) ) { // header and data are in separate files - let the default implementation deal with it
+			LOG( ImageIoDebug, info ) << util::MSubject( filename ) << " is no single file nifti, falling back to loading from a temporary file";
+			return FileFormat::load( retList, src, filename, dialect );
 		}
 
-		LOG( ImageIoDebug, isis::info ) << "datatype to load from nifti " << ni->datatype;
-		Deleter del( ni, filename );
+		nifti_image *ni = nifti_convert_nhdr2nim( header, filename.c_str() ); // this also does the byteswapping of the header if necessary
 
-		switch ( ni->datatype ) {
-		case DT_UINT8:
-			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<uint8_t *> ( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 )  );
-			break;
-		case DT_INT8:
-			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<int8_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
-			break;
-		case DT_INT16:
-			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<int16_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
-			break;
-		case DT_UINT16:
-			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<uint16_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
-			break;
-		case DT_UINT32:
-			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<uint32_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
-			break;
-		case DT_INT32:
-			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<int32_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
-			break;
-		case DT_FLOAT32:
-			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<float *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
-			break;
-		case DT_FLOAT64:
-			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<double *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
-			break;
-		default:
-			throwGenericError( std::string( "Unsupported datatype " ) + util::Value<int>( ni->datatype ).toString() );
+		if ( not ni )
+			throwGenericError( "nifti_convert_nhdr2nim() failed" );
+
+		const size_t bytes = ni->nvox * ni->nbyper;
+
+		if( ni->iname_offset < 0 || src.getLength() < static_cast<size_t>( ni->iname_offset ) + bytes ) {
+			nifti_image_free( ni );
+			throwGenericError( "Too few data for the image described in the nifti header" );
 		}
 
-		// don't forget to take the properties with
-		copyHeaderFromNifti( retList.back(), *ni );
-		return 1; // if there was an error, we wouldn't get here
+		uint8_t *const data_at = const_cast<uint8_t *>( &src[ni->iname_offset] );
+
+		if( ni->byteorder != nifti_short_order() ) { // we'll have to swap - so we need a copy, the memory isn't ours
+			LOG( ImageIoDebug, info ) << "Swapping nifti data of " << util::MSubject( filename ) << " into its own memory";
+			ni->data = malloc( bytes );
+
+			if( not ni->data ) {
+				nifti_image_free( ni );
+				throwGenericError( "Failed to allocate memory for nifti data" );
+			}
+
+			memcpy( ni->data, data_at, bytes );
+			nifti_swap_Nbytes( ni->nvox, ni->swapsize, ni->data );
+			return addChunk( retList, ni, Deleter( ni, filename ) );
+		} else {
+			ni->data = data_at;
+			return addChunk( retList, ni, MemDeleter( ni, src ) );
+		}
 	}
 
 
@@ -381,6 +401,52 @@ private:
 		slice->castTo<util::fvector4>() = util::fvector4( geo.m[0][2], geo.m[1][2], geo.m[2][2], geo.m[3][2] ) / div[2];
 	}
 
+	template<typename D> int addChunk( std::list<data::Chunk> &retList, nifti_image *ni, const D &del ) {
+		// 0.0 would mean "not in use" - so for better handling use a 1.0
+		float scale = ni->scl_slope ? ni->scl_slope : 1.0;
+
+		// TODO: at the moment scaling not supported due to data type changes
+		if ( 1.0 != scale ) {
+			//          throwGenericError( std::string( "Scaling is not supported at the moment. Scale Factor: " ) + util::Value<float>( scale ).toString() );
+			LOG( ImageIoDebug, warning ) << "Scaling is not supported at the moment. Scale Factor: "  + util::Value<float>( scale ).toString();
+		}
+
+		LOG( ImageIoDebug, isis::info ) << "datatype to load from nifti " << ni->datatype;
+
+		switch ( ni->datatype ) {
+		case DT_UINT8:
+			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<uint8_t *> ( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 )  );
+			break;
+		case DT_INT8:
+			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<int8_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
+			break;
+		case DT_INT16:
+			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<int16_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
+			break;
+		case DT_UINT16:
+			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<uint16_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
+			break;
+		case DT_UINT32:
+			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<uint32_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
+			break;
+		case DT_INT32:
+			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<int32_t *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
+			break;
+		case DT_FLOAT32:
+			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<float *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
+			break;
+		case DT_FLOAT64:
+			retList.push_back( _internal::NiftiChunk::makeNiftiChunk( static_cast<double *>( ni->data ), del, ni->dim[1], ni->dim[2], ni->dim[3], ni->dim[4] ? ni->dim[4] : 1 ) );
+			break;
+		default:
+			throwGenericError( std::string( "Unsupported datatype " ) + util::Value<int>( ni->datatype ).toString() );
+		}
+
+		// don't forget to take the properties with
+		copyHeaderFromNifti( retList.back(), *ni );
+		return 1; // if there was an error, we wouldn't get here
+	}
+
 	void copyHeaderFromNifti( data::Chunk &retChunk, const nifti_image &ni ) {
 		util::fvector4 dimensions( ni.dim[1], ni.ndim >= 2 ? ni.dim[2] : 1,
 								   ni.ndim >= 3 ? ni.dim[3] : 1, ni.ndim >= 4 ? ni.dim[4] : 1 );
@@ -23,12 +23,22 @@
 
 // local includes
 #include "imageFormat_Vista.hpp"
+#include <CoreUtils/threadpool.hpp>
 
 // global includes
 #include <list>
 #include <sstream>
 #include <algorithm>
+#include <limits>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <viaio/option.h>
+#include <boost/filesystem.hpp>
 #include <boost/mpl/if.hpp>
 #include <boost/type_traits/is_unsigned.hpp>
 
@@ -45,6 +55,205 @@ boost::is_unsigned<VBit>::type,
 	  int8_t
 	  >::type vista_bitmask_type;
 
+namespace _internal
+{
+/// deleter for the mapped file
+struct UnMap {
+	size_t m_length;
+	UnMap( size_t length ): m_length( length ) {}
+	void operator()( void *at ) {
+		LOG( Debug, info ) << "Unmapping " << m_length << " bytes at " << at;
+		munmap( at, m_length );
+	}
+};
+
+template<int SIZE> struct swap_type;
+template<> struct swap_type<1> {typedef uint8_t type;};
+template<> struct swap_type<2> {typedef uint16_t type;};
+template<> struct swap_type<4> {typedef uint32_t type;};
+template<> struct swap_type<8> {typedef uint64_t type;};
+
+inline uint8_t swapBytes( uint8_t v ) {return v;}
+inline uint16_t swapBytes( uint16_t v ) {return v << 8 | v >> 8;}
+inline uint32_t swapBytes( uint32_t v ) {return v << 24 | ( v & 0xFF00 ) << 8 | ( ( v >> 8 ) & 0xFF00 ) | v >> 24;}
+inline uint64_t swapBytes( uint64_t v ) {return uint64_t( swapBytes( uint32_t( v ) ) ) << 32 | swapBytes( uint32_t( v >> 32 ) );}
+
+/// copy count elements from src (which doesn't have to be aligned) to dst swapping their byte order
+template<typename TYPE> void swapCopy( TYPE *dst, const uint8_t *src, size_t count )
+{
+	typedef typename swap_type<sizeof( TYPE )>::type uint_type;
+	uint_type *at = reinterpret_cast<uint_type *>( dst );
+
+	for( uint_type *const end = at + count; at < end; at++, src += sizeof( uint_type ) ) {
+		uint_type val;
+		memcpy( &val, src, sizeof( uint_type ) );
+		*at = swapBytes( val );
+	}
+}
+
+/*
+ * Parser for the ascii header of vista files.
+ * The header is a list of attributes in curly brackets. Each attribute is "name: value", where value is either
+ * - a word (anything up to the next whitespace or bracket)
+ * - a quoted string (which may contain escaped characters)
+ * - a list of attributes (in curly brackets)
+ * - an object made of its type (a word) and its attribute list
+ */
+void skipSpace( const char *&at, const char *end )
+{
+	while( at < end && ( *at == ' ' || *at == '\t' || *at == '\n' || *at == '\r' ) )
+		at++;
+}
+std::string readWord( const char *&at, const char *end )
+{
+	const char *const start = at;
+
+	while( at < end && *at != ' ' && *at != '\t' && *at != '\n' && *at != '\r' && *at != '{' && *at != '}' )
+		at++;
+
+	return std::string( start, at );
+}
+bool readQuoted( const char *&at, const char *end, std::string &value )
+{
+	for( at++; at < end && *at != '"'; at++ ) {
+		if( *at == '\\' && at + 1 < end )
+			at++;
+
+		value += *at;
+	}
+
+	return at++ < end;
+}
+bool readList( const char *&at, const char *end, std::list<ImageFormat_Vista::VistaAttribute> &list )
+{
+	skipSpace( at, end );
+
+	if( at >= end || *at != '{' )
+		return false;
+
+	for( at++; ; ) {
+		skipSpace( at, end );
+
+		if( at >= end )
+			return false;
+
+		if( *at == '}' ) {
+			at++;
+			return true;
+		}
+
+		const char *const name = at;
+
+		while( at < end && *at != ':' && *at != '\n' )
+			at++;
+
+		if( at >= end || *at != ':' )
+			return false;
+
+		list.push_back( ImageFormat_Vista::VistaAttribute() );
+		ImageFormat_Vista::VistaAttribute &attr = list.back();
+		attr.name.assign( name, at++ );
+		skipSpace( at, end );
+
+		if( at >= end )
+			return false;
+
+		if( *at == '"' ) {
+			attr.quoted = true;
+
+			if( !readQuoted( at, end, attr.value ) )
+				return false;
+		} else if( *at == '{' ) { // plain attribute list
+			attr.isList = true;
+
+			if( !readList( at, end, attr.children ) )
+				return false;
+		} else {
+			attr.value = readWord( at, end );
+			const char *next = at;
+			skipSpace( next, end );
+
+			if( next < end && *next == '{' ) { // its an object, and the word was its type
+				attr.isList = true;
+
+				if( !readList( next, end, attr.children ) )
+					return false;
+
+				at = next;
+			}
+		}
+	}
+}
+
+/// orders slices the same way data::Image does
+struct originLess {
+	bool operator()( const data::Chunk *a, const data::Chunk *b )const {
+		return data::_internal::SortedChunkList::posCompare()(
+				   a->getPropertyAs<util::fvector4>( "indexOrigin" ), b->getPropertyAs<util::fvector4>( "indexOrigin" )
+			   );
+	}
+};
+
+/// check if the (sorted) slices have the given size and are equidistant
+bool isRegularVolume( const std::vector<data::Chunk *> &slices, const util::ivector4 &dims )
+{
+	util::fvector4 dist;
+
+	for( size_t z = 0; z < slices.size(); z++ ) {
+		const util::FixedVector<size_t, 4> size = slices[z]->getSizeAsVector();
+
+		if( size[0] != ( size_t )dims[0] || size[1] != ( size_t )dims[1] || size[2] != 1 || size[3] != ( size_t )dims[3] )
+			return false;
+
+		if( z ) {
+			const util::fvector4 d = slices[z]->getPropertyAs<util::fvector4>( "indexOrigin" ) - slices[z - 1]->getPropertyAs<util::fvector4>( "indexOrigin" );
+
+			if( z == 1 )
+				dist = d;
+
+			if( d.sqlen() == 0 || !d.fuzzyEqual( dist ) )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/// copies all timesteps of a slice into the volume-major voxel data of the volume (vista stores slice by slice, each holding all timesteps)
+struct SliceToVolume {
+	const std::vector<data::Chunk *> &m_slices;
+	VShort *m_dst;
+	size_t m_plane, m_timesteps;
+	SliceToVolume( const std::vector<data::Chunk *> &slices, VShort *dst, size_t plane, size_t timesteps ):
+		m_slices( slices ), m_dst( dst ), m_plane( plane ), m_timesteps( timesteps ) {}
+	void operator()( size_t z ) {
+		// whole planes are moved, so reading and writing stays sequential
+		const VShort *src = &m_slices[z]->voxel<VShort>( 0 );
+
+		for( size_t t = 0; t < m_timesteps; t++, src += m_plane )
+			memcpy( m_dst + ( t * m_slices.size() + z ) * m_plane, src, m_plane * sizeof( VShort ) );
+	}
+};
+
+/// the inverse of SliceToVolume - copies all timesteps of a slice of the (spliced) image into the voxel data of the vista image of the slice
+struct ImageToSlice {
+	const data::Image &m_image;
+	VImage *m_vimages;
+	size_t m_plane, m_timesteps;
+	ImageToSlice( const data::Image &image, VImage *vimages, size_t plane, size_t timesteps ):
+		m_image( image ), m_vimages( vimages ), m_plane( plane ), m_timesteps( timesteps ) {}
+	void operator()( size_t z ) {
+		VShort *dst = &VPixel( m_vimages[z], 0, 0, 0, VShort );
+
+		// the image is made of slices, so every timestep of this slice is one whole plane
+		for( size_t t = 0; t < m_timesteps; t++, dst += m_plane ) {
+			const data::Chunk ch = m_image.getChunk( 0, 0, z, t, false );
+			memcpy( dst, &ch.voxel<VShort>( 0 ), m_plane * sizeof( VShort ) );
+		}
+	}
+};
+}
+
 
 void
 ImageFormat_Vista::write( const data::Image &image,
@@ -82,18 +291,15 @@ throw( std::runtime_error & )
 		acquisitionTimeList.sort();
 		float sliceTimeOffset = acquisitionTimeList.front();
 
-		for( int z = 0; z < dims[2]; z++ ) {
+		const size_t plane = dims[0] * dims[1];
+
+		for( int z = 0; z < dims[2]; z++ )
 			vimages[z] = VCreateImage( dims[3], dims[1], dims[0], VShortRepn );
 
-			for( int x = 0; x < dims[0]; x++ ) {
-				for( int y = 0; y < dims[1]; y++ ) {
-					for( int t = 0; t < dims[3]; t++ ) {
-						VPixel( vimages[z], t, y, x, VShort )
-						= shortImage.voxel<VShort>( x, y, z, t );
-					}
-				}
-			}
+		// the slices are copied in parallel, the headers (which go into libvista lists) are done afterwards
+		util::ThreadPool::get().parallel_for( 0, dims[2], _internal::ImageToSlice( shortImage, vimages, plane, dims[3] ) );
 
+		for( int z = 0; z < dims[2]; z++ ) {
 			copyHeaderToVista( shortImage, vimages[z], sliceTimeOffset, true, z );
 			VAppendAttr( attrList, "image", NULL, VImageRepn, vimages[z] );
 		}
@@ -210,27 +416,203 @@ throw( std::runtime_error & )
 int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &filename,
 							 const std::string &dialect ) throw ( std::runtime_error & )
 {
-	// open input file
-	FILE *ip;
-	std::string myDialect = dialect;
+	// map the input file
+	VistaData src;
+	src.length = boost::filesystem::file_size( filename );
+	const int mfile = open( filename.c_str(), O_RDONLY );
 
-	if( !( ip = fopen( filename.c_str(), "r" ) ) ) {
-		std::string s;
-		s = "Error opening file " + filename + "for reading.";
-		throwGenericError( s );
+	if( mfile == -1 ) {
+		throwSystemError( errno, "Error opening file " + filename + " for reading." );
 	}
 
-	VAttrList list;
-	VAttrListPosn hposn;
-	VImage *images;
-	// number of images (images loaded into a VistaChunk)
-	unsigned nimages = 0;
+	// map privately, so changes to the chunks don't go into the file
+	void *mmem = mmap( NULL, src.length, PROT_READ | PROT_WRITE, MAP_PRIVATE, mfile, 0 );
+	const int err = errno;
+	close( mfile ); // the mapping stays valid
+
+	if( mmem == MAP_FAILED ) {
+		throwSystemError( err, "Error mapping file " + filename + " into memory." );
+	}
+
+	src.base = static_cast<uint8_t *>( mmem );
+	src.keep.reset( mmem, _internal::UnMap( src.length ) );
+	return readData( chunks, src, filename, dialect );
+}
+
+int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src,
+							 const std::string &filename, const std::string &dialect ) throw ( std::runtime_error & )
+{
+	// use the memory directly, but don't change it (it belongs to the proxy plugin)
+	VistaData data;
+	data.base = const_cast<uint8_t *>( &src[0] );
+	data.length = src.getLength();
+	data.keep = src.getRawAddress().lock();
+	return readData( chunks, data, filename, dialect );
+}
+
+const char *ImageFormat_Vista::VistaImage::getAttribute( const char *name )const
+{
+	BOOST_FOREACH( const Attribute & attr, attributes ) {
+		if( attr.name == name )
+			return attr.value.c_str();
+	}
+	return NULL;
+}
+
+void ImageFormat_Vista::setAttribute( util::PropertyMap &map, const util::istring &name, const VistaAttribute &attr )
+{
+	const char *const val = attr.value.c_str();
+	char *end;
+
+	if( !attr.quoted && !attr.value.empty() ) {
+		errno = 0;
+		const long ival = strtol( val, &end, 10 );
+
+		if( *end == '\0' && errno == 0 && ival >= std::numeric_limits<int32_t>::min() && ival <= std::numeric_limits<int32_t>::max() ) {
+			map.setPropertyAs<int32_t>( name, ival );
+			return;
+		}
+
+		const double dval = strtod( val, &end );
+
+		if( *end == '\0' ) {
+			map.setPropertyAs<double>( name, dval );
+			return;
+		}
+	}
+
+	map.setPropertyAs<std::string>( name, attr.value );
+}
+
+ImageFormat_Vista::VistaAttribute ImageFormat_Vista::parseHeader( const char *&at, const char *end )
+{
+	static const char signature[] = "V-data";
+
+	if( end - at < ( ptrdiff_t )sizeof( signature ) || strncmp( at, signature, sizeof( signature ) - 1 ) != 0 )
+		throwGenericError( "Not a vista file" );
+
+	at += sizeof( signature ) - 1;
+	VistaAttribute ret;
+	ret.isList = true;
+	_internal::skipSpace( at, end );
+	_internal::readWord( at, end ); // version
+
+	if( !_internal::readList( at, end, ret.children ) )
+		throwGenericError( "Failed to parse the vista header" );
+
+	// the binary data starts after the "\f\n" following the header
+	while( at < end && *at != '\f' )
+		at++;
+
+	if( at < end && *( ++at ) == '\n' )
+		at++;
+
+	return ret;
+}
+
+ImageFormat_Vista::VistaImage ImageFormat_Vista::makeImage( const VistaAttribute &object )
+{
+	VistaImage ret;
+	ret.nbands = ret.nrows = ret.ncolumns = 1;
+	ret.data = ret.length = 0;
+	BOOST_FOREACH( const VistaAttribute & attr, object.children ) {
+		if( attr.isList ) // nested attribute lists are ignored
+			continue;
+
+		const std::string &name = attr.name;
+
+		if( name == "repn" )
+			ret.repn = attr.value;
+		else if( name == "nbands" )
+			ret.nbands = strtoul( attr.value.c_str(), NULL, 10 );
+		else if( name == "nrows" )
+			ret.nrows = strtoul( attr.value.c_str(), NULL, 10 );
+		else if( name == "ncolumns" )
+			ret.ncolumns = strtoul( attr.value.c_str(), NULL, 10 );
+		else if( name == "data" )
+			ret.data = strtoul( attr.value.c_str(), NULL, 10 );
+		else if( name == "length" )
+			ret.length = strtoul( attr.value.c_str(), NULL, 10 );
+		else if( name != "nframes" && name != "nviewpoints" && name != "ncolors" && name != "ncomponents" ) // libvista drops these as well
+			ret.attributes.push_back( attr );
+	}
+	return ret;
+}
+
+template<typename TYPE> TYPE *ImageFormat_Vista::getVoxels( const VistaImage &image, const VistaData &src, boost::shared_ptr<void> &keep )
+{
+	const size_t voxels = image.nbands * image.nrows * image.ncolumns;
+	const uint8_t *at = src.base + image.data;
+
+	if( image.repn == "bit" ) { // bits are packed (most significant bit first) - so they always have to be unpacked
+		if( image.data + ( voxels + 7 ) / 8 > src.length )
+			throwGenericError( "Voxel data of the image exceeds the file" );
+
+		TYPE *ret = static_cast<TYPE *>( malloc( voxels * sizeof( TYPE ) ) );
+		keep.reset( ret, free );
+
+		for( size_t i = 0; i < voxels; i++ )
+			ret[i] = ( at[i / 8] >> ( 7 - i % 8 ) ) & 1;
+
+		return ret;
+	}
+
+	if( image.data + voxels * sizeof( TYPE ) > src.length || image.length < voxels * sizeof( TYPE ) )
+		throwGenericError( "Voxel data of the image exceeds the file" );
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	const bool swap = sizeof( TYPE ) > 1;
+#else
+	const bool swap = false;
+#endif
+	TYPE *ret;
+
+	// data which have to be swapped are always copied (and swapped while copying)
+	// swapping them in place would write to every page of the private mapping, which makes the kernel copy each of them anyway
+	if( swap || reinterpret_cast<size_t>( at ) % sizeof( TYPE ) ) {
+		LOG( Debug, info ) << ( swap ? "Swapping " : "Copying " ) << voxels * sizeof( TYPE ) << " bytes of voxel data";
+		ret = static_cast<TYPE *>( malloc( voxels * sizeof( TYPE ) ) );
+
+		if( !ret )
+			throwGenericError( "Failed to allocate memory for the voxel data" );
+
+		keep.reset( ret, free );
+
+		if( swap )
+			_internal::swapCopy( ret, at, voxels );
+		else
+			memcpy( ret, at, voxels * sizeof( TYPE ) );
+	} else {
+		ret = reinterpret_cast<TYPE *>( const_cast<uint8_t *>( at ) );
+		keep = src.keep;
+	}
+
+	return ret;
+}
+
+int ImageFormat_Vista::readData( std::list<data::Chunk> &chunks, const VistaData &src, const std::string &filename, const std::string &dialect )
+{
+	std::string myDialect = dialect;
+	const char *at = reinterpret_cast<const char *>( src.base );
+	const VistaAttribute header = parseHeader( at, at + src.length );
+	// the data offsets in the header are relative to the end of the header
+	VistaData data = src;
+	data.base = reinterpret_cast<uint8_t *>( const_cast<char *>( at ) );
+	data.length = src.length - ( data.base - src.base );
+	std::vector<VistaImage> images;
 	// number of VistaChunks loaded. Since every VImage is saved into a VistaChunk
 	// nloaded gives the number of slices loaded so far.
 	unsigned nloaded = 0;
 
-	// read images from file stream
-	if( ( nimages = VReadImages( ip, &list, &images ) ) == 0 ) {
+	BOOST_FOREACH( const VistaAttribute & object, header.children ) {
+		if( object.isList && object.value == "image" )
+			images.push_back( makeImage( object ) );
+	}
+
+	// number of images (images loaded into a VistaChunk)
+	const unsigned nimages = images.size();
+
+	if( nimages == 0 ) {
 		std::string s = "Error reading images from file " + filename;
 		throwGenericError( s );
 	}
@@ -244,21 +626,18 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 	// Create an empty PropertyMap to store vista history related properties.
 	// This map should be appended to every chunk in the output.
 	util::PropertyMap hMap;
-	VAttrList hist_list = VReadHistory( &list );
-
-	if ( hist_list != NULL ) {
-		unsigned int hcount = 0;
-		VPointer val;
-
-		for( VFirstAttr( hist_list, &hposn ); VAttrExists( &hposn ); VNextAttr( &hposn ) ) {
-			// The vista file history will be saved in the Vista/HistoryLineXX elements
-			// with XX as the index of the corresponding entry in the vista history list.
-			if( VGetAttrValue( &hposn, NULL, VStringRepn, &val ) ) {
-				const VString attrName = VGetAttrName( &hposn );
-				std::stringstream key, value;
-				key << histPrefix << ++hcount;
-				value << attrName << ":" << std::string( ( VString ) val );
-				hMap.setPropertyAs<std::string>( util::istring( key.str().c_str() ), value.str() );
+	BOOST_FOREACH( const VistaAttribute & object, header.children ) {
+		if( object.isList && object.name == "history" && object.value.empty() ) {
+			unsigned int hcount = 0;
+			BOOST_FOREACH( const VistaAttribute & attr, object.children ) {
+				// The vista file history will be saved in the Vista/HistoryLineXX elements
+				// with XX as the index of the corresponding entry in the vista history list.
+				if( !attr.isList ) {
+					std::stringstream key, value;
+					key << histPrefix << ++hcount;
+					value << attr.name << ":" << attr.value;
+					hMap.setPropertyAs<std::string>( util::istring( key.str().c_str() ), value.str() );
+				}
 			}
 		}
 	}
@@ -277,7 +656,7 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 	 */
 	//if we have a vista image with functional data and one or more anatomical scans, we
 	//can not reject the anatomical images. So we store them in a vector and handle them later.
-	std::vector<VImage> residualVImages;
+	std::vector<const VistaImage *> residualVImages;
 
 	if( myDialect.empty() ) {
 		if( nimages > 1 ) {
@@ -291,21 +670,14 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 			//if we have more than 1 short image with the same voxelsize, columnsize and rowsize
 			//we assume a functional image
 			for ( size_t k = 0; k < nimages; k++ ) {
-				if( VPixelRepn( images[k] ) == VShortRepn ) {
+				if( images[k].repn == "short" ) {
 					nShortRepn++;
-					columnsSet.insert( VImageNColumns( images[k] ) );
-					rowsSet.insert( VImageNRows( images[k] ) );
-					VAttrList attributes = VImageAttrList( images[k] );
-					VAttrListPosn posn;
-
-					for( VFirstAttr( attributes, &posn ); VAttrExists( &posn ); VNextAttr( &posn ) ) {
-						const char *name = VGetAttrName( &posn );
-						VPointer val;
-
-						if( strcmp( name, "voxel" ) == 0 ) {
-							VGetAttrValue( &posn, NULL, VStringRepn, &val );
-							voxelSet.insert( std::string( ( char * )val ) );
-						}
+					columnsSet.insert( images[k].ncolumns );
+					rowsSet.insert( images[k].nrows );
+					const char *voxel = images[k].getAttribute( "voxel" );
+
+					if( voxel ) {
+						voxelSet.insert( voxel );
 					}
 				} else {
 					nOtherRepn++;
@@ -319,7 +691,7 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 				LOG( isis::DataDebug, info ) << "Autodetect Dialect: Multiple images found. Assuming a set of anatomical images";
 			}
 		} else {
-			if( VPixelRepn( images[0] ) == VFloatRepn ) {
+			if( images[0].repn == "float" ) {
 				LOG( isis::DataDebug, info ) << "Autodetect Dialect: VFloat image found. Assuming a statistical vista image";
 				myDialect = "map";
 			} else {
@@ -328,23 +700,23 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 		}
 	}
 
-	// FUNCTIONAL -> copy every subimage into one chunk, splice the chunk
-	// along the z-direction -> add all resulting chunks to the chunk list.
+	// FUNCTIONAL -> make a chunk of every subimage, copy them into one 4D chunk
+	// (or splice them along the time-direction) -> add the result to the chunk list.
 	if( myDialect == std::string( "functional" ) ) {
 		char orient[100], voxelstr[100];
 		orient[0] = '\0';
 		voxelstr[0] = '\0';
 		util::FixedVector<float, 3> v3;
-		VPointer val;
+		const char *val;
 		// index origin
 		util::fvector4 indexOrigin;
 		// traverse images and collect all VShort images.
-		std::vector<VImage> vImageVector;
+		std::vector<const VistaImage *> vImageVector;
 
 		for( unsigned int k = 0; k < nimages; k++ ) {
-			if( VPixelRepn( images[k] ) != VShortRepn ) {
-				residualVImages.push_back( images[k] );
-			} else vImageVector.push_back( images[k] );
+			if( images[k].repn != "short" ) {
+				residualVImages.push_back( &images[k] );
+			} else vImageVector.push_back( &images[k] );
 		}
 
 		std::list<VistaChunk<VShort> > vistaChunkList;
@@ -355,16 +727,16 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 		util::ivector4 dims( 0, 0, 0, 0 );
 
 		if( vImageVector.size() > 0 ) {
-			dims[0] = VImageNColumns( vImageVector.back() );
-			dims[1] = VImageNRows( vImageVector.back() );
+			dims[0] = vImageVector.back()->ncolumns;
+			dims[1] = vImageVector.back()->nrows;
 			dims[2] = vImageVector.size();
-			dims[3] = VImageNBands( vImageVector.back() );
+			dims[3] = vImageVector.back()->nbands;
 		}
 
 		std::set<util::fvector4, data::_internal::SortedChunkList::posCompare> originCheckSet;
 		//first we have to create a vista chunkList so we can get the number of slices
-		BOOST_FOREACH( std::vector<VImage>::reference sliceRef, vImageVector ) {
-			VistaChunk<VShort> vchunk( sliceRef, true );
+		BOOST_FOREACH( const VistaImage * sliceRef, vImageVector ) {
+			VistaChunk<VShort> vchunk = makeChunk<VShort>( *sliceRef, data, true );
 			vistaChunkList.push_back( vchunk );
 
 			if( vchunk.hasProperty( "indexOrigin" ) ) {
@@ -383,17 +755,12 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 		BOOST_FOREACH( std::vector<VistaChunk<VShort> >::reference sliceRef, vistaChunkList ) {
 			// increase slice counter
 			nloaded++;
-			uint16_t repetitionTime = 0;
 			util::fvector4 ioprob;
 
 			if( !sliceRef.hasProperty( "repetitionTime" ) && biggest_slice_time ) {
 				sliceRef.setPropertyAs<uint16_t>( "repetitionTime", biggest_slice_time );
 			}
 
-			if( sliceRef.hasProperty( "repetitionTime" ) ) {
-				repetitionTime = sliceRef.getPropertyAs<uint16_t>( "repetitionTime" );
-			}
-
 			// since functional data will be read first the sequence number
 			// is 0.
 			sliceRef.setPropertyAs<uint16_t>( "sequenceNumber", 0 );
@@ -414,19 +781,10 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 				// and voxel resolution. All chunks in the list splices are supposed
 				// to have the same index origin since they are from the same slice.
 				// get slice orientation of image
-				VAttrList attributes = VImageAttrList( vImageVector[nloaded - 1] );
-				VAttrListPosn posn;
-				val = NULL;
+				const VistaImage &vImage = *vImageVector[nloaded - 1];
 
 				// Get orientation information
-				for ( VFirstAttr( attributes, &posn ); VAttrExists( &posn ); VNextAttr( &posn ) ) {
-					const VString name = VGetAttrName( &posn );
-
-					if( strcmp( name, "orientation" ) == 0 ) {
-						VGetAttrValue( &posn, NULL, VStringRepn, &val );
-						break;
-					}
-				}
+				val = vImage.getAttribute( "orientation" );
 
 				// unusual error: there is no 'orientation' information in the vista image.
 				if( val == NULL ) {
@@ -436,24 +794,15 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 				// compare new orientation with old. Just to make sure that all subimages
 				// have the same slice orientation.
 				if( orient[0] == '\0' ) {
-					strcpy( orient, ( char * )val );
+					strcpy( orient, val );
 				} else {
 					// orientation string differs from previous value;
-					if( strcmp( orient, ( char * )val ) != 0 )
+					if( strcmp( orient, val ) != 0 )
 						throwGenericError( "Inconsistent orienation information in functional data." );
 				}
 
 				// get voxel resolution
-				val = NULL;
-
-				for ( VFirstAttr( attributes, &posn ); VAttrExists( &posn ); VNextAttr( &posn ) ) {
-					const VString name = VGetAttrName( &posn );
-
-					if( strcmp( name, "voxel" ) == 0 ) {
-						VGetAttrValue( &posn, NULL, VStringRepn, &val );
-						break;
-					}
-				}
+				val = vImage.getAttribute( "voxel" );
 
 				// unusual error: there is no 'voxel' information in the vista image.
 				if( val == NULL )
@@ -462,12 +811,12 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 				// compare new voxel resolution with old. Just to make sure that all subimages
 				// have the same slice voxel resolution.
 				if( voxelstr[0] == '\0' ) {
-					strcpy( voxelstr, ( char * )val );
+					strcpy( voxelstr, val );
 					std::list<float> buff = util::stringToList<float>( std::string( voxelstr ), ' ' );
 					v3.copyFrom( buff.begin(), buff.end() );
 				} else {
 					// voxel string differs from previous value;
-					if( strcmp( voxelstr, ( char * )val ) != 0 )
+					if( strcmp( voxelstr, val ) != 0 )
 						throwGenericError( "Inconsistent voxel information in functional data." );
 				}
 
@@ -502,39 +851,64 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 				}
 			}
 
-			// Set indexOrigin. This should be done before splicing.
+			// Set indexOrigin. This should be done before assembling the volume.
 			sliceRef.setPropertyAs<util::fvector4>( "indexOrigin", ioprob );
-			/********************* SPLICE VistaChunk *********************
-			 * With functional data the VistaChunk has the dimensions
-			 * columns x rows x 1 x time. We splice the Chunk along the
-			 * time axise to get time * (column x row x 1 x 1) chunks.
-			 */
-			// splice VistaChunk
-			std::list<data::Chunk> splices = sliceRef.splice( data::sliceDim );
-			/******************** SET acquisitionTime ********************/
-			size_t timestep = 0;
-			BOOST_FOREACH( data::Chunk & spliceRef, splices ) {
-				uint32_t acqusitionNumber = ( nloaded - 1 ) + vImageVector.size() * timestep;
-				spliceRef.setPropertyAs<uint32_t>( "acquisitionNumber", acqusitionNumber );
-
-				if ( repetitionTime && sliceRef.hasProperty( "acquisitionTime" ) ) {
-					float acquisitionTimeSplice = sliceRef.getPropertyAs<float>( "acquisitionTime" ) + ( repetitionTime * timestep );
-					spliceRef.setPropertyAs<float>( "acquisitionTime", acquisitionTimeSplice );
+		} // END foreach vistaChunkList
+
+		/********************* ASSEMBLE the volume *********************
+		 * With functional data every VistaChunk has the dimensions
+		 * columns x rows x 1 x time. If the slices form a regular volume they are
+		 * copied into one columns x rows x slices x time chunk, so every volume is
+		 * contiguous in memory. Otherwise they are spliced along the time axis to
+		 * get time * (column x row x 1 x 1) chunks.
+		 */
+		std::vector<data::Chunk *> slices;
+		BOOST_FOREACH( VistaChunk<VShort> &sliceRef, vistaChunkList ) {
+			slices.push_back( &sliceRef );
+		}
+		std::stable_sort( slices.begin(), slices.end(), _internal::originLess() );
+
+		if( !slices.empty() && _internal::isRegularVolume( slices, dims ) ) {
+			chunks.push_back( makeVolume( slices, dims ) );
+			chunks.back().join( hMap, true );
+		} else {
+			LOG_IF( !slices.empty(), Runtime, info ) << "The slices of the functional data don't form a regular volume, splicing them into single slices";
+			size_t slice = 0;
+			BOOST_FOREACH( VistaChunk<VShort> &sliceRef, vistaChunkList ) {
+				uint16_t repetitionTime = 0;
+
+				if( sliceRef.hasProperty( "repetitionTime" ) ) {
+					repetitionTime = sliceRef.getPropertyAs<uint16_t>( "repetitionTime" );
 				}
 
-				// add history information
-				spliceRef.join( hMap, true );
-				timestep++;
+				// splice VistaChunk
+				std::list<data::Chunk> splices = sliceRef.splice( data::sliceDim );
+				/******************** SET acquisitionTime ********************/
+				size_t timestep = 0;
+				BOOST_FOREACH( data::Chunk & spliceRef, splices ) {
+					uint32_t acqusitionNumber = slice + vImageVector.size() * timestep;
+					spliceRef.setPropertyAs<uint32_t>( "acquisitionNumber", acqusitionNumber );
+
+					if ( repetitionTime && sliceRef.hasProperty( "acquisitionTime" ) ) {
+						float acquisitionTimeSplice = sliceRef.getPropertyAs<float>( "acquisitionTime" ) + ( repetitionTime * timestep );
+						spliceRef.setPropertyAs<float>( "acquisitionTime", acquisitionTimeSplice );
+					}
+
+					// add history information
+					spliceRef.join( hMap, true );
+					timestep++;
+				}
+				LOG( DataLog, verbose_info ) << "adding " << splices.size() << " chunks to the output";
+				/******************** add chunks to output ********************/
+				chunks.splice( chunks.end(), splices );
+				slice++;
 			}
-			LOG( DataLog, verbose_info ) << "adding " << splices.size() << " chunks to the output";
-			/******************** add chunks to output ********************/
-			std::back_insert_iterator<std::list<data::Chunk> > dest_iter ( chunks );
-			std::copy( splices.begin(), splices.end(), dest_iter );
-		} // END foreach vistaChunkList
+		}
+
 		//handle the residual images
 		uint16_t sequenceNumber = 0;
-		BOOST_FOREACH( std::vector<VImage>::reference vImageRef, residualVImages ) {
-			if( switchHandle( vImageRef, chunks ) ) {
+		BOOST_FOREACH( const VistaImage * vImageRef, residualVImages ) {
+			if( switchHandle( *vImageRef, data, chunks ) ) {
 				chunks.back().setPropertyAs<uint16_t>( "sequenceNumber", ++sequenceNumber );
 				// add history information
 				chunks.back().join( hMap, true );
@@ -552,12 +926,10 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 					<< "Multiple images found. Will use the first VFloat image I can find.";
 		}
 
-		// have a look for the first float image -> destroy the other images
+		// have a look for the first float image -> ignore the other images
 		for( unsigned k = 0; k < nimages; k++ ) {
-			if( ( VPixelRepn( images[k] ) != VFloatRepn ) || ( nloaded > 0 ) )
-				VDestroyImage( images[k] );
-			else {
-				addChunk<VFloat>( chunks, images[k] );
+			if( ( images[k].repn == "float" ) && ( nloaded == 0 ) ) {
+				addChunk<VFloat>( chunks, images[k], data );
 
 				// check indexOrigin -> calculate default value if necessary
 				if ( ! chunks.back().hasProperty( "indexOrigin" ) ) {
@@ -576,7 +948,7 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 	// the corresponding data type.
 	else {
 		for( unsigned k = 0; k < nimages; k++ ) {
-			if( switchHandle( images[k], chunks ) ) {
+			if( switchHandle( images[k], data, chunks ) ) {
 				chunks.back().setPropertyAs<uint16_t>( "sequenceNumber", nloaded );
 
 				// check indexOrigin -> calculate default value if necessary
@@ -593,9 +965,6 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 		}
 	} // END else
 
-	//  cleanup, close file handle
-	fclose( ip );
-
 	// ERROR: throw exception if there is no new chunk in the list
 	if( !nloaded )
 		throwGenericError ( "No images loaded" );
@@ -604,45 +973,33 @@ int ImageFormat_Vista::load( std::list<data::Chunk> &chunks, const std::string &
 	return nloaded;
 }
 
-bool ImageFormat_Vista::switchHandle( VImage &image, std::list<data::Chunk> &chunks )
+bool ImageFormat_Vista::switchHandle( const VistaImage &image, const VistaData &src, std::list<data::Chunk> &chunks )
 {
-	switch( VPixelRepn( image ) ) {
-	case VBitRepn:
-		addChunk<vista_bitmask_type>( chunks, image );
+	if( image.repn == "bit" ) {
+		addChunk<vista_bitmask_type>( chunks, image, src );
 		return true;
-		break;
-	case VUByteRepn:
-		addChunk<VUByte>( chunks, image );
+	} else if( image.repn == "ubyte" ) {
+		addChunk<VUByte>( chunks, image, src );
 		return true;
-		break;
-	case VSByteRepn:
-		addChunk<VSByte>( chunks, image );
+	} else if( image.repn == "sbyte" ) {
+		addChunk<VSByte>( chunks, image, src );
 		return true;
-		break;
-	case VShortRepn:
-		addChunk<VShort>( chunks, image );
+	} else if( image.repn == "short" ) {
+		addChunk<VShort>( chunks, image, src );
 		return true;
-		break;
-#if defined(_M_X64) || defined(__amd64__)
-	case VLongRepn:
-		addChunk<VLong>( chunks, image );
+	} else if( image.repn == "long" ) { // vista stores long as 32bit
+		addChunk<int32_t>( chunks, image, src );
 		return true;
-		break;
-#endif
-	case VFloatRepn:
-		addChunk<VFloat>( chunks, image );
+	} else if( image.repn == "float" ) {
+		addChunk<VFloat>( chunks, image, src );
 		return true;
-		break;
-	case VDoubleRepn:
-		addChunk<VDouble>( chunks, image );
+	} else if( image.repn == "double" ) {
+		addChunk<VDouble>( chunks, image, src );
 		return true;
-		break;
-	default:
-		// discard images with unknown data type
-		VDestroyImage( image );
-		return false;
 	}
 
+	// discard images with unknown data type
+	LOG( Runtime, warning ) << "Ignoring image of unknown type " << util::MSubject( image.repn );
 	return false;
 }
 
@@ -741,7 +1098,15 @@ void ImageFormat_Vista::copyHeaderToVista( const data::Image &image, VImage &vim
 
 		// Check if the current chunk encodes more than one slice. This
 		// is only valid if there is more than one slice in the isis image.
-		if( image.getChunk( slice ).getSizeAsVector()[2] > 1 ) {
+		if( image.hasProperty( "Vista/sliceTimes" ) && image.getPropertyAs<util::dlist>( "Vista/sliceTimes" ).size() == image.getSizeAsVector()[2] ) {
+			// the slice times of a volume loaded from vista
+			util::dlist sliceTimes = image.getPropertyAs<util::dlist>( "Vista/sliceTimes" );
+			util::dlist::const_iterator stime = sliceTimes.begin();
+			std::advance( stime, slice );
+			std::stringstream sstream;
+			sstream << *stime - *std::min_element( sliceTimes.begin(), sliceTimes.end() );
+			VAppendAttr ( list, "slice_time", NULL, VStringRepn, sstream.str().c_str() );
+		} else if( image.getChunk( slice ).getSizeAsVector()[2] > 1 ) {
 			LOG( data::Runtime, error ) << "Chunk contains more than one slice."
 										<< "Interpolation of slice time is not possible.";
 		} else {
@@ -817,6 +1182,11 @@ void ImageFormat_Vista::copyHeaderToVista( const data::Image &image, VImage &vim
 				continue;
 			}
 
+			// the slice times are written as slice_time of the single images
+			if( *kiter == "sliceTimes" ) {
+				continue;
+			}
+
 			// get property value
 			util::PropertyValue pv = vista_branch.propertyValue( *kiter );
 			// VBit -> VBit (char *)
@@ -880,13 +1250,67 @@ void ImageFormat_Vista::copyHeaderToVista( const data::Image &image, VImage &vim
 							 pv->castTo<std::string>().c_str() );
 				continue;
 			}
+
+			// everything else (eg. int32_t attributes from other vista files) is written as string
+			if( !pv.isEmpty() ) {
+				VAppendAttr( list, ( *kiter ).c_str(), NULL, VStringRepn,
+							 pv->toString( false ).c_str() );
+			}
+		}
+	}
+}
+
+data::Chunk ImageFormat_Vista::makeVolume( const std::vector<data::Chunk *> &slices, const util::ivector4 &dims )
+{
+	const size_t nslices = slices.size(), plane = dims[0] * dims[1];
+	data::Chunk ret = slices.front()->cloneToNew( dims[0], dims[1], nslices, dims[3] );
+
+	// vista stores slice by slice (each holding all timesteps) - the volume is stored timestep by timestep
+	util::ThreadPool::get().parallel_for( 0, nslices, _internal::SliceToVolume( slices, &ret.voxel<VShort>( 0 ), plane, dims[3] ) );
+
+	ret.join( *slices.front() ); // cloneToNew doesn't copy the properties
+	ret.setPropertyAs<uint32_t>( "acquisitionNumber", 0 );
+
+	// keep the slice distance (data::Image can't compute it from a single chunk)
+	// vista has no gap information, so the slices come with a zero gap
+	if( nslices > 1 && ( !ret.hasProperty( "voxelGap" ) || ret.getPropertyAs<util::fvector4>( "voxelGap" )[2] == 0 ) ) {
+		const float sliceDist = ( slices[1]->getPropertyAs<util::fvector4>( "indexOrigin" ) - slices[0]->getPropertyAs<util::fvector4>( "indexOrigin" ) ).len();
+		const float gap = sliceDist - ret.getPropertyAs<util::fvector4>( "voxelSize" )[2];
+
+		if( gap > 0 )
+			ret.setPropertyAs<util::fvector4>( "voxelGap", util::fvector4( 0, 0, gap, 0 ) );
+	}
+
+	// the acquisition times of the slices can't be kept in the chunk - store them as list (in the order of the slices in the volume)
+	util::dlist sliceTimes;
+	BOOST_FOREACH( const data::Chunk * slice, slices ) {
+		if( !slice->hasProperty( "acquisitionTime" ) ) {
+			sliceTimes.clear();
+			break;
 		}
+
+		sliceTimes.push_back( slice->getPropertyAs<float>( "acquisitionTime" ) );
 	}
+
+	if( !sliceTimes.empty() ) {
+		ret.setPropertyAs<float>( "acquisitionTime", *std::min_element( sliceTimes.begin(), sliceTimes.end() ) );
+		ret.setPropertyAs<util::dlist>( "Vista/sliceTimes", sliceTimes );
+	}
+
+	LOG( DataLog, info ) << "Assembled " << nslices << " functional slices into a volume of size " << ret.getSizeAsString();
+	return ret;
+}
+
+template <typename TInput> ImageFormat_Vista::VistaChunk<TInput> ImageFormat_Vista::makeChunk( const VistaImage &image, const VistaData &src, bool functional )
+{
+	boost::shared_ptr<void> keep;
+	TInput *voxels = getVoxels<TInput>( image, src, keep );
+	return VistaChunk<TInput>( voxels, VistaDeleter( keep ), image, functional );
 }
 
-template <typename TInput> void ImageFormat_Vista::addChunk( std::list< isis::data::Chunk >& chunks, VImage image )
+template <typename TInput> void ImageFormat_Vista::addChunk( std::list< isis::data::Chunk >& chunks, const VistaImage &image, const VistaData &src )
 {
-	chunks.push_back( VistaChunk<TInput>( image, false ) );
+	chunks.push_back( makeChunk<TInput>( image, src, false ) );
 }
 
 template <typename T> bool ImageFormat_Vista::copyImageToVista( const data::Image &image, VImage &vimage )
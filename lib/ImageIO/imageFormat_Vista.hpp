@@ -68,6 +68,8 @@ public:
 	std::string dialects( const std::string &filename )const {return std::string( "functional map anatomical" );}
 	int load( std::list<data::Chunk> &chunks, const std::string &filename,
 			  const std::string &dialect ) throw( std::runtime_error & );
+	int load( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src, const std::string &filename,
+			  const std::string &dialect ) throw( std::runtime_error & );
 	void write( const data::Image &image, const std::string &filename,
 				const std::string &dialect ) throw( std::runtime_error & );
 
@@ -77,6 +79,24 @@ public:
 	ImageFormat_Vista() : FileFormat(),
 		histPrefix( "Vista/HistoryLine" ) {}
 
+	/**
+	 * An attribute list as read from the header of a vista file.
+	 * Nested attribute lists and objects are stored in children, with value being the type of the object.
+	 */
+	struct VistaAttribute {
+		std::string name, value;
+		std::list<VistaAttribute> children;
+		bool isList;
+		bool quoted; // the value was given as quoted string
+		VistaAttribute(): isList( false ), quoted( false ) {}
+	};
+
+	/**
+	 * Store a (non-list) attribute as property.
+	 * Unquoted integers are stored as int32_t, other unquoted numbers as double and everything else as string.
+	 */
+	static void setAttribute( util::PropertyMap &map, const util::istring &name, const VistaAttribute &attr );
+
 private:
 
 	/**
@@ -92,28 +112,38 @@ private:
 			: dateRegex( regex ), delimiter( d ) , first( f ), second( s ), third( t ) {}
 	};
 
-	template <typename TYPE> class VistaChunk : public data::Chunk
-	{
-
-	private:
+	/// an image as described in the header of a vista file
+	struct VistaImage {
+		typedef VistaAttribute Attribute;
+		std::string repn;
+		size_t nbands, nrows, ncolumns;
+		size_t data, length; // position of the voxel data (relative to the end of the header)
+		std::list<Attribute> attributes; // all other (non-list) attributes of the image in the order of the file
+		/// \returns the value of the attribute, or NULL if the image has no such attribute
+		const char *getAttribute( const char *name )const;
+	};
 
-		/**
-		 * The vista IO plugin maps VImage objects to isis::Chunks. The VImage
-		 * memory space must be freed afterwards.
-		 */
-		struct VImageDeleter {
+	/// memory holding a vista file (either a mapped file, or memory handed in by a proxy plugin)
+	struct VistaData {
+		uint8_t *base;
+		size_t length;
+		boost::shared_ptr<void> keep; // keeps base alive
+	};
 
-			VImage m_image;
+	/// deleter for chunks referencing VistaData (or memory allocated for them)
+	struct VistaDeleter {
+		boost::shared_ptr<void> m_mem;
+		VistaDeleter( const boost::shared_ptr<void> &mem ): m_mem( mem ) {}
+		void operator()( void *p ) {
+			LOG( Debug, verbose_info ) << "Releasing vista voxel data at " << p;
+			m_mem.reset();
+		}
+	};
 
-			VImageDeleter( VImage image ) {
-				m_image = image;
-			}
+	template <typename TYPE> class VistaChunk : public data::Chunk
+	{
 
-			void operator()( void *p ) {
-				LOG( Debug, info ) << "Freeing VImage pointer " << p;
-				VDestroyImage( m_image );
-			}
-		};
+	private:
 
 		/**
 		 * This function copies all metadata from Vista image header attributes to
@@ -121,22 +151,18 @@ private:
 		 * @param image The target chunk where all data will be copied to.
 		 * @param chunk The source image that provides the Vista metadata attributes.
 		 */
-		void copyHeaderFromVista( const VImage &image, data::Chunk &chunk, bool functional ) {
+		void copyHeaderFromVista( const VistaImage &image, data::Chunk &chunk, bool functional ) {
 			// traverse through attribute list and set metadata
-			VAttrList attributes = VImageAttrList( image );
-			VAttrListPosn posn;
 			LOG( DataLog, verbose_info ) << "copying Header from Vista";
 			std::string time, date;
 
-			for( VFirstAttr( attributes, &posn ); VAttrExists( &posn ); VNextAttr( &posn ) ) {
-				const char *name = VGetAttrName( &posn );
-				VPointer val;
+			BOOST_FOREACH( const VistaImage::Attribute & attr, image.attributes ) {
+				const char *name = attr.name.c_str(), *val = attr.value.c_str();
 
 				// MANDATORY: voxel --> voxelSize
 				// it's a vector with 3 elements
 				if( strcmp( name, "voxel" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					std::list<float> flist = util::stringToList<float>( std::string( ( char * )val ) );
+					std::list<float> flist = util::stringToList<float>( std::string( val ) );
 					std::list<float>::const_iterator iter = flist.begin();
 					float x = *iter++, y = *iter++, z = *iter;
 					chunk.setPropertyAs<util::fvector4>( "voxelSize", util::fvector4( x, y, z, 1 ) );
@@ -151,48 +177,47 @@ private:
 				// "orientation" in vista header. This should only be done if the vectors
 				// weren't defined otherwise.
 				if( ( strcmp( name, "orientation" ) == 0 ) && ( ! chunk.hasProperty( "rowVec" ) ) ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
 					//TODO remove "orientation" in Vista group
-					chunk.setPropertyAs<std::string>( propname, std::string( ( VString )val ) );
+					chunk.setPropertyAs<std::string>( propname, std::string( val ) );
 
 					if( functional ) {
 						// axial is the reference
-						if( strcmp( ( const char * )val, "axial" ) == 0 ) {
+						if( strcmp( val, "axial" ) == 0 ) {
 							chunk.setPropertyAs<util::fvector4>( "rowVec", util::fvector4( 1, 0, 0, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "columnVec", util::fvector4( 0, 1, 0, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "sliceVec", util::fvector4( 0, 0, 1, 0 ) );
 							continue;
 						}
 
-						if( strcmp( ( const char * )val, "sagittal" ) == 0 ) {
+						if( strcmp( val, "sagittal" ) == 0 ) {
 							chunk.setPropertyAs<util::fvector4>( "rowVec", util::fvector4( 0, 1, 0, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "columnVec", util::fvector4( 0, 0, 1, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "sliceVec", util::fvector4( 1, 0, 0, 0 ) );
 							continue;
 						}
 
-						if( strcmp( ( const char * )val, "coronal" ) == 0 ) {
+						if( strcmp( val, "coronal" ) == 0 ) {
 							chunk.setPropertyAs<util::fvector4>( "rowVec", util::fvector4( 1, 0, 0, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "columnVec", util::fvector4( 0, 0, 1, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "sliceVec", util::fvector4( 0, -1, 0, 0 ) );
 							continue;
 						}
 					} else {
-						if( strcmp( ( const char * )val, "axial" ) == 0 ) {
+						if( strcmp( val, "axial" ) == 0 ) {
 							chunk.setPropertyAs<util::fvector4>( "rowVec", util::fvector4( -1, 0, 0, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "columnVec", util::fvector4( 0, 1, 0, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "sliceVec", util::fvector4( 0, 0, -1, 0 ) );
 							continue;
 						}
 
-						if( strcmp( ( const char * )val, "sagittal" ) == 0 ) {
+						if( strcmp( val, "sagittal" ) == 0 ) {
 							chunk.setPropertyAs<util::fvector4>( "rowVec", util::fvector4( 0, 1, 0, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "columnVec", util::fvector4( 0, 0, 1, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "sliceVec", util::fvector4( 1, 0, 0, 0 ) );
 							continue;
 						}
 
-						if( strcmp( ( const char * )val, "coronal" ) == 0 ) {
+						if( strcmp( val, "coronal" ) == 0 ) {
 							chunk.setPropertyAs<util::fvector4>( "rowVec", util::fvector4( 1, 0, 0, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "columnVec", util::fvector4( 0, 0, 1, 0 ) );
 							chunk.setPropertyAs<util::fvector4>( "sliceVec", util::fvector4( 0, -1, 0, 0 ) );
@@ -203,8 +228,7 @@ private:
 
 				// OPTIONAL: "repetition_time" or "repetition" -> repetitionTime
 				if( ( strcmp ( name, "repetition" ) == 0 ) || ( strcmp( name, "repetition_time" ) == 0 ) ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					std::string repTime = std::string( VString( val ) );
+					std::string repTime = std::string( val );
 
 					if ( static_cast<signed int>( repTime.find( "." ) ) != -1 ) {
 						repTime.erase( repTime.begin() + repTime.find( "." ), repTime.end() );
@@ -218,8 +242,7 @@ private:
 				}
 
 				if ( strcmp ( name , "slice_time" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					std::string slice_time = std::string( VString ( val ) );
+					std::string slice_time = std::string( val );
 					std::stringstream sstr( slice_time );
 					float sliceTimeFloat;
 					sstr >> sliceTimeFloat;
@@ -228,18 +251,17 @@ private:
 				}
 
 				if ( strcmp ( name, "sex" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
 					util::Selection genderSelection( "female,male,other" );
 
-					if ( std::string( ( VString ) val ) == "female" ) {
+					if ( std::string( val ) == "female" ) {
 						genderSelection.set( "female" );
 					}
 
-					if ( std::string( ( VString ) val ) == std::string( "male" ) ) {
+					if ( std::string( val ) == std::string( "male" ) ) {
 						genderSelection.set( "male" );
 					}
 
-					if ( std::string( ( VString ) val ) == "other" ) {
+					if ( std::string( val ) == "other" ) {
 						genderSelection.set( "other" );
 					}
 
@@ -248,8 +270,7 @@ private:
 				}
 
 				if ( strcmp ( name, "patient" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					std::string subjectName = std::string ( ( VString ) val );
+					std::string subjectName = std::string ( val );
 					subjectName.resize( 4 );
 					chunk.setPropertyAs<std::string>( "subjectName", subjectName );
 					continue;
@@ -258,8 +279,7 @@ private:
 				// OPTIONAL: columnVec -> rowVec, overwrite old values
 				if( strcmp( name, "columnVec" ) == 0 ) {
 					util::fvector4 rowVec;
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					const std::list<float> tokens = util::stringToList<float>( std::string( ( const char * )val ), ' ' );
+					const std::list<float> tokens = util::stringToList<float>( std::string( val ), ' ' );
 					rowVec.copyFrom<std::list<float>::const_iterator>( tokens.begin(), tokens.end() );
 					chunk.setPropertyAs<util::fvector4>( "rowVec", rowVec );
 					continue;
@@ -268,8 +288,7 @@ private:
 				// OPTIONAL: rowVec -> columnVec, overwrite old values
 				if( strcmp( name, "rowVec" ) == 0 ) {
 					util::fvector4 columnVec;
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					const std::list<float> tokens = util::stringToList<float>( std::string( ( const char * )val ), ' ' );
+					const std::list<float> tokens = util::stringToList<float>( std::string( val ), ' ' );
 					columnVec.copyFrom<std::list<float>::const_iterator>( tokens.begin(), tokens.end() );
 					chunk.setPropertyAs<util::fvector4>( "columnVec", columnVec );
 					continue;
@@ -278,8 +297,7 @@ private:
 				// OPTIONAL: sliceVec -> sliceVec, overwrite old values
 				if( strcmp( name, "sliceVec" ) == 0 ) {
 					util::fvector4 sliceVec;
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					const std::list<float> tokens = util::stringToList<float>( std::string( ( const char * )val ), ' ' );
+					const std::list<float> tokens = util::stringToList<float>( std::string( val ), ' ' );
 					sliceVec.copyFrom<std::list<float>::const_iterator>( tokens.begin(), tokens.end() );
 					chunk.setPropertyAs<util::fvector4>( "sliceVec", sliceVec );
 					continue;
@@ -287,8 +305,7 @@ private:
 
 				// OPTIONAL: indexOrigin -> indexOrigin
 				if( strcmp( name, "indexOrigin" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					std::list<float> flist = util::stringToList<float>( std::string( ( char * )val ) );
+					std::list<float> flist = util::stringToList<float>( std::string( val ) );
 					std::list<float>::const_iterator iter = flist.begin();
 					float x = *iter++, y = *iter++, z = *iter;
 					chunk.setPropertyAs<util::fvector4>( "indexOrigin", util::fvector4( x, y, z, 0 ) );
@@ -296,20 +313,17 @@ private:
 				}
 
 				if( strcmp( name, "date" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					date = std::string( ( VString ) val );
+					date = std::string( val );
 					continue;
 				}
 
 				if( strcmp( name, "time" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					time = std::string( ( VString ) val );
+					time = std::string( val );
 					continue;
 				}
 
 				if( strcmp( name, "echoTime" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					std::string echoTimeStr = std::string( VString ( val ) );
+					std::string echoTimeStr = std::string( val );
 					std::stringstream sstr( echoTimeStr );
 					float echoTime;
 					sstr >> echoTime;
@@ -318,8 +332,7 @@ private:
 				}
 
 				if( strcmp( name, "flipAngle" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					std::string flipAngleStr = std::string( VString ( val ) );
+					std::string flipAngleStr = std::string( val );
 					std::stringstream sstr( flipAngleStr );
 					uint16_t flipAngle;
 					sstr >> flipAngle;
@@ -328,15 +341,15 @@ private:
 				}
 
 				if( strcmp( name, "transmitCoil" ) == 0 ) {
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					chunk.setPropertyAs<std::string>( "transmitCoil", std::string( ( VString )val ) );
+					chunk.setPropertyAs<std::string>( "transmitCoil", std::string( val ) );
 					continue;
 				}
 
 				// read the age in years (vista) and save it in PatientAge in days (isis)
 				if( strcmp( name, "age" ) == 0 ) {
+					std::stringstream sstr( val );
 					uint16_t age;
-					VGetAttrValue( &posn, NULL, VShortRepn, &age );
+					sstr >> age;
 					// rounding: floor or ceil
 					age = ( ( age * 365.2425 ) - floor( age * 365.2425 ) ) < 0.5 ?
 						  floor( age * 365.2425 ) : ceil( age * 365.2425 );
@@ -344,36 +357,8 @@ private:
 					continue;
 				}
 
-				// traverse through attributes
-				switch( VGetAttrRepn( &posn ) ) {
-				case VBitRepn:
-					VGetAttrValue( &posn, NULL, VBitRepn, val );
-					break;
-				case VUByteRepn:
-					VGetAttrValue( &posn, NULL, VUByteRepn, val );
-					break;
-				case VSByteRepn:
-					VGetAttrValue( &posn, NULL, VSByteRepn, val );
-					break;
-				case VShortRepn:
-					VGetAttrValue( &posn, NULL, VShortRepn, val );
-					break;
-				case VLongRepn:
-					VGetAttrValue( &posn, NULL, VLongRepn, val );
-					break;
-				case VFloatRepn:
-					VGetAttrValue( &posn, NULL, VFloatRepn, val );
-					break;
-				case VDoubleRepn:
-					VGetAttrValue( &posn, NULL, VDoubleRepn, val );
-					break;
-				case VStringRepn:
-					VGetAttrValue( &posn, NULL, VStringRepn, &val );
-					chunk.setPropertyAs<std::string>( propname, std::string( ( VString )val ) );
-					break;
-				default:
-					std::cout << "unknown attribute representation found" << std::endl;
-				}
+				// all other attributes are stored as they are
+				setAttribute( chunk, propname, attr );
 			} // END iterate over attributes
 
 			// AFTERMATH
@@ -463,15 +448,46 @@ private:
 		 * Default constructor. Create a VistaChunk out of a vista image.
 		 */
 
-		VistaChunk( VImage image, const bool functional, size_t nslices = 0 ):
-			data::Chunk( static_cast<TYPE *>( image->data ), VImageDeleter( image ),
-						 VImageNColumns( image ), VImageNRows( image ), functional ? 1 : VImageNBands( image ), functional ? VImageNBands( image ) : 1 ) {
+		VistaChunk( TYPE *data, const VistaDeleter &del, const VistaImage &image, const bool functional ):
+			data::Chunk( data, del, image.ncolumns, image.nrows, functional ? 1 : image.nbands, functional ? image.nbands : 1 ) {
 			copyHeaderFromVista( image, *this, functional );
 		}
 	};
 
+	/**
+	 * Read all images from a vista file in memory into the chunk list.
+	 * This is used for loading from files (which are mapped) as well as from memory.
+	 * The chunks use the voxel data in the memory directly if possible.
+	 * @param filename the name of the source (only used for messages)
+	 */
+	int readData( std::list<data::Chunk> &chunks, const VistaData &src, const std::string &filename, const std::string &dialect );
+
+	/**
+	 * Parse the ascii header of a vista file.
+	 * @param at the beginning of the file, will be set to the beginning of the binary data
+	 * @param end the end of the file
+	 * @returns the top level attribute list of the file
+	 */
+	static VistaAttribute parseHeader( const char *&at, const char *end );
+	/// make a VistaImage out of an image object from the header
+	static VistaImage makeImage( const VistaAttribute &object );
+
+	/**
+	 * Get the voxel data of an image as TYPE.
+	 * Vista stores the data in big endian. The data is used directly from src if possible.
+	 * It is copied if its not aligned for TYPE, or if it has to be swapped (which is the case for all but byte data on little endian machines).
+	 * @param keep will be set to whatever has to be kept alive for the returned data
+	 */
+	template<typename TYPE> static TYPE *getVoxels( const VistaImage &image, const VistaData &src, boost::shared_ptr<void> &keep );
+
+	/**
+	 * Copy the (sorted) slices of functional data into one columns x rows x slices x time chunk.
+	 * The properties are taken from the first slice, the acquisition times of the slices are stored in "Vista/sliceTimes".
+	 */
+	static data::Chunk makeVolume( const std::vector<data::Chunk *> &slices, const util::ivector4 &dims );
+
 	//member function which switch handles the loaded images
-	bool switchHandle( VImage &, std::list<data::Chunk> & );
+	bool switchHandle( const VistaImage &, const VistaData &, std::list<data::Chunk> & );
 
 	/**
 	 * This function copies all chunk header informations to the appropriate
@@ -492,11 +508,14 @@ private:
 	 */
 	template <typename T> bool copyImageToVista( const data::Image &image, VImage &vimage );
 
+	/// This function creates a VistaChunk with the correct type for the given image.
+	template <typename TInput> VistaChunk<TInput> makeChunk( const VistaImage &image, const VistaData &src, bool functional );
+
 	/**
-	 * This function creates a MemChunk with the correct type and adds it to the
+	 * This function creates a VistaChunk with the correct type and adds it to the
 	 * end of the Chunk list.
 	 */
-	template <typename TInput> void addChunk( std::list<data::Chunk> &chunks, VImage image );
+	template <typename TInput> void addChunk( std::list<data::Chunk> &chunks, const VistaImage &image, const VistaData &src );
 
 	/**
 	 * This function calculates the index origin of a given chunk according to its
@@ -4,9 +4,10 @@
 
 #include "DataStorage/io_interface.h"
 #include <DataStorage/io_factory.hpp>
-#include <CoreUtils/tmpfile.hpp>
 #include <stdio.h>
 #include <fstream>
+#include <algorithm>
+#include <string.h>
 #include <zlib.h>
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/convenience.hpp>
@@ -62,19 +63,48 @@ private:
 		}
 	}
 
-	static void gz_uncompress( gzFile in, std::ofstream &out ) {
-		char buf[2048 * 1024];
+	/// get the uncompressed size as stored in the trailer of the gzip file (this is only a hint, as its stored modulo 2^32 and only for the last member)
+	static size_t gz_sizehint( const std::string &infile ) {
+		std::ifstream in( infile.c_str(), std::ios::binary );
+		unsigned char isize[4];
+
+		if( in.seekg( -4, std::ios::end ) && in.read( reinterpret_cast<char *>( isize ), 4 ) )
+			return isize[0] | isize[1] << 8 | isize[2] << 16 | static_cast<size_t>( isize[3] ) << 24;
+		else
+			return 0;
+	}
+
+	static data::ValuePtr<uint8_t> gz_uncompress( gzFile in, size_t sizehint ) {
+		size_t bytes = 0, capacity = std::max<size_t>( sizehint, 2048 * 1024 );
+		uint8_t *buf = ( uint8_t * )malloc( capacity );
 		int len;
-		size_t bytes = 0;
 
-		for (
-			len = gzread( in, buf, 2048 * 1024 );
-			len;
-			len = gzread( in, buf, 2048 * 1024 )
-		) {
+		if( !buf )
+			throwGenericError( "insufficient memory for decompression" );
+
+		do {
+			if( bytes < capacity ) {
+				len = gzread( in, buf + bytes, std::min<size_t>( capacity - bytes, 2048 * 1024 ) );
+			} else { // the buffer is full - usually the size hint was exact, so only grow it if there actually is more data
+				uint8_t probe[4096];
+
+				if( ( len = gzread( in, probe, sizeof( probe ) ) ) > 0 ) {
+					uint8_t *grown = ( uint8_t * )realloc( buf, capacity *= 2 );
+
+					if( !grown ) {
+						free( buf );
+						throwGenericError( "insufficient memory for decompression" );
+					}
+
+					buf = grown;
+					memcpy( buf + bytes, probe, len );
+				}
+			}
+
 			if ( len < 0 ) {
 				int err;
-				gzerror( out, &err );
+				gzerror( in, &err );
+				free( buf );
 
 				// If an error occurred in the file system and not in the compression library, err is set to Z_ERRNO
 				if ( err == Z_ERRNO ) {
@@ -82,18 +112,76 @@ private:
 				} else {
 					throwGenericError( "Failed to read compressed file" );
 				}
+			}
+
+			bytes += len;
+		} while( len > 0 );
+
+		LOG( Debug, verbose_info ) << "Uncompressed " << bytes << " bytes";
+		return data::ValuePtr<uint8_t>( buf, bytes ); // will be freed by the BasicDeleter
+	}
+
+	static data::ValuePtr<uint8_t> mem_uncompress( const data::ValuePtr<uint8_t> &src ) {
+		z_stream strm;
+		memset( &strm, 0, sizeof( z_stream ) );
+
+		if( inflateInit2( &strm, 16 + MAX_WBITS ) != Z_OK ) // 16+ means gzip-header
+			throwGenericError( "Failed to initialize decompression" );
+
+		const uint8_t *trailer = &src[src.getLength() - 4];
+		size_t bytes = 0, capacity = std::max<size_t>( trailer[0] | trailer[1] << 8 | trailer[2] << 16 | static_cast<size_t>( trailer[3] ) << 24, 2048 * 1024 );
+		uint8_t *buf = ( uint8_t * )malloc( capacity );
+		int err = buf ? Z_OK : Z_MEM_ERROR;
+
+		strm.next_in = const_cast<uint8_t *>( &src[0] );
+		strm.avail_in = src.getLength();
+
+		while( err == Z_OK ) {
+			if( bytes == capacity ) { // the buffer is full - usually the size hint was exact, so inflate into a probe first to see if the stream just ends here
+				uint8_t probe[4096];
+				strm.next_out = probe;
+				strm.avail_out = sizeof( probe );
+				err = inflate( &strm, Z_NO_FLUSH );
+				const size_t more = strm.next_out - probe;
+
+				if( more ) { // the size hint was wrong - grow the buffer
+					uint8_t *grown = ( uint8_t * )realloc( buf, capacity *= 2 );
+
+					if( !grown ) {
+						err = Z_MEM_ERROR;
+						break;
+					}
+
+					buf = grown;
+					memcpy( buf + bytes, probe, more );
+					bytes += more;
+				}
 			} else {
-				out.write( buf, len );
-				bytes += len;
+				strm.next_out = buf + bytes;
+				strm.avail_out = std::min<size_t>( capacity - bytes, 2048 * 1024 );
+				err = inflate( &strm, Z_NO_FLUSH );
+				bytes = strm.next_out - buf;
 			}
+
+			if( err == Z_STREAM_END && strm.avail_in ) // there is another gzip member - go on with that (gzread does the same)
+				err = inflateReset( &strm );
 		}
 
-		LOG( Debug, verbose_info ) << "Uncompressed " << bytes << " bytes";
+		inflateEnd( &strm );
+
+		if( err != Z_STREAM_END ) {
+			free( buf );
+			throwGenericError( std::string( "Failed to uncompress data (" ) + ( strm.msg ? strm.msg : zError( err ) ) + ")" );
+		}
+
+		LOG( Debug, verbose_info ) << "Uncompressed " << src.getLength() << " bytes into " << bytes << " bytes";
+		return data::ValuePtr<uint8_t>( buf, bytes ); // will be freed by the BasicDeleter
 	}
 
-	static void file_uncompress( std::string infile, std::string outfile ) {
+	static data::ValuePtr<uint8_t> file_uncompress( std::string infile ) {
+		const size_t sizehint = gz_sizehint( infile );
 		gzFile in = gzopen( infile.c_str(), "rb" );
-		LOG( Debug, info ) <<  "Uncompressing " << util::MSubject( infile ) << " to "  << util::MSubject( outfile );
+		LOG( Debug, info ) <<  "Uncompressing " << util::MSubject( infile ) << " into memory";
 
 		if ( in == NULL ) {
 			if ( errno )
@@ -102,14 +190,13 @@ private:
 				throwGenericError( "insufficient memory for compression" );
 		}
 
-		std::ofstream out;
-		out.exceptions( std::ifstream::failbit | std::ifstream::badbit );
-		out.open( outfile.c_str(), std::ios::binary );
-		gz_uncompress( in, out );
+		const data::ValuePtr<uint8_t> ret = gz_uncompress( in, sizehint );
 
 		if ( gzclose( in ) != Z_OK ) {
-			LOG( ImageIoLog, warning ) << "gclose " << outfile << " failed";
+			LOG( ImageIoLog, warning ) << "gclose " << infile << " failed";
 		}
+
+		return ret;
 	}
 
 protected:
@@ -156,26 +243,29 @@ public:
 			throwGenericError( "Cannot determine the unzipped suffix of \"" + filename + "\" because no io-plugin was found for it" );
 		}
 
-		const std::pair<std::string, std::string> realBase = formats.front()->makeBasename( proxyBase.first );
-
-		util::TmpFile tmpfile( "", realBase.second );
+		std::list<data::Chunk> loaded;
+		const int ret = data::IOFactory::load( loaded, file_uncompress( filename ), proxyBase.first, dialect );
 
-		file_uncompress( filename, tmpfile.file_string() );
-
-		std::list<data::Chunk>::iterator prev = chunks.end();
+		LOG( Debug, info ) <<  "Setting source of all " << loaded.size() << " chunks to " << util::MSubject( filename );
+		BOOST_FOREACH( data::Chunk & ref, loaded ) {
+			ref.setPropertyAs( "source", filename );
+		}
+		chunks.splice( chunks.end(), loaded );
 
-		--prev;
+		return ret;
+	}
 
-		int ret = data::IOFactory::load( chunks, tmpfile.string(), "", dialect );
+	int load ( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & ) {
+		if( src.getLength() < 18 ) // gzip header and trailer alone are 18 bytes
+			throwGenericError( "Too few data to be gzip compressed" );
 
-		if( ret ) {
-			prev++;
-			LOG( Debug, info ) <<  "Setting source of all " << std::distance( prev, chunks.end() ) << " chunks to " << util::MSubject( filename );
+		std::list<data::Chunk> loaded;
+		const int ret = data::IOFactory::load( loaded, mem_uncompress( src ), FileFormat::makeBasename( filename ).first, dialect );
 
-			for( ; prev != chunks.end(); ++prev ) {
-				prev->setPropertyAs( "source", filename );
-			}
+		BOOST_FOREACH( data::Chunk & ref, loaded ) {
+			ref.setPropertyAs( "source", filename );
 		}
+		chunks.splice( chunks.end(), loaded );
 
 		return ret;
 	}
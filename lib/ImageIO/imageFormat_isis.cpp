@@ -0,0 +1,321 @@
+#include <DataStorage/io_interface.h>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <limits>
+#include <algorithm>
+#include <zlib.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+namespace isis
+{
+namespace image_io
+{
+
+/**
+ * Native isis format.
+ * Stores an image losslessly (all properties of the image and its chunks, mixed chunk types) so it can be used to hand data between
+ * processing steps.
+ * Layout of the file (all values in host byte order, which is checked on load):
+ * - the header (Header)
+ * - the properties of the image (see PropertyMap::writeBinary)
+ * - the voxel data of the chunks, each block aligned to 64 bytes
+ * - the properties of the chunks
+ * - the chunk directory (one DirEntry per chunk)
+ * Uncompressed voxel data is used directly from the mapped file.
+ * With the dialect "compressed" the voxel data of each chunk is compressed using zlib (if that makes it smaller).
+ */
+class ImageFormat_isis: public FileFormat
+{
+	static const char magic[8];
+	static const uint16_t version = 1;
+	static const uint16_t byteOrderMark = 0x0102;
+	static const size_t alignment = 64;
+	enum {compressed = 1};
+
+	struct Header {
+		char magic[8];
+		uint16_t version, byteOrderMark;
+		uint32_t chunks;
+		uint64_t propLength; // the properties of the image directly follow the header
+		uint64_t directory;
+	};
+	struct DirEntry {
+		uint16_t typeID, flags;
+		uint32_t reserved;
+		uint64_t size[4];
+		uint64_t data, dataLength;
+		uint64_t props, propLength;
+	};
+
+	/// keeps the memory the chunks were loaded from (mapped file or memory from a proxy plugin) alive
+	struct KeepAlive {
+		boost::shared_ptr<void> m_mem;
+		KeepAlive( const boost::shared_ptr<void> &mem ): m_mem( mem ) {}
+		void operator()( void *at ) {
+			LOG( Debug, verbose_info ) << "Releasing chunk at " << at;
+			m_mem.reset();
+		}
+	};
+	struct UnMap {
+		size_t m_length;
+		UnMap( size_t length ): m_length( length ) {}
+		void operator()( void *at ) {
+			LOG( Debug, info ) << "Unmapping " << m_length << " bytes at " << at;
+			munmap( at, m_length );
+		}
+	};
+
+	class IsisChunk: public data::Chunk
+	{
+	public:
+		template<typename TYPE> IsisChunk( TYPE *src, const KeepAlive &del, const uint64_t size[4] ):
+			data::Chunk( src, del, size[0], size[1], size[2], size[3] ) {}
+		IsisChunk( const data::ValuePtrReference &src, const uint64_t size[4] ):
+			data::Chunk( src, size[0], size[1], size[2], size[3] ) {}
+	};
+
+	/// \returns true if the block at offset with the given length is within the first length bytes (written so it can't wrap around)
+	static bool fits( uint64_t offset, uint64_t blockLength, size_t length ) {
+		return offset <= length && blockLength <= length - offset;
+	}
+	/**
+	 * \returns the amount of voxels of the chunk described by entry
+	 * That can't be more than maxVoxels (which depends on the length of the voxel data in the file), otherwise the file is broken.
+	 */
+	static uint64_t voxelCount( const DirEntry &entry, uint64_t maxVoxels ) {
+		uint64_t ret = 1;
+
+		for( int d = 0; d < 4; d++ ) {
+			if( entry.size[d] == 0 || entry.size[d] > maxVoxels / ret )
+				throwGenericError( "invalid size of a chunk" );
+
+			ret *= entry.size[d];
+		}
+
+		return ret;
+	}
+	static bool readProps( util::PropertyMap &dst, const uint8_t *at, size_t length ) {
+		std::stringstream buff( std::string( reinterpret_cast<const char *>( at ), length ) );
+		return dst.readBinary( buff );
+	}
+	/// create a chunk of the given type using the memory at data directly
+	static void mapChunk( std::list<data::Chunk> &chunks, const DirEntry &entry, uint8_t *data, const KeepAlive &del ) {
+#define ISIS_CHUNK(TYPE) case data::ValuePtr<TYPE>::staticID: chunks.push_back( IsisChunk( reinterpret_cast<TYPE*>( data ), del, entry.size ) ); break
+
+		switch( entry.typeID ) {
+			ISIS_CHUNK( bool );
+			ISIS_CHUNK( int8_t );
+			ISIS_CHUNK( uint8_t );
+			ISIS_CHUNK( int16_t );
+			ISIS_CHUNK( uint16_t );
+			ISIS_CHUNK( int32_t );
+			ISIS_CHUNK( uint32_t );
+			ISIS_CHUNK( int64_t );
+			ISIS_CHUNK( uint64_t );
+			ISIS_CHUNK( float );
+			ISIS_CHUNK( double );
+			ISIS_CHUNK( util::color24 );
+			ISIS_CHUNK( util::color48 );
+			ISIS_CHUNK( std::complex<float> );
+			ISIS_CHUNK( std::complex<double> );
+		default:
+			throwGenericError( "unknown type id " + boost::lexical_cast<std::string>( entry.typeID ) );
+		}
+
+#undef ISIS_CHUNK
+	}
+	/// create a chunk of the given type in new memory and uncompress the data into it
+	static void uncompressChunk( std::list<data::Chunk> &chunks, const DirEntry &entry, const uint8_t *data ) {
+		// deflate can't compress more than 1032:1, every voxel has at least one byte (and at most 16, which must still fit into size_t)
+		const size_t volume = voxelCount( entry, std::min<uint64_t>( entry.dataLength * 1032, std::numeric_limits<size_t>::max() / 16 ) );
+		const data::ValuePtrReference mem = data::_internal::ValuePtrBase::createById( entry.typeID, volume );
+		const size_t bytes = mem->bytesPerElem() * volume;
+		uLongf destLen = bytes;
+
+		if( uncompress( static_cast<Bytef *>( mem->getRawAddress().lock().get() ), &destLen, data, entry.dataLength ) != Z_OK || destLen != bytes )
+			throwGenericError( "failed to uncompress voxel data" );
+
+		chunks.push_back( IsisChunk( mem, entry.size ) );
+	}
+
+	/// parse the file at base and add its chunks (base has to be kept alive by keep)
+	static int parse( std::list<data::Chunk> &chunks, uint8_t *base, size_t length, const boost::shared_ptr<void> &keep ) {
+		Header header; // copied, as the file may not be aligned
+
+		if( length < sizeof( Header ) )
+			throwGenericError( "not an isis file" );
+
+		memcpy( &header, base, sizeof( Header ) );
+
+		if( memcmp( header.magic, magic, sizeof( magic ) ) != 0 )
+			throwGenericError( "not an isis file" );
+
+		if( header.byteOrderMark != byteOrderMark )
+			throwGenericError( "the file was written on a host with different byte order" );
+
+		if( header.version > version )
+			throwGenericError( "the file was written by a newer version of the plugin" );
+
+		if( !fits( sizeof( Header ), header.propLength, length ) || header.directory > length || header.chunks > ( length - header.directory ) / sizeof( DirEntry ) )
+			throwGenericError( "the file is truncated" );
+
+		util::PropertyMap imageProps;
+
+		if( !readProps( imageProps, base + sizeof( Header ), header.propLength ) )
+			throwGenericError( "failed to read the properties of the image" );
+
+		const KeepAlive del( keep );
+		std::list<data::Chunk> loaded; // only hand out the chunks if all of them could be loaded
+
+		for( uint32_t i = 0; i < header.chunks; i++ ) {
+			DirEntry entry;
+			memcpy( &entry, base + header.directory + i * sizeof( DirEntry ), sizeof( DirEntry ) );
+
+			if( !fits( entry.data, entry.dataLength, length ) || !fits( entry.props, entry.propLength, length ) )
+				throwGenericError( "the file is truncated" );
+
+			if( entry.flags & compressed ) {
+				uncompressChunk( loaded, entry, base + entry.data );
+			} else {
+				voxelCount( entry, entry.dataLength ); // every voxel has at least one byte
+				mapChunk( loaded, entry, base + entry.data, del );
+
+				if( loaded.back().bytesPerVoxel() * loaded.back().getVolume() != entry.dataLength )
+					throwGenericError( "size of the voxel data does not match" );
+			}
+
+			if( !readProps( loaded.back(), base + entry.props, entry.propLength ) )
+				throwGenericError( "failed to read the properties of a chunk" );
+
+			loaded.back().join( imageProps );
+		}
+
+		chunks.splice( chunks.end(), loaded );
+		return header.chunks;
+	}
+
+	static void pad( std::ostream &out ) {
+		static const char zeros[alignment] = {0};
+		const size_t rest = out.tellp() % alignment;
+
+		if( rest )
+			out.write( zeros, alignment - rest );
+	}
+	static void writeProps( std::ostream &out, const util::PropertyMap &props, uint64_t &offset, uint64_t &length ) {
+		offset = out.tellp();
+		props.writeBinary( out );
+		length = static_cast<uint64_t>( out.tellp() ) - offset;
+	}
+protected:
+	std::string suffixes()const {
+		return std::string( "isis" );
+	}
+public:
+	std::string getName()const {
+		return "native isis format";
+	}
+	std::string dialects( const std::string & ) const {
+		return "compressed";
+	}
+
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &/*dialect*/ )  throw( std::runtime_error & ) {
+		const size_t fsize = boost::filesystem::file_size( filename );
+		const int mfile = open( filename.c_str(), O_RDONLY );
+
+		if( mfile == -1 )
+			throwSystemError( errno, std::string( "Failed to open " ) + filename );
+
+		// map privately, so changes to the chunks don't go into the file
+		void *mmem = mmap( NULL, fsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, mfile, 0 );
+		const int err = errno;
+		close( mfile ); // the mapping stays valid
+
+		if( mmem == MAP_FAILED )
+			throwSystemError( err, std::string( "Failed to map " ) + filename + " into memory" );
+
+		return parse( chunks, static_cast<uint8_t *>( mmem ), fsize, boost::shared_ptr<void>( mmem, UnMap( fsize ) ) );
+	}
+
+	int load ( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src, const std::string &/*filename*/, const std::string &/*dialect*/ )  throw( std::runtime_error & ) {
+		LOG( Debug, info ) << "Using " << src.getLength() << " bytes from memory at " << ( void * )&src[0];
+		return parse( chunks, const_cast<uint8_t *>( &src[0] ), src.getLength(), src.getRawAddress().lock() );
+	}
+
+	void write( const data::Image &image, const std::string &filename, const std::string &dialect )  throw( std::runtime_error & ) {
+		const std::vector<data::Chunk> chunks = image.copyChunksToVector( false );
+		const bool compress = ( dialect == "compressed" );
+		std::vector<DirEntry> dir( chunks.size() );
+		std::ofstream out;
+		out.exceptions( std::ios::failbit | std::ios::badbit );
+		out.open( filename.c_str(), std::ios::binary );
+
+		Header header;
+		memset( &header, 0, sizeof( Header ) );
+		memcpy( header.magic, magic, sizeof( magic ) );
+		header.version = version;
+		header.byteOrderMark = byteOrderMark;
+		header.chunks = chunks.size();
+		out.write( reinterpret_cast<const char *>( &header ), sizeof( Header ) );
+
+		uint64_t propOffset; // always sizeof( Header )
+		writeProps( out, image, propOffset, header.propLength );
+
+		std::vector<Bytef> buffer;
+
+		for( size_t i = 0; i < chunks.size(); i++ ) {
+			const data::Chunk &ch = chunks[i];
+			const boost::shared_ptr<void> data( ch.getValuePtrBase().getRawAddress() );
+			const size_t bytes = ch.bytesPerVoxel() * ch.getVolume();
+			const util::FixedVector<size_t, 4> size = ch.getSizeAsVector();
+			DirEntry &entry = dir[i];
+			memset( &entry, 0, sizeof( DirEntry ) );
+			entry.typeID = ch.getTypeID();
+
+			for( size_t d = 0; d < 4; d++ )
+				entry.size[d] = size[d];
+
+			pad( out );
+			entry.data = out.tellp();
+			entry.dataLength = bytes;
+
+			if( compress ) {
+				uLongf destLen = compressBound( bytes );
+				buffer.resize( destLen );
+
+				if( compress2( &buffer[0], &destLen, static_cast<const Bytef *>( data.get() ), bytes, Z_DEFAULT_COMPRESSION ) == Z_OK && destLen < bytes ) {
+					entry.flags |= compressed;
+					entry.dataLength = destLen;
+				}
+			}
+
+			if( entry.flags & compressed )
+				out.write( reinterpret_cast<const char *>( &buffer[0] ), entry.dataLength );
+			else
+				out.write( static_cast<const char *>( data.get() ), bytes );
+		}
+
+		for( size_t i = 0; i < chunks.size(); i++ )
+			writeProps( out, chunks[i], dir[i].props, dir[i].propLength );
+
+		pad( out );
+		header.directory = out.tellp();
+		out.write( reinterpret_cast<const char *>( &dir[0] ), dir.size() * sizeof( DirEntry ) );
+
+		out.seekp( 0 );
+		out.write( reinterpret_cast<const char *>( &header ), sizeof( Header ) );
+		LOG( ImageIoLog, info ) << "Wrote " << chunks.size() << " chunks to " << filename;
+	}
+	bool tainted()const {return false;}//internal plugins are not tainted
+};
+const char ImageFormat_isis::magic[8] = {'i', 's', 'i', 's', 'i', 'm', 'g', '\0'};
+}
+}
+isis::image_io::FileFormat *factory()
+{
+	return new isis::image_io::ImageFormat_isis();
+}
@@ -1,8 +1,12 @@
 #include <DataStorage/io_interface.h>
 #include <fstream>
 #include <boost/foreach.hpp>
+#include <boost/regex.hpp>
+#include <CoreUtils/threadpool.hpp>
+#include <boost/lexical_cast.hpp>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <boost/filesystem.hpp>
 
 namespace isis
@@ -10,31 +14,233 @@ namespace isis
 namespace image_io
 {
 
+/**
+ * Plugin for raw voxel data.
+ * The geometry and type of the data is taken from (in that order)
+ * - a sidecar header next to the file (the filename with ".header" appended), eg.:
+ *   \code
+ *   size: 64 64 32 100
+ *   type: s16bit
+ *   \endcode
+ * - the filename, if it ends with "_<size>_<type>.raw" (eg. "data_64x64x32x100_s16bit.raw") as written by this plugin
+ * - the type given as dialect (eg. "-rdialect u16bit"), the data is then assumed to be a square slice
+ * The writer stores the voxel data of the image in its major type and writes the sidecar header.
+ */
 class ImageFormat_raw: public FileFormat
 {
 	typedef std::map<std::string, unsigned short> typemap;
+	struct Geometry {
+		util::FixedVector<size_t, 4> size;
+		unsigned short type;
+	};
 protected:
 	std::string suffixes()const {
 		return std::string( "raw" );
 	}
-	struct Deleter {
-		//members
-		int m_file;
+	struct UnMap {
+		size_t m_length;
 		std::string m_filename;
-		Deleter( int file, const std::string &filename ): m_file( file ), m_filename( filename ) {}
+		UnMap( size_t length, const std::string &filename ): m_length( length ), m_filename( filename ) {}
 
 		void operator ()( void *at ) {
 			LOG( Debug, info ) << "Freeing memory at " << at << " mapped from " << m_filename;
-			munmap( at, boost::filesystem::file_size( m_filename ) ); //@todo will fail when the file was replaced in the meantime
-			close( m_file );
+			munmap( at, m_length );
+		}
+	};
+
+	/// deleter for chunks referencing memory handed in by another plugin (it keeps the memory alive)
+	struct MemDeleter {
+		data::ValuePtr<uint8_t> m_mem;
+		MemDeleter( const data::ValuePtr<uint8_t> &mem ): m_mem( mem ) {}
+		void operator ()( void *at ) {
+			LOG( Debug, info ) << "Releasing reference to memory at " << at;
 		}
 	};
 
 	class RawMemChunk: public data::Chunk
 	{
 	public:
-		template<typename T> RawMemChunk( T *src, const Deleter &del, size_t width, size_t height, size_t slices = 1, size_t timesteps = 1 )
-			: data::Chunk( src, del, width, height, slices, timesteps ) {}
+		template<typename T, typename D> RawMemChunk( T *src, const D &del, const util::FixedVector<size_t, 4> &size )
+			: data::Chunk( src, del, size[0], size[1], size[2], size[3] ) {}
+	};
+
+	static std::string headerName( const std::string &filename ) {
+		return filename + ".header";
+	}
+	static unsigned short typeByName( const std::string &name ) {
+		return util::getTransposedTypeMap( false, true )[name + "*"];
+	}
+	static std::string typeName( unsigned short type ) {
+		std::string ret = util::getTypeMap( false )[type];
+		ret.erase( ret.find_last_not_of( '*' ) + 1 );
+		return ret;
+	}
+	static size_t elemSize( unsigned short type ) {
+		return data::_internal::ValuePtrBase::createById( type, 0 )->bytesPerElem();
+	}
+
+	/// read geometry and type from the sidecar header of filename
+	static bool readHeader( const std::string &filename, Geometry &geo ) {
+		std::ifstream in( headerName( filename ).c_str() );
+
+		if( !in.good() )
+			return false;
+
+		std::string line;
+		geo.size.fill( 1 );
+		geo.type = 0;
+
+		while( std::getline( in, line ) ) {
+			const size_t colon = line.find( ':' );
+
+			if( line.empty() || line[0] == '#' || colon == std::string::npos )
+				continue;
+
+			const std::string key = line.substr( 0, colon );
+			std::stringstream value( line.substr( colon + 1 ) );
+
+			if( key == "size" ) {
+				for( size_t i = 0; i < 4 && value >> geo.size[i]; i++ );
+			} else if( key == "type" ) {
+				std::string type;
+				value >> type;
+				geo.type = typeByName( type );
+				LOG_IF( geo.type == 0, Runtime, error ) << "Unknown type " << util::MSubject( type ) << " in " << headerName( filename );
+			} else {
+				LOG( Runtime, warning ) << "Ignoring unknown entry " << util::MSubject( key ) << " in " << headerName( filename );
+			}
+		}
+
+		return geo.type != 0 && geo.size.product() > 0;
+	}
+	static void writeHeader( const std::string &filename, const Geometry &geo ) {
+		std::ofstream out;
+		out.exceptions( std::ios::failbit | std::ios::badbit );
+		out.open( headerName( filename ).c_str() );
+		out << "# raw data written by isis" << std::endl;
+		out << "size: " << geo.size[0] << " " << geo.size[1] << " " << geo.size[2] << " " << geo.size[3] << std::endl;
+		out << "type: " << typeName( geo.type ) << std::endl;
+	}
+
+	/// get geometry and type from the filename (as generated by write)
+	static bool parseFilename( const std::string &filename, Geometry &geo ) {
+		static const boost::regex pattern( ".*_([0-9]+)x([0-9]+)x([0-9]+)x([0-9]+)_([a-z0-9]+)\\.raw.*" );
+		const std::string leaf = boost::filesystem::path( filename ).leaf();
+		boost::smatch results;
+
+		if( !boost::regex_match( leaf, results, pattern ) )
+			return false;
+
+		for( size_t i = 0; i < 4; i++ )
+			geo.size[i] = boost::lexical_cast<size_t>( results.str( i + 1 ) );
+
+		geo.type = typeByName( results.str( 5 ) );
+		return geo.type != 0;
+	}
+
+	/// guess the size of read and phase from the type given as dialect, assuming the data is a square slice
+	static bool guessSize( size_t fsize, const std::string &dialect, Geometry &geo ) {
+		geo.type = typeByName( dialect );
+
+		if( geo.type == 0 ) {
+			LOG( Runtime, error ) << "No known datatype given, you have to give the type ofe the raw data as rdialect (eg. \"-rdialect u16bit\") or in a header file";
+			throwGenericError( "No known datatype" );
+		}
+
+		const size_t ssize = sqrt( fsize / elemSize( geo.type ) );
+
+		if( ssize *ssize *elemSize( geo.type ) == fsize ) {
+			LOG( Runtime, info ) << "Guessing size of read and phase to be " << ssize;
+			geo.size = util::FixedVector<size_t, 4>();
+			geo.size.fill( 1 );
+			geo.size[0] = geo.size[1] = ssize;
+			return true;
+		} else {
+			LOG( Runtime, error ) << "Could not guess image size for " << fsize << " bytes of data";
+			return false;
+		}
+	}
+
+	static bool getGeometry( const std::string &filename, size_t fsize, const std::string &dialect, Geometry &geo ) {
+		if( readHeader( filename, geo ) ) {
+			LOG( Runtime, info ) << "Using size " << geo.size << " and type " << typeName( geo.type ) << " from " << headerName( filename );
+		} else if( parseFilename( filename, geo ) ) {
+			LOG( Runtime, info ) << "Using size " << geo.size << " and type " << typeName( geo.type ) << " from the filename";
+		} else if( !guessSize( fsize, dialect, geo ) ) {
+			return false;
+		}
+
+		if( geo.size.product() * elemSize( geo.type ) != fsize ) {
+			LOG( Runtime, error ) << "The size of " << filename << " (" << fsize << " bytes) does not match the size " << geo.size << " of type " << typeName( geo.type );
+			return false;
+		}
+
+		return true;
+	}
+
+	template<typename D> static int makeChunk( std::list<data::Chunk> &chunks, void *mem, const D &del, const Geometry &geo ) {
+#define ISIS_RAW_CHUNK(TYPE) case data::ValuePtr<TYPE>::staticID: chunks.push_back( RawMemChunk( static_cast<TYPE*>( mem ), del, geo.size ) ); break
+
+		switch( geo.type ) {
+			ISIS_RAW_CHUNK( int8_t );
+			ISIS_RAW_CHUNK( uint8_t );
+			ISIS_RAW_CHUNK( int16_t );
+			ISIS_RAW_CHUNK( uint16_t );
+			ISIS_RAW_CHUNK( int32_t );
+			ISIS_RAW_CHUNK( uint32_t );
+			ISIS_RAW_CHUNK( int64_t );
+			ISIS_RAW_CHUNK( uint64_t );
+			ISIS_RAW_CHUNK( float );
+			ISIS_RAW_CHUNK( double );
+			ISIS_RAW_CHUNK( util::color24 );
+			ISIS_RAW_CHUNK( util::color48 );
+			ISIS_RAW_CHUNK( std::complex<float> );
+			ISIS_RAW_CHUNK( std::complex<double> );
+		default:
+			throwGenericError( "Unsupported type " + typeName( geo.type ) );
+		}
+
+#undef ISIS_RAW_CHUNK
+		data::Chunk &ch = chunks.back();
+		ch.setPropertyAs<uint16_t>( "sequenceNumber", 0 );
+		ch.setPropertyAs<uint32_t>( "acquisitionNumber", 0 );
+		ch.setPropertyAs( "voxelSize", util::fvector4( 1, 1, 1 ) );
+		ch.setPropertyAs( "rowVec", util::fvector4( 1, 0 ) );
+		ch.setPropertyAs( "columnVec", util::fvector4( 0, 1 ) );
+		ch.setPropertyAs( "indexOrigin", util::fvector4( 0, 0 ) );
+		return 1;
+	}
+
+	/// writes the chunk with the given index to the file at its offset
+	struct WriteOp {
+		int m_file;
+		const std::vector<data::Chunk> &m_chunks;
+		const std::vector<off_t> &m_offsets;
+		std::vector<int> &m_errors; // errno for every chunk (0 if it was written)
+		WriteOp( int file, const std::vector<data::Chunk> &chunks, const std::vector<off_t> &offsets, std::vector<int> &errors )
+			: m_file( file ), m_chunks( chunks ), m_offsets( offsets ), m_errors( errors ) {}
+		void operator()( size_t i ) {
+			const boost::shared_ptr<void> data( m_chunks[i].getValuePtrBase().getRawAddress() );
+			const char *at = static_cast<const char *>( data.get() );
+			size_t left = m_chunks[i].bytesPerVoxel() * m_chunks[i].getVolume();
+			off_t offset = m_offsets[i];
+
+			while( left ) {
+				const ssize_t written = pwrite( m_file, at, left, offset );
+
+				if( written < 0 ) {
+					if( errno == EINTR )
+						continue;
+
+					m_errors[i] = errno;
+					break;
+				}
+
+				at += written;
+				offset += written;
+				left -= written;
+			}
+		}
 	};
 public:
 	std::string getName()const {
@@ -56,80 +262,95 @@ public:
 
 
 	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &dialect )  throw( std::runtime_error & ) {
-
-
 		const size_t fsize = boost::filesystem::file_size( filename );
-		const unsigned short type = util::getTransposedTypeMap( false, true )[dialect+"*"];
-
-		if( type == 0 ) {
-			LOG( Runtime, error ) << "No known datatype given, you have to give the type ofe the raw data as rdialect (eg. \"-rdialect u16bit\")";
-			throwGenericError( "No known datatype" );
-		}
-
-		const size_t elemSize = data::_internal::ValuePtrBase::createById( type, 0 )->bytesPerElem();
+		Geometry geo;
 
-		const size_t ssize = sqrt( fsize / elemSize );
-
-		if( ssize *ssize *elemSize == fsize ) {
-			LOG( Runtime, info ) << "Guessing size of read and phase to be " << ssize;
-
-			int mfile = open( filename.c_str(), O_RDONLY );
+		if( getGeometry( filename, fsize, dialect, geo ) ) {
+			const int mfile = open( filename.c_str(), O_RDONLY );
 
 			if( mfile == -1 ) {
 				throwSystemError( errno, std::string( "Failed to open " ) + filename );
 			}
 
-
-			char *mmem = ( char * )mmap( NULL, fsize, PROT_READ, MAP_SHARED, mfile, 0 ); //map it into memory
+			// map privately, so changes to the chunk don't go into the file
+			void *mmem = mmap( NULL, fsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, mfile, 0 );
+			const int err = errno;
+			close( mfile ); // the mapping stays valid
 
 			if( mmem == MAP_FAILED ) {
-				throwSystemError( errno, std::string( "Failed to map " ) + filename + " into memory" );
+				throwSystemError( err, std::string( "Failed to map " ) + filename + " into memory" );
 			}
 
+			return makeChunk( chunks, mmem, UnMap( fsize, filename ), geo );
+		} else
+			return 0;
+	}
 
-			Deleter del( mfile, filename );
-			chunks.push_back( RawMemChunk( ( uint16_t * )mmem, del, ssize, ssize ) );
-			data::Chunk &ch = chunks.back();
-			ch.setPropertyAs<uint16_t>( "sequenceNumber", 0 );
-			ch.setPropertyAs<uint32_t>( "acquisitionNumber", 0 );
-			ch.setPropertyAs( "voxelSize", util::fvector4( 1, 1, 1 ) );
-			ch.setPropertyAs( "rowVec", util::fvector4( 1, 0 ) );
-			ch.setPropertyAs( "columnVec", util::fvector4( 0, 1 ) );
-			ch.setPropertyAs( "indexOrigin", util::fvector4( 0, 0 ) );
-			return 1;
-		} else {
-			LOG( Runtime, error ) << "Could not guess image size for " << fsize << " bytes of data";
+	int load ( std::list<data::Chunk> &chunks, const data::ValuePtr<uint8_t> &src, const std::string &filename, const std::string &dialect )  throw( std::runtime_error & ) {
+		Geometry geo;
+
+		if( getGeometry( filename, src.getLength(), dialect, geo ) ) {
+			LOG( Debug, info ) << "Using " << src.getLength() << " bytes from memory at " << ( void * )&src[0];
+			return makeChunk( chunks, const_cast<uint8_t *>( &src[0] ), MemDeleter( src ), geo );
+		} else
 			return 0;
-		}
 	}
 
 	void write( const data::Image &image, const std::string &filename, const std::string &/*dialect*/ )  throw( std::runtime_error & ) {
-		class WriteOp: public data::ChunkOp
-		{
-			std::ofstream out;
-			unsigned short typeID;
-		public:
-			WriteOp( std::string fname, unsigned short id ): out( fname.c_str() ), typeID( id ) {
-				out.exceptions( std::ios::failbit | std::ios::badbit );
-			}
-			bool operator()( data::Chunk &ref, util::FixedVector<size_t, 4 > /*posInImage*/ ) {
-				const boost::shared_ptr<void> data( ref.getValuePtrBase().getRawAddress() );
-				const size_t data_size = ref.bytesPerVoxel() * ref.getVolume();
-				out.write( static_cast<const char *>( data.get() ), data_size );
-				return true;
-			}
-		};
 		const std::pair<std::string, std::string> splitted = makeBasename( filename );
-		unsigned short type = image.getMajorTypeID();
-
-		std::string typeStr = util::getTypeMap( false )[type];
-		typeStr.erase( typeStr.find_last_not_of( '*' ) + 1 );
-
+		Geometry geo;
+		geo.type = image.getMajorTypeID();
+		geo.size = image.getSizeAsVector();
+		const std::string typeStr = typeName( geo.type );
 		const std::string outName = splitted.first + "_" + image.getSizeAsString() + "_" + typeStr + splitted.second ;
 
 		LOG( ImageIoLog, info ) << "Writing image of size " << image.getSizeAsVector() << " and type " << typeStr << " to " << outName;
-		WriteOp writer( outName, type );
-		const_cast<data::Image &>( image ).foreachChunk( writer );
+
+		// the chunks are contiguous in the image, so each one goes right behind the previous one
+		std::vector<data::Chunk> chunks = image.copyChunksToVector( false );
+		std::vector<off_t> offsets( chunks.size() );
+		const data::scaling_pair scaling = image.getScalingTo( geo.type );
+		off_t fsize = 0;
+
+		for( size_t i = 0; i < chunks.size(); i++ ) {
+			if( !chunks[i].convertToType( geo.type, scaling ) )
+				throwGenericError( "Failed to convert chunk to " + typeStr );
+
+			offsets[i] = fsize;
+			fsize += chunks[i].bytesPerVoxel() * chunks[i].getVolume();
+		}
+
+		const int file = open( outName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+
+		if( file == -1 )
+			throwSystemError( errno, std::string( "Failed to open " ) + outName + " for writing" );
+
+		// allocate the whole file upfront, so the parallel writes don't have to extend it
+		int err = 0;
+#ifdef __linux__
+
+		if( fallocate( file, 0, 0, fsize ) )
+			err = errno;
+
+		if( err == EOPNOTSUPP ) // not all filesystems support fallocate
+#endif
+			err = ftruncate( file, fsize ) ? errno : 0;
+
+		if( err ) {
+			close( file );
+			throwSystemError( err, std::string( "Failed to allocate " ) + boost::lexical_cast<std::string>( fsize ) + " bytes for " + outName );
+		}
+
+		std::vector<int> errors( chunks.size(), 0 );
+		util::ThreadPool::get().parallel_for( 0, chunks.size(), WriteOp( file, chunks, offsets, errors ), 1 );
+		close( file );
+
+		for( size_t i = 0; i < chunks.size(); i++ ) {
+			if( errors[i] )
+				throwSystemError( errors[i], std::string( "Failed to write chunk " ) + boost::lexical_cast<std::string>( i ) + " to " + outName );
+		}
+
+		writeHeader( outName, geo );
 	}
 	bool tainted()const {return false;}//internal plugins are not tainted
 };
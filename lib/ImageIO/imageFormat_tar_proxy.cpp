@@ -1,8 +1,7 @@
 
 #include "DataStorage/io_interface.h"
 #include <DataStorage/io_factory.hpp>
-#include <CoreUtils/tmpfile.hpp>
-#include <DataStorage/io_factory.hpp>
+#include <CoreUtils/threadpool.hpp>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/convenience.hpp>
@@ -11,17 +10,20 @@
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filter/bzip2.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread.hpp>
 
 #include <tar.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <fstream>
-
-#ifdef HAVE_FALLOCATE
-#include <linux/falloc.h>
-#elif defined HAVE_POSIX_FALLOCATE
-#include <fcntl.h>
-#endif
+#include <sstream>
+#include <deque>
+#include <vector>
+#include <map>
+#include <string.h>
 
 namespace isis
 {
@@ -35,7 +37,7 @@ namespace image_io
 class ImageFormat_TarProxy: public FileFormat
 {
 private:
-	struct {
+	struct tar_header {
 		char name[100];
 		char mode[8];
 		char uid[8];
@@ -53,22 +55,29 @@ private:
 		char devminor[8];
 		char prefix[155];
 		char padding[12];
-	} tar_header;
-	bool read_header( const boost::iostreams::filtering_istream &src, size_t &size, size_t &next_header_in ) {
-		if( boost::iostreams::read( src, reinterpret_cast<char *>( &tar_header ), 512 ) == 512 ) {
-			//get the size
-			std::stringstream buff( tar_header.size );
-			size = 0, next_header_in = 0;
-
-			if( tar_header.size[10] != 0 ) {
-				buff >> std::oct >> size;
-				next_header_in = ( size / 512 ) * 512 + ( size % 512 ? 512 : 0 );
-			}
-
+	};
+	/// get the size of the data following the header and the offset of the next header relative to the end of this header
+	static void parse_size( const tar_header &header, size_t &size, size_t &next_header_in ) {
+		std::stringstream buff( std::string( header.size, 12 ) );
+		size = 0, next_header_in = 0;
+
+		if( header.size[10] != 0 ) {
+			buff >> std::oct >> size;
+			next_header_in = ( size / 512 ) * 512 + ( size % 512 ? 512 : 0 );
+		}
+	}
+	static bool read_header( const boost::iostreams::filtering_istream &src, tar_header &header, size_t &size, size_t &next_header_in ) {
+		if( boost::iostreams::read( src, reinterpret_cast<char *>( &header ), 512 ) == 512 ) {
+			parse_size( header, size, next_header_in );
 			return true;
 		} else
 			return false;
 	}
+	/// get the original filename (use strnlen, because these fields are not \0-terminated if they are full)
+	static boost::filesystem::path member_name( const tar_header &header ) {
+		const std::string prefix( header.prefix, strnlen( header.prefix, 155 ) ), name( header.name, strnlen( header.name, 100 ) );
+		return prefix.empty() ? boost::filesystem::path( name ) : boost::filesystem::path( prefix ) / name;
+	}
 	static size_t tar_readstream( const boost::iostreams::filtering_istream &src, void *dst, size_t size, const std::string &log_title ) {
 		size_t red = boost::iostreams::read( src, ( char * )dst, size ); // read data from the stream into the mapped memory
 
@@ -79,68 +88,303 @@ private:
 		return red;
 	}
 
-protected:
-	std::string suffixes()const {
-		return std::string( "tar tar.gz tgz tar.bz2 tbz tar.Z taz" );
+	/// a member of the tar file which was read into memory
+	struct Member {
+		boost::filesystem::path name;
+		data::ValuePtr<uint8_t> data;
+		size_t index; // position of the member in the archive (set by the queue)
+		Member( const boost::filesystem::path &_name, const data::ValuePtr<uint8_t> &_data ): name( _name ), data( _data ), index( 0 ) {}
+	};
+
+	/**
+	 * Queue to hand members from the thread reading the tar file to the workers.
+	 * The amount of queued members is limited to keep the memory footprint sane.
+	 */
+	class MemberQueue
+	{
+		boost::mutex mutex;
+		boost::condition_variable changed;
+		std::deque<boost::shared_ptr<Member> > members;
+		const size_t max_queued;
+		size_t pushed;
+		bool closed;
+	public:
+		MemberQueue( size_t max ): max_queued( max ), pushed( 0 ), closed( false ) {}
+		void push( const boost::shared_ptr<Member> &member ) {
+			boost::unique_lock<boost::mutex> lock( mutex );
+
+			while( members.size() >= max_queued )
+				changed.wait( lock );
+
+			member->index = pushed++;
+			members.push_back( member );
+			changed.notify_all();
+		}
+		/// \returns the next member or an empty pointer if the queue was closed and there are no members left
+		boost::shared_ptr<Member> pop() {
+			boost::unique_lock<boost::mutex> lock( mutex );
+
+			while( members.empty() && !closed )
+				changed.wait( lock );
+
+			boost::shared_ptr<Member> ret;
+
+			if( !members.empty() ) {
+				ret = members.front();
+				members.pop_front();
+				changed.notify_all();
+			}
+
+			return ret;
+		}
+		/// no more members will be pushed
+		void close() {
+			boost::mutex::scoped_lock lock( mutex );
+			closed = true;
+			changed.notify_all();
+		}
+	};
+
+	/// chunks loaded by the workers sorted by the index of the member they came from
+	typedef std::map<size_t, std::list<data::Chunk> > ChunksByMember;
+
+	/// loads the members from the queue into its own chunk lists until the queue is closed
+	struct Worker {
+		MemberQueue &queue;
+		const std::string &tarname, &dialect;
+		ChunksByMember chunks;
+		int loaded;
+		Worker( MemberQueue &_queue, const std::string &_tarname, const std::string &_dialect ): queue( _queue ), tarname( _tarname ), dialect( _dialect ), loaded( 0 ) {}
+		void operator()() {
+			for( boost::shared_ptr<Member> member = queue.pop(); member; member = queue.pop() ) {
+				try {
+					loaded += loadMember( chunks[member->index], *member, tarname, dialect );
+				} catch( std::exception &e ) {
+					LOG( Runtime, error ) << "Failed to load " << member->name << " from " << tarname << " (" << e.what() << ")";
+				}
+			}
+		}
+	};
+
+	/// hand a member read into memory to the actual plugin
+	static int loadMember( std::list<data::Chunk> &chunks, const Member &member, const std::string &tarname, const std::string &dialect ) {
+		// the dialect is used as suffix override for the members, so we add it to the name the data is known by
+		const std::string name = dialect.empty() ? member.name.file_string() : member.name.file_string() + "." + dialect;
+		std::list<data::Chunk> loaded;
+		const int ret = data::IOFactory::load( loaded, member.data, name );
+
+		BOOST_FOREACH( data::Chunk & ref, loaded ) { // set the source property of the red chunks to something more usefull
+			ref.setPropertyAs( "source", ( boost::filesystem::path( tarname ) / member.name ).file_string() );
+		}
+		chunks.splice( chunks.end(), loaded );
+		return ret;
 	}
-public:
-	std::string dialects( const std::string &/*filename*/ )const {
 
-		std::list<util::istring> suffixes;
-		BOOST_FOREACH(data::IOFactory::FileFormatPtr format,data::IOFactory::getFormats()){
-			const std::list<util::istring> s=format->getSuffixes();
-			suffixes.insert(suffixes.end(),s.begin(),s.end());
+	/// entry of the index of a plain tar file
+	struct IndexEntry {
+		std::string name;
+		size_t offset, size;
+	};
+	typedef std::list<IndexEntry> Index;
+
+	/// deleter for a tar file mapped into memory
+	struct MapDeleter {
+		size_t m_length;
+		std::string m_filename;
+		MapDeleter( size_t length, const std::string &filename ): m_length( length ), m_filename( filename ) {}
+		void operator()( uint8_t *at ) {
+			LOG( Debug, info ) << "Unmapping " << util::MSubject( m_filename ) << " from " << ( void * )at;
+			munmap( at, m_length );
 		}
-		suffixes.sort();
-		suffixes.unique();
+	};
+	/// deleter for members of a mapped tar file (it keeps the whole mapping alive)
+	struct MemberDeleter {
+		data::ValuePtr<uint8_t> m_archive;
+		MemberDeleter( const data::ValuePtr<uint8_t> &archive ): m_archive( archive ) {}
+		void operator()( uint8_t * ) {}
+	};
+
+	/// walk through the headers of a tar file in memory and list all regular files
+	static Index makeIndex( const data::ValuePtr<uint8_t> &archive ) {
+		Index ret;
+		std::string longname;
+		size_t size, next_header_in;
 
-		return std::string(util::listToString(suffixes.begin(),suffixes.end()," ","",""));
+		for( size_t offset = 0; offset + 512 <= archive.getLength(); offset += 512 + next_header_in ) {
+			const tar_header &header = *reinterpret_cast<const tar_header *>( &archive[offset] );
+			parse_size( header, size, next_header_in );
+
+			if( offset + 512 + size > archive.getLength() ) {
+				LOG( Runtime, warning ) << "The tar file is truncated, ignoring everything after byte " << offset;
+				break;
+			}
+
+			if( header.typeflag == 'L' ) { // the filename of the next file is to long - so its stored in the block following this header
+				const char *name = reinterpret_cast<const char *>( &archive[offset + 512] );
+				longname = std::string( name, strnlen( name, size ) );
+			} else {
+				if( size && ( header.typeflag == AREGTYPE || header.typeflag == REGTYPE ) ) {
+					const IndexEntry entry = {longname.empty() ? member_name( header ).file_string() : longname, offset + 512, size};
+					ret.push_back( entry );
+				}
+
+				longname.clear();
+			}
+		}
+
+		return ret;
 	}
-	std::string getName()const {return "tar decompression proxy for other formats";}
 
-	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & ) {
-		int ret = 0;
+	/// the first line of the index file - if it differs from the one in the index file, the index is outdated (or belongs to another tar file)
+	static std::string indexHeader( const std::string &filename, const struct stat &st ) {
+		return std::string( "isis tar index 2 " ) + boost::lexical_cast<std::string>( st.st_size ) + " " + boost::lexical_cast<std::string>( st.st_mtime ) + " " +
+			   boost::filesystem::complete( filename ).file_string();
+	}
+	/// the index is stored in the cache directory of the IOFactory if there is one, next to the tar file otherwise
+	static std::string indexFile( const std::string &filename ) {
+		const boost::filesystem::path cachedir = data::IOFactory::getCacheDirectory();
+
+		if( cachedir.empty() ) {
+			return filename + ".idx";
+		} else {
+			std::ostringstream name;
+			name << std::hex << boost::hash<std::string>()( boost::filesystem::complete( filename ).file_string() ) << ".taridx";
+			return ( cachedir / name.str() ).file_string();
+		}
+	}
+	static bool readIndex( const std::string &indexfile, const std::string &filename, const struct stat &st, Index &index ) {
+		std::ifstream in( indexfile.c_str() );
+		std::string header;
+		size_t entries;
 
-		const util::istring suffix = makeBasename( filename ).second.c_str();
+		if( !std::getline( in, header ) || header != indexHeader( filename, st ) ) {
+			LOG_IF( in.is_open(), Runtime, info ) << "Ignoring outdated index " << util::MSubject( indexfile );
+			return false;
+		}
 
+		if( !( in >> entries ) || in.get() != '\n' ) {
+			LOG( Runtime, warning ) << "Ignoring broken index " << util::MSubject( indexfile );
+			return false;
+		}
 
-		// set up the input stream
-		std::ifstream input( filename.c_str(), std::ios_base::binary );
-		input.exceptions( std::ios::badbit );
-		boost::iostreams::filtering_istream in;
+		for( IndexEntry entry; in >> entry.offset >> entry.size && in.get() == ' ' && std::getline( in, entry.name ); ) {
+			if( entry.offset + entry.size > static_cast<size_t>( st.st_size ) ) {
+				LOG( Runtime, warning ) << "Ignoring broken index " << util::MSubject( indexfile );
+				return false;
+			}
 
-		if( suffix == ".tar.gz" || suffix == ".tgz" )
-			in.push( boost::iostreams::gzip_decompressor() );
-		else if( suffix == ".tar.bz2" || suffix == ".tbz" )
-			in.push( boost::iostreams::bzip2_decompressor() );
-		else if( suffix == ".tar.Z" || suffix == ".taz" )
-			in.push( boost::iostreams::zlib_decompressor() );
+			index.push_back( entry );
+		}
 
-		in.push( input );
+		if( !in.eof() || index.size() != entries ) { // the index was truncated (or is otherwise broken)
+			LOG( Runtime, warning ) << "Ignoring broken index " << util::MSubject( indexfile ) << " (got " << index.size() << " of " << entries << " entries)";
+			index.clear();
+			return false;
+		}
+
+		LOG( Debug, info ) << "Got " << index.size() << " entries from " << util::MSubject( indexfile );
+		return true;
+	}
+	/// write the index into a temporary file and rename it, so a concurrent load never sees a partial index
+	static void writeIndex( const std::string &indexfile, const std::string &filename, const struct stat &st, const Index &index ) {
+		std::ostringstream tmpname; // unique for every thread of every process
+		tmpname << indexfile << "." << getpid() << "." << boost::this_thread::get_id() << ".tmp";
+		const std::string tmpfile = tmpname.str();
+		std::ofstream out( tmpfile.c_str() );
+		out << indexHeader( filename, st ) << std::endl << index.size() << std::endl;
+		BOOST_FOREACH( const IndexEntry & entry, index ) {
+			out << entry.offset << " " << entry.size << " " << entry.name << std::endl;
+		}
+		out.close();
+
+		if( !out || rename( tmpfile.c_str(), indexfile.c_str() ) == -1 ) {
+			LOG( Runtime, info ) << "Could not write the index " << util::MSubject( indexfile ) << ", it will be regenerated on the next load";
+			unlink( tmpfile.c_str() );
+		}
+	}
+
+	/**
+	 * Map a plain tar file into memory and load the members directly from there.
+	 * The positions of the members are stored in an index file (see indexFile), so the headers don't have to be searched the next time.
+	 */
+	int loadIndexed( std::list<data::Chunk> &chunks, MemberQueue &queue, bool serial, const std::string &filename, const std::string &dialect ) {
+		const int file = open( filename.c_str(), O_RDONLY );
+		struct stat st;
+
+		if( file == -1 || fstat( file, &st ) == -1 ) {
+			const int err = errno;
 
+			if( file != -1 )
+				close( file );
+
+			throwSystemError( err, std::string( "Failed to open " ) + filename );
+		}
+
+		if( st.st_size == 0 ) {
+			close( file );
+			throwGenericError( filename + " is empty" );
+		}
+
+		// map it privately, so the plugins may change the data without touching the file
+		uint8_t *const mmem = ( uint8_t * )mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0 );
+		close( file ); // the mapping stays valid without the file
+
+		if( mmem == MAP_FAILED ) {
+			throwSystemError( errno, std::string( "Failed to map " ) + filename + " into memory" );
+		}
+
+		const data::ValuePtr<uint8_t> archive( mmem, st.st_size, MapDeleter( st.st_size, filename ) );
+		const std::string indexfile = indexFile( filename );
+		Index index;
+
+		if( !readIndex( indexfile, filename, st, index ) ) {
+			index = makeIndex( archive );
+			writeIndex( indexfile, filename, st, index );
+		}
+
+		int ret = 0;
+		BOOST_FOREACH( const IndexEntry & entry, index ) {
+			if( data::IOFactory::getFileFormatList( entry.name, dialect ).empty() ) {
+				LOG( Runtime, info ) << "Skipping " << entry.name << " from " << filename << " because no plugin was found to read it";
+				continue;
+			}
+
+			const boost::shared_ptr<Member> member( new Member( entry.name, data::ValuePtr<uint8_t>( mmem + entry.offset, entry.size, MemberDeleter( archive ) ) ) );
+
+			if( serial )
+				ret += loadMember( chunks, *member, filename, dialect );
+			else
+				queue.push( member );
+		}
+		return ret;
+	}
+
+	/// reads all members from the stream and loads them (if serial is true) or pushes them into the queue
+	int readMembers( boost::iostreams::filtering_istream &in, std::list<data::Chunk> &chunks, MemberQueue &queue, bool serial, const std::string &filename, const std::string &dialect ) {
+		int ret = 0;
+		tar_header header;
 		size_t size, next_header_in;
 
-		while( in.good() && read_header( in, size, next_header_in ) ) { //read the header block
+		while( in.good() && read_header( in, header, size, next_header_in ) ) { //read the header block
 
 			boost::filesystem::path org_file;
 
-			if( tar_header.typeflag == 'L' ) { // the filename of the next file is to long - so its stored in the next block (following this header)
+			if( header.typeflag == 'L' ) { // the filename of the next file is to long - so its stored in the next block (following this header)
 				char namebuff[size];
 				next_header_in -= tar_readstream( in, namebuff, size, "overlong filename for next entry" );
 				in.ignore( next_header_in ); // skip the remaining input until the next header
 				org_file = boost::filesystem::path( namebuff );
 				LOG( Debug, verbose_info ) << "Got overlong name " << util::MSubject( org_file.file_string() ) << " for next file.";
 
-				read_header( in, size, next_header_in ); //continue with the next header
+				read_header( in, header, size, next_header_in ); //continue with the next header
 			} else {
-				//get the original filename (use substr, because these fields are not \0-terminated)
-				org_file = boost::filesystem::path( std::string( tar_header.prefix ).substr( 0, 155 ) + std::string( tar_header.name ).substr( 0, 100 ) );
+				org_file = member_name( header );
 			}
 
 			if( size == 0 ) //if there is no content skip this entry (there are allways two "empty" blocks at the end of a tar)
 				continue;
 
-			if( tar_header.typeflag == AREGTYPE || tar_header.typeflag == REGTYPE ) {
+			if( header.typeflag == AREGTYPE || header.typeflag == REGTYPE ) {
 
 				data::IOFactory::FileFormatList formats = data::IOFactory::getFileFormatList( org_file.file_string(), dialect ); // and get the reading pluging for that
 
@@ -149,60 +393,133 @@ public:
 				} else {
 					LOG( Debug, info ) << "Got " << org_file << " from " << filename << " there are " << formats.size() << " plugins which should be able to read it";
 
-					const std::pair<std::string, std::string> base = formats.front()->makeBasename( org_file.file_string() );//ask any of the plugins for the suffix
-					util::TmpFile tmpfile( "", base.second );//create a temporary file with this suffix
-					int mfile = open( tmpfile.file_string().c_str(), O_RDWR, S_IRUSR | S_IWUSR );
+					uint8_t *buf = ( uint8_t * )malloc( size );
 
-					if( mfile == -1 ) {
-						throwSystemError( errno, std::string( "Failed to open temporary " ) + tmpfile.file_string() );
+					if( !buf ) {
+						throwGenericError( std::string( "Failed to allocate " ) + boost::lexical_cast<std::string>( size ) + " bytes for " + org_file.file_string() );
 					}
 
-					// set it to the given size - otherwise mmap will be very sad
-#ifdef HAVE_FALLOCATE
-					const int err = fallocate( mfile, 0, 0, size ); //fast preallocation using features of ome linux-filesystems
-#elif HAVE_POSIX_FALLOCATE
-					const int err = posix_fallocate( mfile, 0, size ); // slower posix compatible version
-#else
-					const int err = ( lseek( mfile, size - 1, SEEK_SET ) == off_t(size - 1) && ::write( mfile, " ", 1 ) ) ? 0 : errno; //workaround in case there is no fallocate
-#endif
-
-					if( err ) {
-						throwSystemError( err, std::string( "Failed grow " ) + tmpfile.file_string() + " to size " + boost::lexical_cast<std::string>( size ) );
-					}
+					const boost::shared_ptr<Member> member( new Member( org_file, data::ValuePtr<uint8_t>( buf, size ) ) ); // will be freed by the BasicDeleter
+					next_header_in -= tar_readstream( in, buf, size, org_file.file_string() ); // read data from the stream into memory
 
-					char *mmem = ( char * )mmap( NULL, size,  PROT_WRITE, MAP_SHARED, mfile, 0 ); //map it into memory
+					// and hand the memory to the actual plugin
+					if( serial )
+						ret += loadMember( chunks, *member, filename, dialect );
+					else
+						queue.push( member );
+				}
+			} else {
+				LOG( Debug, verbose_info ) << "Skipping " << org_file.file_string() << " because its no regular file (type is " << header.typeflag << ")" ;
+			}
 
-					if( mmem == MAP_FAILED ) {
-						throwSystemError( errno, std::string( "Failed to map temporary " ) + tmpfile.file_string() + " into memory" );
-					}
+			in.ignore( next_header_in ); // skip the remaining input until the next header
+		}
 
-					LOG( Debug, info ) << "Mapped " << size << " bytes of " << tmpfile.file_string() << " at " << ( void * )mmem;
+		return ret;
+	}
 
-					size_t red = boost::iostreams::read( in, mmem, size ); // read data from the stream into the mapped memory
-					next_header_in -= red;
+protected:
+	std::string suffixes()const {
+		return std::string( "tar tar.gz tgz tar.bz2 tbz tar.Z taz" );
+	}
+public:
+	std::string dialects( const std::string &/*filename*/ )const {
 
-					if( red != size ) { // read the data from the stream
-						LOG( Runtime, warning ) << "Could not read all " << size << " bytes for " << tmpfile.file_string();
-					}
+		std::list<util::istring> suffixes;
+		BOOST_FOREACH(data::IOFactory::FileFormatPtr format,data::IOFactory::getFormats()){
+			const std::list<util::istring> s=format->getSuffixes();
+			suffixes.insert(suffixes.end(),s.begin(),s.end());
+		}
+		suffixes.sort();
+		suffixes.unique();
 
-					//unmap and close the file
-					munmap( mmem, size );
-					close( mfile );
+		return std::string(util::listToString(suffixes.begin(),suffixes.end()," ","",""));
+	}
+	std::string getName()const {return "tar decompression proxy for other formats";}
 
-					// read the temporary file
-					std::list<data::Chunk>::iterator prev = chunks.end();
-					--prev;
-					ret += data::IOFactory::load( chunks, tmpfile.string(), dialect );
+	/// read the archive and either load its members directly (serial) or hand them to the workers through queue
+	int readArchive( std::list<data::Chunk> &chunks, MemberQueue &queue, bool serial, const std::string &filename, const std::string &dialect ) {
+		const util::istring suffix = makeBasename( filename ).second.c_str();
 
-					for( ; prev != chunks.end(); ++prev ) { // set the source property of the red chunks to something more usefull
-						prev->setPropertyAs( "source", ( boost::filesystem::path( filename ) / org_file ).file_string() );
-					}
-				}
+		if( suffix == ".tar" ) // plain tar files can be mapped directly
+			return loadIndexed( chunks, queue, serial, filename, dialect );
+
+		// set up the input stream
+		std::ifstream input( filename.c_str(), std::ios_base::binary );
+		input.exceptions( std::ios::badbit );
+		boost::iostreams::filtering_istream in;
+
+		if( suffix == ".tar.gz" || suffix == ".tgz" )
+			in.push( boost::iostreams::gzip_decompressor() );
+		else if( suffix == ".tar.bz2" || suffix == ".tbz" )
+			in.push( boost::iostreams::bzip2_decompressor() );
+		else if( suffix == ".tar.Z" || suffix == ".taz" )
+			in.push( boost::iostreams::zlib_decompressor() );
+
+		in.push( input );
+		return readMembers( in, chunks, queue, serial, filename, dialect );
+	}
+
+	/// runs the reader of the archive (index 0) and the workers (all other indices) in the thread pool
+	struct LoadOp {
+		ImageFormat_TarProxy &format;
+		std::list<data::Chunk> &chunks;
+		MemberQueue &queue;
+		std::vector<Worker *> &workers;
+		const std::string &filename, &dialect;
+		int read;
+		LoadOp( ImageFormat_TarProxy &_format, std::list<data::Chunk> &_chunks, MemberQueue &_queue, std::vector<Worker *> &_workers, const std::string &_filename, const std::string &_dialect ):
+			format( _format ), chunks( _chunks ), queue( _queue ), workers( _workers ), filename( _filename ), dialect( _dialect ), read( 0 ) {}
+		void operator()( size_t i ) {
+			if( i ) {
+				( *workers[i - 1] )();
 			} else {
-				LOG( Debug, verbose_info ) << "Skipping " << org_file.file_string() << " because its no regular file (type is " << tar_header.typeflag << ")" ;
+				// the workers wait for the queue to be closed, so it has to be closed whatever happens here
+				try {
+					read = format.readArchive( chunks, queue, false, filename, dialect );
+				} catch( ... ) {
+					queue.close();
+					throw;
+				}
+
+				queue.close();
 			}
+		}
+	};
 
-			in.ignore( next_header_in ); // skip the remaining input until the next header
+	int load ( std::list<data::Chunk> &chunks, const std::string &filename, const std::string &dialect ) throw( std::runtime_error & ) {
+		// use the thread pool if it has more than one thread (and we're not running inside of it already)
+		// then one thread reads the archive while all others parse the members in parallel
+		const size_t nthreads = util::ThreadPool::inWorker() ? 1 : util::ThreadPool::get().getThreads();
+
+		if( nthreads < 2 ) {
+			MemberQueue queue( 1 ); // not used
+			return readArchive( chunks, queue, true, filename, dialect );
+		}
+
+		LOG( Debug, info ) << "Using " << nthreads << " threads to load the members of " << util::MSubject( filename );
+		MemberQueue queue( nthreads * 2 );
+		std::list<Worker> workers( nthreads - 1, Worker( queue, filename, dialect ) );
+		std::vector<Worker *> workerPtrs;
+		BOOST_FOREACH( Worker & ref, workers ) {
+			workerPtrs.push_back( &ref );
+		}
+		LoadOp op( *this, chunks, queue, workerPtrs, filename, dialect );
+		util::ThreadPool::get().parallel_for( 0, nthreads, op, 1 ); // index 0 is handed out first, so the reader runs in any case
+		int ret = op.read;
+
+		// the members were loaded in arbitrary order, so merge the chunks in the order of the members in the archive
+		ChunksByMember merged;
+		BOOST_FOREACH( Worker & ref, workers ) {
+			ret += ref.loaded;
+
+			for( ChunksByMember::iterator i = ref.chunks.begin(); i != ref.chunks.end(); ++i ) {
+				merged[i->first].swap( i->second ); // every member was loaded by exactly one worker
+			}
+		}
+
+		for( ChunksByMember::iterator i = merged.begin(); i != merged.end(); ++i ) {
+			chunks.splice( chunks.end(), i->second );
 		}
 
 		return ret;
@@ -17,8 +17,8 @@
 namespace isis
 {
 
-struct PythonLog {static const char *name() {return "Python";}; enum {use = _ENABLE_LOG};};
-struct PythonDebug {static const char *name() {return "PythonDebug";}; enum {use = _ENABLE_DEBUG};};
+struct PythonLog {static const char *name() {return "Python";}; enum {use = _ENABLE_LOG, maxLevel = _LOG_MAX_LEVEL};};
+struct PythonDebug {static const char *name() {return "PythonDebug";}; enum {use = _ENABLE_DEBUG, maxLevel = _DEBUG_MAX_LEVEL};};
 
 namespace python
 {
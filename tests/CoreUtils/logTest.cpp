@@ -0,0 +1,138 @@
+#define BOOST_TEST_MODULE LogTest
+#define NOMINMAX 1
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <CoreUtils/log.hpp>
+#include <CoreUtils/common.hpp>
+#include <CoreUtils/threadpool.hpp>
+
+namespace isis
+{
+namespace test
+{
+
+// Handlers must not be local classes
+class CountHandler : public util::_internal::MessageHandlerBase
+{
+public:
+	static size_t hit, inside, maxInside;
+	CountHandler( LogLevel level ): util::_internal::MessageHandlerBase( level ) {}
+	virtual ~CountHandler() {}
+	void commit( const util::_internal::Message &mesg ) {
+		// commits are serialized, so this does not need to be thread safe
+		maxInside = std::max( ++inside, maxInside );
+
+		if ( mesg.str() == "message from the loop" )
+			hit++;
+
+		boost::this_thread::yield();
+		--inside;
+	}
+};
+size_t CountHandler::hit = 0, CountHandler::inside = 0, CountHandler::maxInside = 0;
+
+struct SendSome {
+	void operator()( size_t i ) {
+		LOG( CoreLog, warning ) << "message from the loop";
+		LOG( CoreLog, info ) << "filtered message " << i;
+
+		if( i % 100 == 0 ) // replace the handler meanwhile
+			util::_internal::Log<CoreLog>::setHandler( boost::shared_ptr<util::_internal::MessageHandlerBase>( new CountHandler( warning ) ) );
+	}
+};
+
+// modules of applications don't have to define a compile time limit
+struct NoLimitLog {static const char *name() {return "NoLimit";}; enum {use = 1};};
+struct LimitedLog {static const char *name() {return "Limited";}; enum {use = 1, maxLevel = warning};};
+
+struct Evaluated {
+	static size_t count;
+};
+size_t Evaluated::count = 0;
+std::ostream &operator<<( std::ostream &o, const Evaluated & )
+{
+	Evaluated::count++;
+	return o;
+}
+
+template<int N> struct SlowSingleton {
+	static size_t created;
+	SlowSingleton() {
+		created++;
+		boost::this_thread::sleep( boost::posix_time::milliseconds( 10 ) );
+	}
+};
+template<int N> size_t SlowSingleton<N>::created = 0;
+
+struct GetSingletons {
+	std::vector<void *> &m_got;
+	GetSingletons( std::vector<void *> &got ): m_got( got ) {}
+	void operator()( size_t i ) {
+		m_got[i] = &util::Singletons::get<SlowSingleton<1>, 10>();
+		util::Singletons::get<SlowSingleton<2>, 10>(); // create some other singletons at the same time
+		util::Singletons::get<SlowSingleton<3>, 10>();
+	}
+};
+
+BOOST_AUTO_TEST_CASE( log_concurrent_test )
+{
+	util::ThreadPool::get().setThreads( 4 );
+	ENABLE_LOG( CoreLog, CountHandler, warning );
+	util::ThreadPool::get().parallel_for( 0, 1000, SendSome(), 10 );
+	ENABLE_LOG( CoreLog, util::DefaultMsgPrint, warning );
+
+	if( CoreLog::use ) {
+		BOOST_CHECK_EQUAL( CountHandler::hit, 1000 );
+		BOOST_CHECK_EQUAL( CountHandler::maxInside, 1 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( log_gate_test )
+{
+	ENABLE_LOG( CoreLog, CountHandler, warning );
+	BOOST_CHECK( util::_internal::Log<CoreLog>::enabled( warning ) );
+	BOOST_CHECK( !util::_internal::Log<CoreLog>::enabled( info ) );
+
+	// filtered messages are not even created, so their arguments are not evaluated
+	LOG( CoreLog, info ) << "filtered " << Evaluated();
+	LOG_IF( true, CoreLog, verbose_info ) << "filtered " << Evaluated();
+	BOOST_CHECK_EQUAL( Evaluated::count, 0 );
+
+	LOG( CoreLog, warning ) << "not filtered " << Evaluated();
+	BOOST_CHECK_EQUAL( Evaluated::count, CoreLog::use ? 1 : 0 );
+
+	ENABLE_LOG( CoreLog, CountHandler, verbose_info );
+	BOOST_CHECK_EQUAL( util::_internal::Log<CoreLog>::enabled( verbose_info ), bool( CoreLog::use ) );
+	ENABLE_LOG( CoreLog, util::DefaultMsgPrint, warning );
+}
+
+BOOST_AUTO_TEST_CASE( log_maxlevel_test )
+{
+	BOOST_CHECK_EQUAL( int( util::_internal::LogMaxLevel<NoLimitLog>::value ), INT_MAX );
+	BOOST_CHECK_EQUAL( int( util::_internal::LogMaxLevel<LimitedLog>::value ), int( warning ) );
+
+	ENABLE_LOG( NoLimitLog, CountHandler, verbose_info );
+	ENABLE_LOG( LimitedLog, CountHandler, verbose_info );
+	BOOST_CHECK( LOG_ENABLED( NoLimitLog, verbose_info ) );
+	BOOST_CHECK( LOG_ENABLED( LimitedLog, warning ) );
+	BOOST_CHECK( !LOG_ENABLED( LimitedLog, info ) ); // the handler would take it, but the module doesn't allow it
+}
+
+BOOST_AUTO_TEST_CASE( singleton_concurrent_test )
+{
+	util::ThreadPool::get().setThreads( 4 );
+	std::vector<void *> got( 20, ( void * )0 );
+	util::ThreadPool::get().parallel_for( 0, got.size(), GetSingletons( got ), 1 );
+
+	BOOST_CHECK_EQUAL( SlowSingleton<1>::created, 1 );
+	BOOST_CHECK_EQUAL( SlowSingleton<2>::created, 1 );
+	BOOST_CHECK_EQUAL( SlowSingleton<3>::created, 1 );
+
+	void *const first = &util::Singletons::get<SlowSingleton<1>, 10>();
+
+	for( size_t i = 0; i < got.size(); i++ )
+		BOOST_CHECK_EQUAL( got[i], first );
+}
+
+}
+}
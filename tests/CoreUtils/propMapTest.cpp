@@ -12,6 +12,8 @@
 #include <CoreUtils/propmap.hpp>
 #include <CoreUtils/vector.hpp>
 #include <string>
+#include <sstream>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 namespace isis
 {
@@ -155,5 +157,101 @@ BOOST_AUTO_TEST_CASE( propMap_transform_test )
 	BOOST_CHECK_EQUAL( map.propertyValue( "Test1int" ), ( int32_t )6 );
 	BOOST_CHECK_EQUAL( map.propertyValue( "Test3int" ), util::ivector4( 1, 1, 1, 1 ) );
 }
+BOOST_AUTO_TEST_CASE( propMap_binary_test )
+{
+	util::PropertyMap map;
+	util::Selection sel( "one,two,three" );
+	sel.set( "two" );
+	const boost::posix_time::ptime timestamp( boost::gregorian::date( 2011, 7, 14 ), boost::posix_time::time_duration( 13, 37, 42, 123 ) );
+	const char *strings[] = {"Hallo", "", "Welt"};
+
+	map.propertyValue( "bool" ) = util::Value<bool>( true ); // a plain bool would select the "needed"-constructor of PropertyValue
+	map.propertyValue( "int8" ) = ( int8_t ) - 5;
+	map.propertyValue( "uint64" ) = std::numeric_limits<uint64_t>::max();
+	map.propertyValue( "double" ) = 1. / 3;
+	map.propertyValue( "fvector" ) = util::fvector4( 1.5, -2, 3, 0.1 );
+	map.propertyValue( "ivector" ) = util::ivector4( 1, -2, 3, 4 );
+	map.propertyValue( "slist" ) = util::slist( strings, strings + 3 );
+	map.propertyValue( "dlist" ) = util::dlist( 3, 1. / 7 );
+	map.propertyValue( "string" ) = std::string( "Hallo Welt" );
+	map.propertyValue( "selection" ) = sel;
+	map.propertyValue( "complex" ) = std::complex<float>( 1, -1 );
+	map.propertyValue( "sub/date" ) = timestamp.date();
+	map.propertyValue( "sub/timestamp" ) = timestamp;
+	map.propertyValue( "special/nodate" ) = boost::gregorian::date( boost::date_time::not_a_date_time );
+	map.propertyValue( "special/infinitedate" ) = boost::gregorian::date( boost::date_time::neg_infin );
+	map.propertyValue( "special/notime" ) = boost::posix_time::ptime( boost::date_time::not_a_date_time );
+	map.propertyValue( "special/infinitetime" ) = boost::posix_time::ptime( boost::date_time::pos_infin );
+
+	std::stringstream buff;
+	map.writeBinary( buff );
+
+	util::PropertyMap read;
+	BOOST_REQUIRE( read.readBinary( buff ) );
+	BOOST_CHECK( map.getDifference( read ).empty() );
+
+	// the types must not change
+	BOOST_CHECK( read.propertyValue( "bool" )->is<bool>() );
+	BOOST_CHECK( read.propertyValue( "int8" )->is<int8_t>() );
+	BOOST_CHECK( read.propertyValue( "uint64" )->is<uint64_t>() );
+	BOOST_CHECK( read.propertyValue( "fvector" )->is<util::fvector4>() );
+	BOOST_CHECK( read.propertyValue( "slist" )->is<util::slist>() );
+	BOOST_CHECK( read.propertyValue( "selection" )->is<util::Selection>() );
+	BOOST_CHECK( read.propertyValue( "sub/timestamp" )->is<boost::posix_time::ptime>() );
+
+	// values must be exact (no string conversion in between)
+	BOOST_CHECK_EQUAL( read.getPropertyAs<uint64_t>( "uint64" ), std::numeric_limits<uint64_t>::max() );
+	BOOST_CHECK_EQUAL( read.getPropertyAs<double>( "double" ), 1. / 3 );
+	BOOST_CHECK_EQUAL( read.getPropertyAs<util::slist>( "slist" ), util::slist( strings, strings + 3 ) );
+	BOOST_CHECK_EQUAL( read.getPropertyAs<util::dlist>( "dlist" ), util::dlist( 3, 1. / 7 ) );
+	BOOST_CHECK_EQUAL( read.getPropertyAs<boost::posix_time::ptime>( "sub/timestamp" ), timestamp );
+	BOOST_CHECK_EQUAL( read.getPropertyAs<util::Selection>( "selection" ), sel );
+	BOOST_CHECK_EQUAL( ( int )read.getPropertyAs<util::Selection>( "selection" ), 2 );
+
+	// special dates and timestamps
+	BOOST_CHECK( read.getPropertyAs<boost::gregorian::date>( "special/nodate" ).is_not_a_date() );
+	BOOST_CHECK( read.getPropertyAs<boost::gregorian::date>( "special/infinitedate" ).is_neg_infinity() );
+	BOOST_CHECK( read.getPropertyAs<boost::posix_time::ptime>( "special/notime" ).is_not_a_date_time() );
+	BOOST_CHECK( read.getPropertyAs<boost::posix_time::ptime>( "special/infinitetime" ).is_pos_infinity() );
+
+	// empty needed properties must be kept (getDifference never considers empty properties equal, so check them separately)
+	util::PropertyMap invalid, readInvalid;
+	invalid.propertyValue( "sub/subsub/empty" ).needed() = true;
+	std::stringstream invalidBuff;
+	invalid.writeBinary( invalidBuff );
+	BOOST_REQUIRE( readInvalid.readBinary( invalidBuff ) );
+	BOOST_CHECK( readInvalid.propertyValue( "sub/subsub/empty" ).isEmpty() );
+	BOOST_CHECK( readInvalid.propertyValue( "sub/subsub/empty" ).isNeeded() );
+	BOOST_CHECK( !readInvalid.isValid() );
+
+	// reading into a map replaces existing properties, also by empty ones or branches
+	util::PropertyMap overwrite;
+	overwrite.setPropertyAs<int32_t>( "int8", 5 );
+	overwrite.setPropertyAs<int32_t>( "sub", 5 );
+	overwrite.setPropertyAs<int32_t>( "string/sub", 5 );
+	overwrite.setPropertyAs<int32_t>( "special/other", 5 );
+	buff.clear();
+	buff.seekg( 0 );
+	BOOST_REQUIRE( overwrite.readBinary( buff ) );
+	BOOST_CHECK( overwrite.propertyValue( "int8" )->is<int8_t>() );
+	BOOST_CHECK( overwrite.propertyValue( "sub/timestamp" )->is<boost::posix_time::ptime>() );
+	BOOST_CHECK( !overwrite.hasBranch( "string" ) );
+	BOOST_CHECK_EQUAL( overwrite.getPropertyAs<std::string>( "string" ), "Hallo Welt" );
+	BOOST_CHECK_EQUAL( overwrite.getPropertyAs<int32_t>( "special/other" ), 5 ); // branches are merged
+	overwrite.setPropertyAs<int32_t>( "sub/subsub/empty", 5 );
+	invalidBuff.clear();
+	invalidBuff.seekg( 0 );
+	BOOST_REQUIRE( overwrite.readBinary( invalidBuff ) );
+	BOOST_CHECK( overwrite.propertyValue( "sub/subsub/empty" ).isEmpty() );
+
+	// anything else must be rejected
+	std::stringstream garbage( "garbage" );
+	BOOST_CHECK( !util::PropertyMap().readBinary( garbage ) );
+
+	// truncated data must be rejected
+	const std::string data = buff.str();
+	std::stringstream truncated( data.substr( 0, data.size() / 2 ) );
+	BOOST_CHECK( !util::PropertyMap().readBinary( truncated ) );
+}
+}
 }
-}
\ No newline at end of file
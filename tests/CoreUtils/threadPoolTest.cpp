@@ -0,0 +1,133 @@
+#define BOOST_TEST_MODULE ThreadPoolTest
+#define NOMINMAX 1
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <CoreUtils/threadpool.hpp>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+
+namespace isis
+{
+namespace test
+{
+
+struct Mark {
+	std::vector<int> &m_hits;
+	Mark( std::vector<int> &hits ): m_hits( hits ) {}
+	void operator()( size_t i ) {m_hits[i]++;}
+};
+
+// counts how many threads are inside the loop at once, and runs a nested loop
+struct Busy {
+	size_t &m_active, &m_maxActive;
+	bool &m_wasInWorker;
+	boost::mutex &m_mutex;
+	Busy( size_t &active, size_t &maxActive, bool &wasInWorker, boost::mutex &mutex ): m_active( active ), m_maxActive( maxActive ), m_wasInWorker( wasInWorker ), m_mutex( mutex ) {}
+	void operator()( size_t ) {
+		{
+			boost::mutex::scoped_lock lock( m_mutex );
+			m_maxActive = std::max( ++m_active, m_maxActive );
+			m_wasInWorker &= util::ThreadPool::inWorker();
+		}
+		std::vector<int> hits( 100, 0 );
+		util::ThreadPool::get().parallel_for( 0, hits.size(), Mark( hits ) );
+		boost::this_thread::sleep( boost::posix_time::milliseconds( 1 ) );
+		boost::mutex::scoped_lock lock( m_mutex );
+		--m_active;
+	}
+};
+
+struct Fail {
+	void operator()( size_t i ) {
+		if( i == 17 || i == 900 )
+			throw std::runtime_error( "failed at " + boost::lexical_cast<std::string>( i ) );
+	}
+};
+
+struct FailOdd {
+	void operator()( size_t i ) {
+		if( i == 3 )
+			throw 3;
+	}
+};
+
+BOOST_AUTO_TEST_CASE( threadpool_for_test )
+{
+	util::ThreadPool &pool = util::ThreadPool::get();
+	pool.setThreads( 4 );
+	BOOST_CHECK_EQUAL( pool.getThreads(), 4 );
+	BOOST_CHECK( !util::ThreadPool::inWorker() );
+
+	std::vector<int> hits( 10000, 0 );
+	pool.parallel_for( 0, hits.size(), Mark( hits ) );
+
+	for( size_t i = 0; i < hits.size(); i++ )
+		BOOST_REQUIRE_EQUAL( hits[i], 1 );
+
+	pool.parallel_for( 100, 200, Mark( hits ), 7 ); // only the given range, in portions of 7
+
+	for( size_t i = 0; i < hits.size(); i++ )
+		BOOST_REQUIRE_EQUAL( hits[i], ( i >= 100 && i < 200 ) ? 2 : 1 );
+
+	pool.setThreads( 1 ); // serial
+	pool.parallel_for( 0, hits.size(), Mark( hits ) );
+	BOOST_CHECK_EQUAL( hits[0], 2 );
+	pool.setThreads( 0 );
+	BOOST_CHECK( pool.getThreads() >= 1 );
+}
+
+BOOST_AUTO_TEST_CASE( threadpool_nested_test )
+{
+	util::ThreadPool &pool = util::ThreadPool::get();
+	pool.setThreads( 3 );
+	size_t active = 0, maxActive = 0;
+	bool wasInWorker = true;
+	boost::mutex mutex;
+
+	pool.parallel_for( 0, 50, Busy( active, maxActive, wasInWorker, mutex ), 1 );
+	BOOST_CHECK( wasInWorker );
+	BOOST_CHECK( maxActive <= 3 );
+	BOOST_CHECK( !util::ThreadPool::inWorker() );
+}
+
+BOOST_AUTO_TEST_CASE( threadpool_exception_test )
+{
+	util::ThreadPool &pool = util::ThreadPool::get();
+	pool.setThreads( 4 );
+
+	try {
+		pool.parallel_for( 0, 1000, Fail(), 1000 ); // one portion, so 17 is the first index that throws
+		BOOST_FAIL( "parallel_for should have thrown" );
+	} catch( const std::runtime_error &e ) {
+		BOOST_CHECK_EQUAL( std::string( e.what() ), "failed at 17" );
+	}
+
+	// the pool still works afterwards
+	std::vector<int> hits( 1000, 0 );
+	pool.parallel_for( 0, hits.size(), Mark( hits ) );
+	BOOST_CHECK_EQUAL( std::count( hits.begin(), hits.end(), 1 ), 1000 );
+
+	// serial loops report errors the same way
+	pool.setThreads( 1 );
+
+	try {
+		pool.parallel_for( 0, 1000, Fail() );
+		BOOST_FAIL( "parallel_for should have thrown" );
+	} catch( const std::runtime_error &e ) {
+		BOOST_CHECK_EQUAL( std::string( e.what() ), "failed at 17" );
+	}
+
+	try {
+		pool.parallel_for( 0, 10, FailOdd() );
+		BOOST_FAIL( "parallel_for should have thrown" );
+	} catch( const std::runtime_error &e ) {
+		BOOST_CHECK_EQUAL( std::string( e.what() ), "unknown exception" );
+	}
+
+	pool.setThreads( 0 );
+}
+
+}
+}
@@ -0,0 +1,187 @@
+/*
+* chunkCacheTest.cpp
+*
+* Description: TestSuite for the on-disk chunk cache of the IOFactory
+*/
+
+#define BOOST_TEST_MODULE ChunkCacheTest
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <DataStorage/chunk_cache.hpp>
+#include <CoreUtils/tmpfile.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace isis
+{
+namespace test
+{
+
+/// a directory with a chunk cache in it, which is removed afterwards
+struct CacheFixture {
+	util::TmpFile dir;
+	data::_internal::ChunkCache cache;
+	CacheFixture() {
+		boost::filesystem::remove( dir );
+		cache.setDirectory( dir );
+	}
+	~CacheFixture() {
+		boost::filesystem::remove_all( dir );
+		boost::filesystem::create_directory( dir ); // so TmpFile finds something to delete
+	}
+	/// \returns the size of the cache file (there must be only one)
+	uintmax_t cacheFileSize() {
+		std::list<boost::filesystem::path> files( ( boost::filesystem::directory_iterator( dir ) ), boost::filesystem::directory_iterator() );
+		BOOST_REQUIRE_EQUAL( files.size(), 1 );
+		return boost::filesystem::file_size( files.front() );
+	}
+};
+
+void writeFile( const boost::filesystem::path &file, const std::string &content )
+{
+	std::ofstream out( file.file_string().c_str(), std::ios::binary | std::ios::trunc );
+	out.write( content.data(), content.length() );
+}
+
+/// a chunk mapping the given file, like plugins for uncompressed formats do it
+class MappedChunk: public data::Chunk
+{
+	struct Unmap {
+		size_t length;
+		void operator()( int16_t *at ) {munmap( at, length );}
+	};
+	static int16_t *map( const boost::filesystem::path &file, size_t length ) {
+		const int fd = open( file.file_string().c_str(), O_RDONLY );
+		void *ret = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+		close( fd );
+		BOOST_REQUIRE( ret != MAP_FAILED );
+		return static_cast<int16_t *>( ret );
+	}
+	static Unmap unmap( size_t length ) {
+		const Unmap ret = {length};
+		return ret;
+	}
+public:
+	MappedChunk( const boost::filesystem::path &file, size_t columns, size_t rows ):
+		data::Chunk( map( file, columns * rows * sizeof( int16_t ) ), unmap( columns * rows * sizeof( int16_t ) ), columns, rows ) {}
+};
+
+data::MemChunk<int16_t> makeChunk()
+{
+	data::MemChunk<int16_t> ret( 64, 32 );
+
+	for( size_t y = 0; y < 32; y++ )
+		for( size_t x = 0; x < 64; x++ )
+			ret.voxel<int16_t>( x, y ) = y * 64 + x;
+
+	ret.setPropertyAs( "indexOrigin", util::fvector4( 1, 2, 3 ) );
+	ret.setPropertyAs( "voxelSize", util::fvector4( 1, 1, 1 ) );
+	ret.setPropertyAs( "rowVec", util::fvector4( 1, 0, 0 ) );
+	ret.setPropertyAs( "columnVec", util::fvector4( 0, 1, 0 ) );
+	ret.setPropertyAs( "acquisitionNumber", ( uint32_t )5 );
+	ret.setPropertyAs( "sequenceDescription", std::string( "cached" ) );
+	return ret;
+}
+
+void checkRestored( const data::Chunk &org, const data::Chunk &restored )
+{
+	BOOST_REQUIRE_EQUAL( restored.getSizeAsVector(), org.getSizeAsVector() );
+	BOOST_REQUIRE( restored.getTypeID() == org.getTypeID() );
+	BOOST_CHECK( restored.getDifference( org ).empty() );
+
+	for( size_t y = 0; y < org.getSizeAsVector()[1]; y++ )
+		for( size_t x = 0; x < org.getSizeAsVector()[0]; x++ )
+			BOOST_CHECK_EQUAL( restored.voxel<int16_t>( x, y ), org.voxel<int16_t>( x, y ) );
+}
+
+BOOST_FIXTURE_TEST_SUITE( chunk_cache_test, CacheFixture )
+
+BOOST_AUTO_TEST_CASE( cache_hit_test )
+{
+	util::TmpFile source( "", ".test" );
+	writeFile( source, "some file the chunk was loaded from" );
+	std::list<data::Chunk> chunks( 1, makeChunk() ), restored;
+
+	cache.store( chunks.begin(), chunks.end(), source, "", "" );
+	BOOST_CHECK_GT( cacheFileSize(), chunks.front().getVolume() * sizeof( int16_t ) ); // the voxels are not in the source, so they must be copied
+
+	BOOST_REQUIRE_EQUAL( cache.load( restored, source, "", "" ), 1 );
+	BOOST_REQUIRE_EQUAL( restored.size(), 1 );
+	checkRestored( chunks.front(), restored.front() );
+}
+
+BOOST_AUTO_TEST_CASE( cache_miss_test )
+{
+	util::TmpFile source( "", ".test" ), other( "", ".test" );
+	writeFile( source, "some file the chunk was loaded from" );
+	std::list<data::Chunk> chunks( 1, makeChunk() ), restored;
+
+	BOOST_CHECK_EQUAL( cache.load( restored, source, "", "" ), 0 ); // nothing stored yet
+	cache.store( chunks.begin(), chunks.end(), source, "", "" );
+
+	BOOST_CHECK_EQUAL( cache.load( restored, other, "", "" ), 0 ); // another file
+	BOOST_CHECK_EQUAL( cache.load( restored, source, "", "dialect" ), 0 ); // same file loaded with another dialect
+	BOOST_CHECK_EQUAL( cache.load( restored, source, "nii", "" ), 0 ); // same file loaded with a suffix override
+	BOOST_CHECK( restored.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( cache_invalidation_test )
+{
+	util::TmpFile source( "", ".test" );
+	writeFile( source, "some file the chunk was loaded from" );
+	std::list<data::Chunk> chunks( 1, makeChunk() ), restored;
+	cache.store( chunks.begin(), chunks.end(), source, "", "" );
+	BOOST_REQUIRE_EQUAL( cache.load( restored, source, "", "" ), 1 );
+	restored.clear();
+
+	// the modification time changed
+	const std::time_t mtime = boost::filesystem::last_write_time( source );
+	boost::filesystem::last_write_time( source, mtime + 10 );
+	BOOST_CHECK_EQUAL( cache.load( restored, source, "", "" ), 0 );
+
+	// the size changed
+	cache.store( chunks.begin(), chunks.end(), source, "", "" );
+	writeFile( source, "some other file the chunk was loaded from" );
+	boost::filesystem::last_write_time( source, mtime + 10 );
+	BOOST_CHECK_EQUAL( cache.load( restored, source, "", "" ), 0 );
+	BOOST_CHECK( restored.empty() );
+}
+
+BOOST_AUTO_TEST_CASE( cache_reference_test )
+{
+	const data::MemChunk<int16_t> org = makeChunk();
+	const size_t length = org.getVolume() * sizeof( int16_t );
+	util::TmpFile source( "", ".test" );
+	writeFile( source, std::string( static_cast<const char *>( org.getValuePtrBase().getRawAddress().lock().get() ), length ) );
+
+	// voxel data which are a mapping of the source are only referenced
+	std::list<data::Chunk> chunks( 1, MappedChunk( source, 64, 32 ) ), restored;
+	chunks.front().join( org );
+	cache.store( chunks.begin(), chunks.end(), source, "", "" );
+	BOOST_CHECK_LT( cacheFileSize(), length );
+
+	BOOST_REQUIRE_EQUAL( cache.load( restored, source, "", "" ), 1 );
+	checkRestored( org, restored.front() );
+
+	// also if they were written to, but are still the same
+	chunks.front().voxel<int16_t>( 0, 0 ) = org.voxel<int16_t>( 0, 0 );
+	cache.store( chunks.begin(), chunks.end(), source, "", "" );
+	BOOST_CHECK_LT( cacheFileSize(), length );
+
+	// but not if they where changed after mapping
+	chunks.front().voxel<int16_t>( 0, 0 ) = -1;
+	cache.store( chunks.begin(), chunks.end(), source, "", "" );
+	BOOST_CHECK_GT( cacheFileSize(), length );
+	restored.clear();
+	BOOST_REQUIRE_EQUAL( cache.load( restored, source, "", "" ), 1 );
+	BOOST_CHECK_EQUAL( restored.front().voxel<int16_t>( 0, 0 ), -1 );
+	BOOST_CHECK_EQUAL( restored.front().voxel<int16_t>( 1, 0 ), 1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
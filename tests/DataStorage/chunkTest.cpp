@@ -90,6 +90,51 @@ BOOST_AUTO_TEST_CASE ( chunk_foreach_voxel_test )
 	BOOST_CHECK_EQUAL( ch.foreachVoxel( check ), 0 ); // now they all should be
 }
 
+// functors for the statically dispatched foreach functions (must not be local types)
+struct SetLinearIndex {
+	data::_internal::NDimensional<4> geometry;
+	SetLinearIndex( const data::_internal::NDimensional<4> &geo ): geometry( geo ) {}
+	bool operator()( uint8_t &vox, const util::FixedVector< size_t, 4 >& pos ) {
+		vox = geometry.getLinearIndex( &pos[0] );
+		return pos[data::rowDim] != 0; // fail for the first voxel of every line
+	}
+};
+struct Sum {
+	size_t sum;
+	Sum(): sum( 0 ) {}
+	void operator()( const uint8_t &vox ) {sum += vox;}
+	void operator()( const uint8_t *begin, const uint8_t *end ) {
+		for( ; begin != end; ++begin )
+			sum += *begin;
+	}
+};
+struct Double {
+	void operator()( uint8_t &vox ) {vox *= 2;}
+};
+
+BOOST_AUTO_TEST_CASE ( chunk_foreach_inlined_test )
+{
+	data::MemChunk<uint8_t> ch( 4, 3, 2, 1 );
+	SetLinearIndex set( ch );
+	BOOST_CHECK_EQUAL( ch.foreachVoxelInlined<uint8_t>( set ), 3 * 2 );
+
+	for( size_t i = 0; i < ch.getVolume(); i++ )
+		BOOST_CHECK_EQUAL( ch.asValuePtr<uint8_t>()[i], i );
+
+	Sum sum, spanSum;
+	const size_t expected = ( ch.getVolume() - 1 ) * ch.getVolume() / 2;
+	static_cast<const data::Chunk &>( ch ).foreachValue<uint8_t>( sum );
+	ch.foreachSpan<uint8_t>( spanSum );
+	BOOST_CHECK_EQUAL( sum.sum, expected );
+	BOOST_CHECK_EQUAL( spanSum.sum, expected );
+
+	Double twice;
+	ch.foreachValue<uint8_t>( twice );
+	sum = Sum();
+	ch.foreachValue<uint8_t>( sum );
+	BOOST_CHECK_EQUAL( sum.sum, expected * 2 );
+}
+
 BOOST_AUTO_TEST_CASE ( chunk_mem_init_test )
 {
 	const short data[3*3] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
@@ -271,6 +316,134 @@ BOOST_AUTO_TEST_CASE ( chunk_splice_test )//Copy chunks
 	}
 }
 
+BOOST_AUTO_TEST_CASE ( chunk_view_test )
+{
+	data::MemChunk<int16_t> ch( 4, 3, 2 );
+	ch.setPropertyAs( "indexOrigin", util::fvector4( 1, 1, 1 ) );
+	ch.setPropertyAs( "rowVec", util::fvector4( 1, 0, 0 ) );
+	ch.setPropertyAs( "columnVec", util::fvector4( 0, 1, 0 ) );
+	ch.setPropertyAs( "voxelSize", util::fvector4( 1, 1, 1 ) );
+	ch.setPropertyAs( "voxelGap", util::fvector4( 1, 1, 1 ) );
+	ch.setPropertyAs<uint32_t>( "acquisitionNumber", 0 );
+
+	for ( size_t i = 0; i < ch.getVolume(); i++ )
+		ch.asValuePtr<int16_t>()[i] = i;
+
+	BOOST_CHECK( ch.getView().isContiguous() );
+
+	// a sagittal slice (not contiguous, and no copy)
+	const size_t start[] = {2, 0, 0, 0}, size[] = {1, 3, 2, 1};
+	data::ChunkView sagittal = ch.getView( start, size );
+	BOOST_CHECK( !sagittal.isContiguous() );
+	BOOST_CHECK_EQUAL( sagittal.getSizeAsString(), "1x3x2x1" );
+	BOOST_CHECK_EQUAL( sagittal.getPropertyAs<util::fvector4>( "indexOrigin" ), util::fvector4( 5, 1, 1 ) );
+
+	for ( size_t z = 0; z < 2; z++ )
+		for ( size_t y = 0; y < 3; y++ )
+			BOOST_CHECK_EQUAL( sagittal.voxel<int16_t>( 0, y, z ), ch.voxel<int16_t>( 2, y, z ) );
+
+	sagittal.voxel<int16_t>( 0, 1, 1 ) = -1; // writing through the view changes the chunk
+	BOOST_CHECK_EQUAL( ch.voxel<int16_t>( 2, 1, 1 ), -1 );
+
+	// every second column of the second row of the sagittal slice
+	const size_t sub_start[] = {0, 1, 0, 0}, sub_size[] = {1, 1, 2, 1};
+	const data::ChunkView line = sagittal.getView( sub_start, sub_size );
+	BOOST_CHECK_EQUAL( line.voxel<int16_t>( 0, 0, 1 ), -1 );
+
+	const size_t step_start[] = {1, 0, 0, 0}, step_size[] = {2, 3, 1, 1}, step[] = {2, 1, 1, 1};
+	const data::ChunkView stepped = ch.getView( step_start, step_size, step );
+	BOOST_CHECK_EQUAL( stepped.getPropertyAs<util::fvector4>( "voxelGap" ), util::fvector4( 3, 1, 1 ) );
+
+	for ( size_t y = 0; y < 3; y++ ) {
+		BOOST_CHECK_EQUAL( stepped.voxel<int16_t>( 0, y ), ch.voxel<int16_t>( 1, y ) );
+		BOOST_CHECK_EQUAL( stepped.voxel<int16_t>( 1, y ), ch.voxel<int16_t>( 3, y ) );
+	}
+
+	// empty views and zero steps are rejected
+	const size_t empty_size[] = {2, 0, 1, 1}, zero_step[] = {0, 1, 1, 1};
+	BOOST_CHECK_THROW( ch.getView( start, empty_size ), std::invalid_argument );
+	BOOST_CHECK_THROW( sagittal.getView( sub_start, sub_size, zero_step ), std::invalid_argument );
+
+	// so are views leaving the chunk (also if start + (size-1)*step would wrap around)
+	const size_t far_start[] = {4, 0, 0, 0}, too_big[] = {3, 3, 1, 1}, huge_step[] = {size_t( -1 ), 1, 1, 1};
+	BOOST_CHECK_THROW( ch.getView( start, too_big ), std::out_of_range );
+	BOOST_CHECK_THROW( ch.getView( far_start, size ), std::out_of_range );
+	BOOST_CHECK_THROW( ch.getView( step_start, step_size, huge_step ), std::out_of_range );
+
+	// materialize makes a contiguous copy
+	const data::Chunk copy = sagittal.materialize();
+	BOOST_CHECK_EQUAL( copy.getSizeAsString(), "1x3x2x1" );
+	BOOST_CHECK( copy.is<int16_t>() );
+	BOOST_CHECK_EQUAL( copy.getPropertyAs<util::fvector4>( "indexOrigin" ), util::fvector4( 5, 1, 1 ) );
+
+	for ( size_t z = 0; z < 2; z++ )
+		for ( size_t y = 0; y < 3; y++ )
+			BOOST_CHECK_EQUAL( copy.voxel<int16_t>( 0, y, z ), ch.voxel<int16_t>( 2, y, z ) );
+
+	ch.voxel<int16_t>( 2, 0, 0 ) = 100;
+	BOOST_CHECK( copy.voxel<int16_t>( 0, 0, 0 ) != 100 );
+}
+
+BOOST_AUTO_TEST_CASE ( chunk_view_reorient_test )
+{
+	data::MemChunk<int32_t> ch( 150, 70, 3, 2 ); // bigger than one block of materialize
+	ch.setPropertyAs( "indexOrigin", util::fvector4( 1, 2, 3 ) );
+	ch.setPropertyAs( "rowVec", util::fvector4( 1, 0, 0 ) );
+	ch.setPropertyAs( "columnVec", util::fvector4( 0, 1, 0 ) );
+	ch.setPropertyAs( "voxelSize", util::fvector4( 1, 2, 3 ) );
+	ch.setPropertyAs<uint32_t>( "acquisitionNumber", 0 );
+
+	for ( size_t i = 0; i < ch.getVolume(); i++ )
+		ch.asValuePtr<int32_t>()[i] = i;
+
+	// flipping keeps the voxels where they are in scanner space
+	data::ChunkView flipped = ch.getView();
+	flipped.flip( data::rowDim );
+	BOOST_CHECK_EQUAL( flipped.getStride( data::rowDim ), -1 );
+	BOOST_CHECK_EQUAL( flipped.voxel<int32_t>( 0, 5, 1, 1 ), ch.voxel<int32_t>( 149, 5, 1, 1 ) );
+	BOOST_CHECK_EQUAL( flipped.getPropertyAs<util::fvector4>( "indexOrigin" ), util::fvector4( 150, 2, 3 ) );
+	BOOST_CHECK_EQUAL( flipped.getPropertyAs<util::fvector4>( "rowVec" ), util::fvector4( -1, 0, 0 ) );
+
+	// two flips at once, and materialized
+	flipped.flip( data::sliceDim );
+	const data::Chunk copy = flipped.materialize();
+	BOOST_CHECK_EQUAL( copy.getSizeAsString(), "150x70x3x2" );
+	size_t errors = 0;
+
+	for ( size_t t = 0; t < 2; t++ )
+		for ( size_t z = 0; z < 3; z++ )
+			for ( size_t y = 0; y < 70; y++ )
+				for ( size_t x = 0; x < 150; x++ )
+					if( copy.voxel<int32_t>( x, y, z, t ) != ch.voxel<int32_t>( 149 - x, y, 2 - z, t ) )
+						errors++;
+
+	BOOST_CHECK_EQUAL( errors, 0 );
+	BOOST_CHECK_EQUAL( copy.getPropertyAs<util::fvector4>( "indexOrigin" ), util::fvector4( 150, 2, 9 ) );
+	BOOST_CHECK_EQUAL( copy.getPropertyAs<util::fvector4>( "sliceVec" ), util::fvector4( 0, 0, -1 ) );
+}
+
+BOOST_AUTO_TEST_CASE ( chunk_view_materialize_complex_test )
+{
+	// non-integral voxels of 8 bytes are not copied as uint64_t
+	data::MemChunk<std::complex<float> > ch( 100, 80 );
+
+	for ( size_t i = 0; i < ch.getVolume(); i++ )
+		ch.asValuePtr<std::complex<float> >()[i] = std::complex<float>( i, -( float )i );
+
+	data::ChunkView flipped = ch.getView();
+	flipped.flip( data::columnDim );
+	const data::Chunk copy = flipped.materialize();
+	BOOST_REQUIRE( copy.is<std::complex<float> >() );
+	size_t errors = 0;
+
+	for ( size_t y = 0; y < 80; y++ )
+		for ( size_t x = 0; x < 100; x++ )
+			if( copy.voxel<std::complex<float> >( x, y ) != ch.voxel<std::complex<float> >( x, 79 - y ) )
+				errors++;
+
+	BOOST_CHECK_EQUAL( errors, 0 );
+}
+
 BOOST_AUTO_TEST_CASE ( chunk_swap_test )
 {
 	class : public data::VoxelOp<int>
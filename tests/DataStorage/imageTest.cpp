@@ -372,6 +372,102 @@ BOOST_AUTO_TEST_CASE ( image_foreach_chunk_test )
 
 }
 
+// functors for the statically dispatched foreach functions (must not be local types)
+struct SetLinearIndex {
+	data::_internal::NDimensional<4> geometry;
+	SetLinearIndex( const data::_internal::NDimensional<4> &geo ): geometry( geo ) {}
+	bool operator()( uint8_t &vox, const util::FixedVector< size_t, 4 >& pos ) {
+		vox = geometry.getLinearIndex( &pos[0] );
+		return true;
+	}
+};
+struct Count {
+	size_t values, spans;
+	Count(): values( 0 ), spans( 0 ) {}
+	void operator()( const uint8_t &/*vox*/ ) {values++;}
+	void operator()( const uint8_t *begin, const uint8_t *end ) {
+		spans++;
+		values += end - begin;
+	}
+};
+
+BOOST_AUTO_TEST_CASE ( image_foreach_inlined_test )
+{
+	std::list<data::Chunk> chunks;
+
+	for ( int i = 0; i < 3; i++ )
+		for ( int j = 0; j < 3; j++ )
+			chunks.push_back( genSlice<uint8_t>( 3, 3, j, j + i * 3 ) );
+
+	data::Image img( chunks );
+	SetLinearIndex setidx( img );
+	BOOST_REQUIRE_EQUAL( img.foreachVoxelInlined<uint8_t>( setidx ), 0 );
+	const util::FixedVector<size_t, 4> imgSize = img.getSizeAsVector();
+	uint8_t cnt = 0;
+
+	for( size_t t = 0; t < imgSize[data::timeDim]; t++ )
+		for( size_t z = 0; z < imgSize[data::sliceDim]; z++ )
+			for( size_t y = 0; y < imgSize[data::columnDim]; y++ )
+				for( size_t x = 0; x < imgSize[data::rowDim]; x++ )
+					BOOST_CHECK_EQUAL( img.voxel<uint8_t>( x, y, z, t ), cnt++ );
+
+	Count values, spans;
+	BOOST_REQUIRE( img.foreachValue<uint8_t>( values ) );
+	BOOST_REQUIRE( img.foreachSpan<uint8_t>( spans ) );
+	BOOST_CHECK_EQUAL( values.values, img.getVolume() );
+	BOOST_CHECK_EQUAL( spans.values, img.getVolume() );
+	BOOST_CHECK_EQUAL( spans.spans, 9 ); // one per chunk
+}
+
+BOOST_AUTO_TEST_CASE ( image_foreach_parallel_test )
+{
+	std::list<data::Chunk> chunks;
+
+	for ( int i = 0; i < 3; i++ )
+		for ( int j = 0; j < 3; j++ )
+			chunks.push_back( genSlice<uint8_t>( 3, 3, j, j + i * 3 ) );
+
+	data::Image img( chunks );
+	SetLinearIndex setidx( img );
+	BOOST_REQUIRE_EQUAL( img.foreachVoxelInlined<uint8_t>( setidx, true ), 0 );
+	const util::FixedVector<size_t, 4> imgSize = img.getSizeAsVector();
+	uint8_t cnt = 0;
+
+	for( size_t t = 0; t < imgSize[data::timeDim]; t++ )
+		for( size_t z = 0; z < imgSize[data::sliceDim]; z++ )
+			for( size_t y = 0; y < imgSize[data::columnDim]; y++ )
+				for( size_t x = 0; x < imgSize[data::rowDim]; x++ )
+					BOOST_CHECK_EQUAL( img.voxel<uint8_t>( x, y, z, t ), cnt++ );
+
+	// failing chunks are counted, the exception of the first throwing chunk is passed on
+	class : public data::ChunkOp
+	{
+	public:
+		bool operator()( data::Chunk &/*ch*/, util::FixedVector<size_t, 4> posInImage ) {
+			if( posInImage[data::timeDim] == 2 )
+				throw std::runtime_error( "timestep " + boost::lexical_cast<std::string>( posInImage[data::sliceDim] ) );
+
+			return posInImage[data::sliceDim] != 1;
+		}
+	} failSome;
+	class : public data::ChunkOp
+	{
+	public:
+		bool operator()( data::Chunk &/*ch*/, util::FixedVector<size_t, 4> posInImage ) {
+			return posInImage[data::sliceDim] != 1;
+		}
+	} failSlice1;
+
+	BOOST_CHECK_EQUAL( img.foreachChunk( failSlice1, false, true ), 3 );
+
+	try {
+		img.foreachChunk( failSome, false, true );
+		BOOST_FAIL( "foreachChunk should have thrown" );
+	} catch( const std::runtime_error &e ) {
+		BOOST_CHECK_EQUAL( std::string( e.what() ), "timestep 0" );
+	}
+}
+
 BOOST_AUTO_TEST_CASE ( image_voxel_test )
 {
 	//  get a voxel from inside and outside the image
@@ -399,6 +495,138 @@ BOOST_AUTO_TEST_CASE ( image_voxel_test )
 	BOOST_CHECK( img.voxel<float>( 2, 2, 2, 0 ) == 23 );
 }
 
+BOOST_AUTO_TEST_CASE ( image_voxel_access_test )
+{
+	// an image of 4 timesteps made of 3 slices each
+	std::list<data::Chunk> chunks;
+
+	for( int t = 0; t < 4; t++ )
+		for( int s = 0; s < 3; s++ )
+			chunks.push_back( genSlice<float>( 5, 4, s, t * 3 + s ) );
+
+	data::Image img( chunks );
+	BOOST_REQUIRE( img.isClean() );
+	BOOST_REQUIRE_EQUAL( img.getSizeAsString(), "5x4x3x4" );
+
+	data::Image::VoxelAccessor<float> acc = img.getVoxelAccessor<float>();
+
+	for( size_t t = 0; t < 4; t++ )
+		for( size_t z = 0; z < 3; z++ )
+			for( size_t y = 0; y < 4; y++ )
+				for( size_t x = 0; x < 5; x++ )
+					acc( x, y, z, t ) = x + y * 10 + z * 100 + t * 1000;
+
+	const data::Image &cimg = img;
+	data::Image::VoxelAccessor<const float> cacc = cimg.getVoxelAccessor<float>();
+
+	for( size_t t = 0; t < 4; t++ )
+		for( size_t z = 0; z < 3; z++ )
+			for( size_t y = 0; y < 4; y++ )
+				for( size_t x = 0; x < 5; x++ ) {
+					const float expect = x + y * 10 + z * 100 + t * 1000;
+					BOOST_REQUIRE_EQUAL( img.voxel<float>( x, y, z, t ), expect );
+					BOOST_REQUIRE_EQUAL( cimg.voxelUnchecked<float>( x, y, z, t ), expect );
+					BOOST_REQUIRE_EQUAL( cacc( x, y, z, t ), expect );
+				}
+
+	// the accessor writes into the chunks of the image
+	BOOST_CHECK_EQUAL( img.getChunk( 0, 0, 2, 3, false ).voxel<float>( 4, 3 ), 4 + 30 + 200 + 3000 );
+	img.voxelUnchecked<float>( 1, 1, 1, 1 ) = -1;
+	BOOST_CHECK_EQUAL( cacc( 1, 1, 1, 1 ), -1 );
+
+	// a const image which is not indexed can't be accessed
+	BOOST_REQUIRE( img.insertChunk( genSlice<float>( 5, 4, 0, 12 ) ) );
+	BOOST_REQUIRE( !img.isClean() );
+	BOOST_CHECK_THROW( cimg.getVoxelAccessor<float>(), std::logic_error );
+}
+
+BOOST_AUTO_TEST_CASE ( image_span_test )
+{
+	// slices of separate memory - every chunk is a span
+	std::list<data::Chunk> chunks;
+
+	for( int t = 0; t < 2; t++ )
+		for( int s = 0; s < 3; s++ )
+			chunks.push_back( genSlice<float>( 5, 4, s, t * 3 + s ) );
+
+	data::Image img( chunks );
+	std::vector<data::Image::Span<float> > spans = img.getSpans<float>();
+	BOOST_REQUIRE_EQUAL( spans.size(), 6 );
+
+	for( size_t i = 0; i < spans.size(); i++ ) {
+		BOOST_CHECK_EQUAL( spans[i].length, 20 );
+		const size_t pos[] = {0, 0, i % 3, i / 3};
+		BOOST_CHECK_EQUAL( spans[i].position, ( util::FixedVector<size_t, 4>( pos ) ) );
+		BOOST_CHECK_EQUAL( spans[i].data, &img.voxel<float>( 0, 0, i % 3, i / 3 ) );
+	}
+
+	// a volume spliced into slices is contiguous in memory - so its one span if merged
+	data::MemChunk<int16_t> vol( 5, 4, 3 );
+	vol.setPropertyAs( "indexOrigin", util::fvector4( 0, 0, 0 ) );
+	vol.setPropertyAs( "rowVec", util::fvector4( 1, 0 ) );
+	vol.setPropertyAs( "columnVec", util::fvector4( 0, 1 ) );
+	vol.setPropertyAs( "voxelSize", util::fvector4( 1, 1, 1 ) );
+	vol.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+
+	for( size_t i = 0; i < vol.getVolume(); i++ )
+		vol.asValuePtr<int16_t>()[i] = i;
+
+	data::Image spliced( vol );
+	spliced.spliceDownTo( data::sliceDim );
+	BOOST_REQUIRE_EQUAL( spliced.copyChunksToVector( false ).size(), 3 );
+
+	const data::Image &cspliced = spliced;
+	const std::vector<data::Image::Span<const int16_t> > merged = cspliced.getSpans<int16_t>();
+	BOOST_REQUIRE_EQUAL( merged.size(), 1 );
+	BOOST_CHECK_EQUAL( merged[0].length, 60 );
+
+	for( size_t i = 0; i < merged[0].length; i++ )
+		BOOST_REQUIRE_EQUAL( merged[0].data[i], i );
+
+	BOOST_CHECK_EQUAL( cspliced.getSpans<int16_t>( false ).size(), 3 );
+	BOOST_CHECK( cspliced.getSpans<float>().empty() ); // the const version does not convert
+}
+
+BOOST_AUTO_TEST_CASE ( image_consolidate_test )
+{
+	std::list<data::Chunk> chunks;
+
+	for( int t = 0; t < 2; t++ )
+		for( int s = 0; s < 3; s++ ) {
+			chunks.push_back( genSlice<float>( 5, 4, s, t * 3 + s ) );
+			chunks.back().voxel<float>( s, t ) = t * 3 + s + 1;
+		}
+
+	data::Image img( chunks );
+	BOOST_REQUIRE_EQUAL( img.getSpans<float>().size(), 6 );
+
+	// keep the type
+	BOOST_REQUIRE( img.consolidate() );
+	BOOST_CHECK( img.getMajorTypeID() == data::ValuePtr<float>::staticID );
+	BOOST_REQUIRE_EQUAL( img.copyChunksToVector( false ).size(), 6 ); // the chunks are still there
+	const std::vector<data::Image::Span<float> > spans = img.getSpans<float>();
+	BOOST_REQUIRE_EQUAL( spans.size(), 1 ); // but they are contiguous now
+	BOOST_CHECK_EQUAL( spans[0].length, img.getVolume() );
+
+	for( int t = 0; t < 2; t++ )
+		for( int s = 0; s < 3; s++ ) {
+			BOOST_CHECK_EQUAL( img.voxel<float>( s, t, s, t ), t * 3 + s + 1 );
+			// the chunks keep their own properties
+			BOOST_CHECK_EQUAL( img.getChunk( 0, 0, s, t, false ).getPropertyAs<uint32_t>( "acquisitionNumber" ), t * 3 + s );
+		}
+
+	// convert on the way
+	BOOST_REQUIRE( img.consolidate( data::ValuePtr<int16_t>::staticID ) );
+	BOOST_CHECK( img.getMajorTypeID() == data::ValuePtr<int16_t>::staticID );
+	const data::Image &cimg = img;
+	BOOST_REQUIRE_EQUAL( cimg.getSpans<int16_t>().size(), 1 );
+	BOOST_CHECK_EQUAL( img.getChunk( 0, 0, 2, 1, false ).getPropertyAs<uint32_t>( "acquisitionNumber" ), 5 );
+
+	for( int t = 0; t < 2; t++ )
+		for( int s = 0; s < 3; s++ ) // the value range is [0,6], so the values are scaled up
+			BOOST_CHECK( img.voxel<int16_t>( s, t, s, t ) > img.voxel<int16_t>( 4, 3, s, t ) );
+}
+
 BOOST_AUTO_TEST_CASE( image_minmax_test )
 {
 	std::list<data::Chunk> chunks;
@@ -0,0 +1,261 @@
+/*
+* imageIODicomTest.cpp
+*
+* Description: TestSuite for the parts of the dicom plugin which don't need an actual dicom file (value parsers and mosaic decomposition)
+*/
+
+#include <DataStorage/chunk.hpp>
+#include <CoreUtils/log.hpp>
+#include "imageFormat_Dicom.hpp"
+
+#define BOOST_TEST_MODULE "imageIODicomTest"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/date_time/gregorian/gregorian.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <string.h>
+
+namespace isis
+{
+namespace test
+{
+
+BOOST_AUTO_TEST_SUITE ( imageIODicom_BaseTests )
+
+BOOST_AUTO_TEST_CASE( mosaic_slicetimes_test )
+{
+	const util::istring prefix = util::istring( image_io::ImageFormat_Dicom::dicomTagTreeName ) + "/";
+
+	// a 4x4 mosaic made of four 2x2 tiles, every voxel holds the number of its tile
+	data::MemChunk<uint16_t> mosaic( 4, 4 );
+
+	for( size_t y = 0; y < 4; y++ )
+		for( size_t x = 0; x < 4; x++ )
+			mosaic.voxel<uint16_t>( x, y ) = ( y / 2 ) * 2 + x / 2;
+
+	util::slist iType;
+	iType.push_back( "ORIGINAL" );
+	iType.push_back( "MOSAIC" );
+	mosaic.setPropertyAs( prefix + "ImageType", iType );
+	mosaic.setPropertyAs( prefix + "CSAImageHeaderInfo/NumberOfImagesInMosaic", ( uint16_t )4 );
+	mosaic.setPropertyAs( "indexOrigin", util::fvector4( 0, 0, 0 ) );
+	mosaic.setPropertyAs( "voxelSize", util::fvector4( 1, 1, 1 ) );
+	mosaic.setPropertyAs( "rowVec", util::fvector4( 1, 0, 0 ) );
+	mosaic.setPropertyAs( "columnVec", util::fvector4( 0, 1, 0 ) );
+	mosaic.setPropertyAs( "acquisitionTime", 1000. );
+
+	util::dlist offsets; // interleaved acquisition
+	offsets.push_back( 0 );
+	offsets.push_back( 1000 );
+	offsets.push_back( 500 );
+	offsets.push_back( 1500 );
+	mosaic.setPropertyAs( prefix + "CSAImageHeaderInfo/MosaicRefAcqTimes", offsets );
+
+	std::list<data::Chunk> chunks;
+	BOOST_REQUIRE_EQUAL( image_io::ImageFormat_Dicom::readMosaic( mosaic, chunks ), 1 );
+	BOOST_REQUIRE_EQUAL( chunks.size(), 1 );
+	const data::Chunk &volume = chunks.front();
+	BOOST_CHECK_EQUAL( volume.getSizeAsVector(), util::ivector4( 2, 2, 4, 1 ) );
+
+	for( uint16_t slice = 0; slice < 4; slice++ ) {
+		BOOST_CHECK_EQUAL( volume.voxel<uint16_t>( 0, 0, slice ), slice );
+		BOOST_CHECK_EQUAL( volume.voxel<uint16_t>( 1, 1, slice ), slice );
+	}
+
+	// the slice times are absolute and in the order of the slices
+	BOOST_REQUIRE( volume.hasProperty( prefix + "sliceTimes" ) );
+	const util::dlist sliceTimes = volume.getPropertyAs<util::dlist>( prefix + "sliceTimes" );
+	BOOST_REQUIRE_EQUAL( sliceTimes.size(), 4 );
+	util::dlist::const_iterator time = sliceTimes.begin(), offset = offsets.begin();
+
+	for( ; time != sliceTimes.end(); ++time, ++offset )
+		BOOST_CHECK_EQUAL( *time, *offset + 1000 );
+
+	BOOST_CHECK_EQUAL( volume.getPropertyAs<double>( "acquisitionTime" ), 1000 );
+}
+
+BOOST_AUTO_TEST_CASE( mosaic_broken_slicetimes_test )
+{
+	const util::istring prefix = util::istring( image_io::ImageFormat_Dicom::dicomTagTreeName ) + "/";
+	data::MemChunk<uint16_t> mosaic( 4, 4 );
+
+	util::slist iType( 1, "MOSAIC" );
+	mosaic.setPropertyAs( prefix + "ImageType", iType );
+	mosaic.setPropertyAs( prefix + "CSAImageHeaderInfo/NumberOfImagesInMosaic", ( uint16_t )4 );
+	mosaic.setPropertyAs( "indexOrigin", util::fvector4( 0, 0, 0 ) );
+	mosaic.setPropertyAs( "voxelSize", util::fvector4( 1, 1, 1 ) );
+	mosaic.setPropertyAs( "rowVec", util::fvector4( 1, 0, 0 ) );
+	mosaic.setPropertyAs( "columnVec", util::fvector4( 0, 1, 0 ) );
+	mosaic.setPropertyAs( prefix + "CSAImageHeaderInfo/MosaicRefAcqTimes", util::dlist( 3, 0 ) ); // one entry is missing
+
+	std::list<data::Chunk> chunks;
+	BOOST_REQUIRE_EQUAL( image_io::ImageFormat_Dicom::readMosaic( mosaic, chunks ), 1 );
+	BOOST_CHECK( !chunks.front().hasProperty( prefix + "sliceTimes" ) );
+}
+
+template<typename T> bool parse( const std::string &str, T &dest, size_t &remaining )
+{
+	const char *at = str.c_str(), *const end = at + str.length();
+	const bool ret = image_io::_internal::parseNumber( at, end, dest );
+	remaining = end - at;
+	return ret;
+}
+template<typename T> bool parse( const std::string &str, T &dest )
+{
+	size_t remaining;
+	return parse( str, dest, remaining ) && remaining == 0;
+}
+
+BOOST_AUTO_TEST_CASE( parse_integer_test )
+{
+	int32_t val = 0;
+	size_t remaining;
+	BOOST_CHECK( parse( "42", val ) && val == 42 );
+	BOOST_CHECK( parse( "-7", val ) && val == -7 );
+	BOOST_CHECK( parse( "+5", val ) && val == 5 );
+	BOOST_CHECK( parse( " 12  ", val ) && val == 12 ); // DICOM allows spaces around the value
+	BOOST_CHECK( parse( "007", val ) && val == 7 );
+
+	// limits of int32
+	BOOST_CHECK( parse( "2147483647", val ) && val == 2147483647 );
+	BOOST_CHECK( parse( "-2147483648", val ) && val == -2147483647 - 1 );
+	val = 1;
+	BOOST_CHECK( !parse( "2147483648", val ) );
+	BOOST_CHECK( !parse( "-2147483649", val ) );
+	BOOST_CHECK( !parse( "99999999999999999999", val ) );
+	BOOST_CHECK_EQUAL( val, 1 ); // failing doesn't touch the destination
+
+	// empty or invalid input
+	BOOST_CHECK( !parse( "", val ) );
+	BOOST_CHECK( !parse( "   ", val ) );
+	BOOST_CHECK( !parse( "-", val ) );
+	BOOST_CHECK( !parse( "x1", val ) );
+
+	// parsing stops at the first character which doesn't belong to the number
+	BOOST_CHECK( parse( "3.5", val, remaining ) && val == 3 && remaining == 2 );
+	BOOST_CHECK( parse( "3 \\4", val, remaining ) && val == 3 && remaining == 2 );
+}
+
+BOOST_AUTO_TEST_CASE( parse_decimal_test )
+{
+	double val = 0;
+	BOOST_CHECK( parse( "1.5", val ) && val == 1.5 );
+	BOOST_CHECK( parse( "-2.25", val ) && val == -2.25 );
+	BOOST_CHECK( parse( "+3", val ) && val == 3 );
+	BOOST_CHECK( parse( ".5", val ) && val == .5 );
+	BOOST_CHECK( parse( "5.", val ) && val == 5 );
+	BOOST_CHECK( parse( " 0.1 ", val ) && val == 0.1 ); // correctly rounded
+	BOOST_CHECK( parse( "-0", val ) && val == 0 );
+
+	// exponents
+	BOOST_CHECK( parse( "1e3", val ) && val == 1000 );
+	BOOST_CHECK( parse( "1.5E-2", val ) && val == 1.5e-2 );
+	BOOST_CHECK( parse( "-2.5e+1", val ) && val == -25 );
+	BOOST_CHECK( parse( "1e-30", val ) && val == 1e-30 ); // exponent out of the exact range
+	BOOST_CHECK( !parse( "1e", val ) );
+	BOOST_CHECK( !parse( "1e ", val ) );
+	BOOST_CHECK( !parse( "1e+", val ) );
+	BOOST_CHECK( !parse( "e5", val ) );
+
+	// more than 15 significant digits go the slow way, but must be correctly rounded as well
+	BOOST_CHECK( parse( "0.1234567890123456789", val ) && val == 0.1234567890123456789 );
+	BOOST_CHECK( parse( "12345678901234567890", val ) && val == 12345678901234567890. );
+	BOOST_CHECK( parse( "-3.14159265358979323846", val ) && val == -3.14159265358979323846 );
+	BOOST_CHECK( parse( "0.00000000000000000001234", val ) && val == 1.234e-20 ); // leading zeros are not significant
+
+	// empty or invalid input
+	BOOST_CHECK( !parse( "", val ) );
+	BOOST_CHECK( !parse( "  ", val ) );
+	BOOST_CHECK( !parse( ".", val ) );
+	BOOST_CHECK( !parse( "-.", val ) );
+	BOOST_CHECK( !parse( "abc", val ) );
+}
+
+BOOST_AUTO_TEST_CASE( parse_numbers_test )
+{
+	const std::string three = "1.5\\ -2 \\3e2";
+	std::vector<double> dvals;
+	BOOST_REQUIRE_EQUAL( image_io::_internal::parseNumbers<double>( three.c_str(), three.c_str() + three.length(), std::back_inserter( dvals ), 4 ), 3 );
+	BOOST_CHECK_EQUAL( dvals[0], 1.5 );
+	BOOST_CHECK_EQUAL( dvals[1], -2 );
+	BOOST_CHECK_EQUAL( dvals[2], 300 );
+
+	// more values than allowed
+	dvals.clear();
+	BOOST_CHECK_EQUAL( image_io::_internal::parseNumbers<double>( three.c_str(), three.c_str() + three.length(), std::back_inserter( dvals ), 2 ), 0 );
+
+	int32_t ivals[4];
+	const std::string ints = "1\\2\\3\\4";
+	BOOST_REQUIRE_EQUAL( image_io::_internal::parseNumbers<int32_t>( ints.c_str(), ints.c_str() + ints.length(), ivals, 4 ), 4 );
+
+	for( int i = 0; i < 4; i++ )
+		BOOST_CHECK_EQUAL( ivals[i], i + 1 );
+
+	// invalid lists
+	const char *const invalid[] = {"", "1\\", "\\1", "1\\x", "1;2", "1\\\\2", "1.5\\2"};
+
+	for( size_t i = 0; i < sizeof( invalid ) / sizeof( invalid[0] ); i++ ) {
+		BOOST_CHECK_MESSAGE(
+			image_io::_internal::parseNumbers<int32_t>( invalid[i], invalid[i] + strlen( invalid[i] ), ivals, 4 ) == 0,
+			"\"" << invalid[i] << "\" should not be parsed as integer list"
+		);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( parse_date_test )
+{
+	boost::gregorian::date date;
+	const std::string valid[] = {"20110407", "2011.04.07", "20110407 "};
+
+	for( size_t i = 0; i < 3; i++ ) {
+		BOOST_CHECK( image_io::_internal::parseDate( valid[i].c_str(), valid[i].c_str() + valid[i].length(), date ) );
+		BOOST_CHECK_EQUAL( date, boost::gregorian::date( 2011, 4, 7 ) );
+	}
+
+	// partial, invalid or malformed dates
+	const std::string invalid[] = {"", "2011", "201104", "2011040", "2011.04", "20111304", "20110230", "2011-04-07", "2011040A", "201104071"};
+
+	for( size_t i = 0; i < sizeof( invalid ) / sizeof( invalid[0] ); i++ ) {
+		BOOST_CHECK_MESSAGE(
+			!image_io::_internal::parseDate( invalid[i].c_str(), invalid[i].c_str() + invalid[i].length(), date ),
+			"\"" << invalid[i] << "\" should not be parsed as date"
+		);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( parse_time_test )
+{
+	using namespace boost::posix_time;
+	const std::string valid[] = {"123456.789", "12:34:56.789", "123456.789000 ", "1234", "12:34", "12", "235960", "000000.000001", "123456.1234567"};
+	const time_duration expected[] = {
+		time_duration( 12, 34, 56 ) + microseconds( 789000 ), time_duration( 12, 34, 56 ) + microseconds( 789000 ), time_duration( 12, 34, 56 ) + microseconds( 789000 ),
+		time_duration( 12, 34, 0 ), time_duration( 12, 34, 0 ), time_duration( 12, 0, 0 ), time_duration( 23, 59, 60 ), microseconds( 1 ),
+		time_duration( 12, 34, 56 ) + microseconds( 123456 ) // only 6 digits of the fraction are used
+	};
+
+	for( size_t i = 0; i < sizeof( valid ) / sizeof( valid[0] ); i++ ) {
+		time_duration time;
+		BOOST_CHECK_MESSAGE( image_io::_internal::parseTime( valid[i].c_str(), valid[i].c_str() + valid[i].length(), time ), "failed to parse \"" << valid[i] << "\"" );
+		BOOST_CHECK_EQUAL( time, expected[i] );
+	}
+
+	// partial, invalid or malformed times
+	const std::string invalid[] = {"", " ", "1", "123", "12345", "1234.5", "240000", "126000", "123461", "12-34-56", "12:3456x"};
+
+	for( size_t i = 0; i < sizeof( invalid ) / sizeof( invalid[0] ); i++ ) {
+		time_duration time;
+		BOOST_CHECK_MESSAGE(
+			!image_io::_internal::parseTime( invalid[i].c_str(), invalid[i].c_str() + invalid[i].length(), time ),
+			"\"" << invalid[i] << "\" should not be parsed as time"
+		);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
+}
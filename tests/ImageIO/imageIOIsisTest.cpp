@@ -0,0 +1,93 @@
+/*
+* imageIOIsisTest.cpp
+*
+* Description: TestSuite to check the read and write ability of the native isis format plugin
+*/
+
+#include <DataStorage/image.hpp>
+#include <DataStorage/io_factory.hpp>
+#include <CoreUtils/log.hpp>
+#include <CoreUtils/tmpfile.hpp>
+
+#define BOOST_TEST_MODULE "imageIOIsisTest"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <string>
+#include <fstream>
+
+namespace isis
+{
+namespace test
+{
+
+BOOST_AUTO_TEST_SUITE ( imageIOIsis_BaseTests )
+
+void checkRoundTrip( const std::string &dialect )
+{
+	data::enableLog<util::DefaultMsgPrint>( warning );
+	std::list<data::Image> images = data::IOFactory::load( "nix.null" );
+	BOOST_REQUIRE( images.size() == 5 );
+
+	util::TmpFile tmpfile( "", ".isis" );
+	BOOST_REQUIRE( data::IOFactory::write( images.front(), tmpfile.file_string(), "", dialect ) );
+
+	std::list<data::Image> loaded = data::IOFactory::load( tmpfile.file_string() );
+	BOOST_REQUIRE( loaded.size() == 1 );
+	const data::Image &org = images.front(), &img = loaded.front();
+
+	// properties and geometry must survive unchanged (except the source)
+	util::PropertyMap::DiffMap diff = org.getDifference( img );
+	diff.erase( "source" );
+	BOOST_CHECK( diff.empty() );
+	BOOST_CHECK_EQUAL( org.getSizeAsVector(), img.getSizeAsVector() );
+	BOOST_CHECK_EQUAL( org.getMajorTypeID(), img.getMajorTypeID() );
+
+	// chunks and voxels too
+	const std::vector<data::Chunk> orgChunks = org.copyChunksToVector( false ), chunks = img.copyChunksToVector( false );
+	BOOST_REQUIRE_EQUAL( orgChunks.size(), chunks.size() );
+
+	for( size_t i = 0; i < chunks.size(); i++ ) {
+		BOOST_CHECK_EQUAL( orgChunks[i].getSizeAsVector(), chunks[i].getSizeAsVector() );
+		BOOST_CHECK_EQUAL( orgChunks[i].getTypeID(), chunks[i].getTypeID() );
+		BOOST_CHECK( orgChunks[i].getDifference( chunks[i] ).empty() );
+		BOOST_CHECK_EQUAL( orgChunks[i].compareRange( 0, orgChunks[i].getVolume() - 1, chunks[i], 0 ), 0 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE ( roundTrip )
+{
+	checkRoundTrip( "" );
+}
+
+BOOST_AUTO_TEST_CASE ( roundTripCompressed )
+{
+	checkRoundTrip( "compressed" );
+}
+
+BOOST_AUTO_TEST_CASE ( brokenDirectory )
+{
+	data::enableLog<util::DefaultMsgPrint>( error );
+	std::list<data::Image> images = data::IOFactory::load( "nix.null" );
+	BOOST_REQUIRE( images.size() == 5 );
+
+	util::TmpFile tmpfile( "", ".isis" );
+	BOOST_REQUIRE( data::IOFactory::write( images.front(), tmpfile.file_string(), "", "compressed" ) );
+
+	// the offset of the directory is at byte 24 of the header, the size of the first chunk at byte 8 of its entry
+	std::fstream file( tmpfile.file_string().c_str(), std::ios::in | std::ios::out | std::ios::binary );
+	uint64_t directory;
+	const uint64_t size[] = {1 << 20, 1 << 20, 1, 1}; // much more than the compressed data can hold
+	file.seekg( 24 );
+	file.read( reinterpret_cast<char *>( &directory ), sizeof( directory ) );
+	file.seekp( directory + 8 );
+	file.write( reinterpret_cast<const char *>( size ), sizeof( size ) );
+	file.close();
+
+	BOOST_CHECK( data::IOFactory::load( tmpfile.file_string() ).empty() );
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
+
+}
+}
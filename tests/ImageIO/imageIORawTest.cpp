@@ -0,0 +1,88 @@
+/*
+* imageIORawTest.cpp
+*
+* Description: TestSuite to check the read and write ability of the raw plugin
+*/
+
+#include <DataStorage/image.hpp>
+#include <DataStorage/io_factory.hpp>
+#include <CoreUtils/log.hpp>
+#include <CoreUtils/tmpfile.hpp>
+
+#define BOOST_TEST_MODULE "imageIORawTest"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <string>
+
+namespace isis
+{
+namespace test
+{
+
+BOOST_AUTO_TEST_SUITE ( imageIORaw_BaseTests )
+
+BOOST_AUTO_TEST_CASE ( roundTrip )
+{
+	data::enableLog<util::DefaultMsgPrint>( warning );
+	std::list<data::Image> images = data::IOFactory::load( "nix.null" );
+	BOOST_REQUIRE( images.size() == 5 );
+	const data::Image &org = images.front();
+
+	util::TmpFile tmpfile( "", ".raw" );
+	BOOST_REQUIRE( data::IOFactory::write( org, tmpfile.file_string(), "", "" ) );
+
+	// the writer puts size and type into the filename, and writes the sidecar header
+	const boost::filesystem::path stem = tmpfile.branch_path() / boost::filesystem::basename( tmpfile );
+	const std::string rawfile = stem.file_string() + "_" + org.getSizeAsString() + "_u8bit.raw";
+	BOOST_REQUIRE( boost::filesystem::exists( rawfile ) );
+	BOOST_REQUIRE( boost::filesystem::exists( rawfile + ".header" ) );
+
+	// load using the sidecar header
+	std::list<data::Image> loaded = data::IOFactory::load( rawfile );
+	BOOST_REQUIRE( loaded.size() == 1 );
+	const data::Image &img = loaded.front();
+	BOOST_CHECK_EQUAL( org.getSizeAsVector(), img.getSizeAsVector() );
+	BOOST_CHECK_EQUAL( org.getMajorTypeID(), img.getMajorTypeID() );
+	BOOST_CHECK_EQUAL( img.copyChunksToVector( false ).size(), 1 ); // the whole volume is one chunk
+
+	const data::MemChunk<uint8_t> orgData = org.copyToMemChunk<uint8_t>(), imgData = img.copyToMemChunk<uint8_t>();
+	BOOST_CHECK_EQUAL( orgData.compareRange( 0, orgData.getVolume() - 1, imgData, 0 ), 0 );
+
+	// without the header geometry and type are taken from the filename
+	boost::filesystem::remove( rawfile + ".header" );
+	loaded = data::IOFactory::load( rawfile );
+	BOOST_REQUIRE( loaded.size() == 1 );
+	BOOST_CHECK_EQUAL( org.getSizeAsVector(), loaded.front().getSizeAsVector() );
+
+	boost::filesystem::remove( rawfile );
+}
+
+BOOST_AUTO_TEST_CASE ( sidecarHeader )
+{
+	data::enableLog<util::DefaultMsgPrint>( warning );
+	util::TmpFile tmpfile( "", ".raw" );
+	{
+		std::ofstream out( tmpfile.file_string().c_str(), std::ios::binary );
+
+		for( int16_t i = 0; i < 2 * 3 * 4 * 5; i++ )
+			out.write( reinterpret_cast<const char *>( &i ), sizeof( i ) );
+
+		std::ofstream header( ( tmpfile.file_string() + ".header" ).c_str() );
+		header << "size: 2 3 4 5" << std::endl << "type: s16bit" << std::endl;
+	}
+
+	std::list<data::Image> loaded = data::IOFactory::load( tmpfile.file_string() );
+	boost::filesystem::remove( tmpfile.file_string() + ".header" );
+	BOOST_REQUIRE( loaded.size() == 1 );
+	const data::Image &img = loaded.front();
+	BOOST_CHECK_EQUAL( img.getSizeAsString(), "2x3x4x5" );
+	BOOST_CHECK( img.getMajorTypeID() == data::ValuePtr<int16_t>::staticID );
+	BOOST_CHECK_EQUAL( img.voxel<int16_t>( 1, 2, 3, 4 ), 1 + 2 * 2 + 3 * 6 + 4 * 24 );
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
+
+}
+}
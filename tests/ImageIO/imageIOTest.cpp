@@ -73,5 +73,21 @@ BOOST_AUTO_TEST_CASE ( imageUniqueName )
 	    }*/
 }
 
+BOOST_AUTO_TEST_CASE ( imageLoadFromMemory )
+{
+	data::ValuePtr<uint8_t> mem( 16 * 16 * sizeof( uint16_t ) );
+	uint16_t *const voxels = reinterpret_cast<uint16_t *>( &mem[0] );
+
+	for( uint16_t i = 0; i < 16 * 16; i++ )
+		voxels[i] = i;
+
+	std::list<data::Chunk> chunks;
+	BOOST_REQUIRE_EQUAL( data::IOFactory::load( chunks, mem, "memory.raw", "u16bit" ), 1 ); // the raw plugin references the memory directly
+	BOOST_REQUIRE_EQUAL( chunks.size(), 1 );
+	BOOST_CHECK_EQUAL( chunks.front().getSizeAsVector(), util::fvector4( 16, 16, 1, 1 ) );
+	BOOST_CHECK_EQUAL( chunks.front().voxel<uint16_t>( 5, 3 ), 3 * 16 + 5 );
+	BOOST_CHECK_EQUAL( chunks.front().getPropertyAs<std::string>( "source" ), "memory.raw" );
+}
+
 }
 }
@@ -1,59 +1,329 @@
-/****************************************************************
- *
- * Copyright (C) 2010 Max Planck Institute for Human Cognitive
- * and Brain Sciences, Leipzig.
- *
- * This program is free software; you can redistribute it and/or
- * modify it under the terms of the GNU General Public License
- * as published by the Free Software Foundation; either version 3
- * of the License, or (at your option) any later version.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program; if not, write to the Free Software
- * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
- *
- * Author: Thomas Pröger, proeger@cbs.mpg.de, 2010
- *
- *****************************************************************/
-
-#include "DataStorage/io_factory.hpp"
-#include "CoreUtils/log.hpp"
-
-//#define BOOST_TEST_MODULE "imageIOVistaTest"
-//#define BOOST_TEST_DYN_LINK
-//#include <boost/test/unit_test.hpp>
+/*
+* imageIOVistaTest.cpp
+*
+* Description: TestSuite for the vista plugin (header parser, voxel data decoding and write/read round trip)
+*/
+
+#include <DataStorage/image.hpp>
+#include <CoreUtils/tmpfile.hpp>
+#include <CoreUtils/log.hpp>
+#include "imageFormat_Vista.hpp"
+
+#define BOOST_TEST_MODULE "imageIOVistaTest"
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <fstream>
+#include <sstream>
 #include <string>
-#include <iostream>
-
-using namespace isis;
-
-//BOOST_AUTO_TEST_SUITE( imageIOVista_BaseTests )
-
-//BOOST_AUTO_TEST_CASE( loadsaveTest )
-
-int main( int /*argc*/, char **/*argv*/ )
-{
-	data::enableLog<util::DefaultMsgPrint>( warning );
-	image_io::enableLog<util::DefaultMsgPrint>( warning );
-
-	//  load the defautl NULL file
-	// std::string tmpfile = ( ( std::string )tmpnam( NULL ) ) + ".null";
-	// std::string vtmpfile = ( ( std::string )tmpnam( NULL ) ) + ".v";
-	// fopen( tmpfile.c_str(), "w" );
-	//  load images from temp file
-	std::list<data::Image> images = data::IOFactory::load( "/scr/kastanie1/DATA/isis/vista/1st_PD.v", "" );
-	// the null-loader should generate 5 50x50x50x10 images
-	//BOOST_CHECK( images.size() == 5 );
-	//  print attributes
-	//  ((data::ImageList::const_reference) images.front())->print(std::cout,true);
-	// get first image and write it to disk
-	//  data::ImageList::const_reference first = images.front();
-	data::IOFactory::write( images, "", "/tmp/data1.v", "" );
-	return 0;
-	//BOOST_AUTO_TEST_SUITE_END()
+#include <vector>
+
+namespace isis
+{
+namespace test
+{
+
+void writeFile( const boost::filesystem::path &file, const std::string &content )
+{
+	std::ofstream out( file.file_string().c_str(), std::ios::binary | std::ios::trunc );
+	out.write( content.data(), content.length() );
+}
+
+std::list<data::Chunk> loadVista( const std::string &content, const std::string &dialect = "" )
+{
+	util::TmpFile file( "", ".v" );
+	writeFile( file, content );
+	std::list<data::Chunk> ret;
+	image_io::ImageFormat_Vista().load( ret, file.file_string(), dialect );
+	return ret;
+}
+
+/*
+ * a handcrafted vista file with four images
+ * - a short image (needs swapping on little endian machines)
+ * - an ubyte image (can be used directly)
+ * - a long image (needs swapping, and is not aligned)
+ * - a double image (needs swapping, and is not aligned)
+ */
+std::string makeVistaFile()
+{
+	const std::string header =
+		"V-data 2 {\n"
+		"\thistory: {\n"
+		"\t\tvconvert: \"-in \\\"my file.v\\\"\"\n"
+		"\t}\n"
+		"\timage: image {\n"
+		"\t\tdata: 0\n"
+		"\t\tlength: 8\n"
+		"\t\tnbands: 1\n"
+		"\t\tnrows: 2\n"
+		"\t\tncolumns: 2\n"
+		"\t\trepn: short\n"
+		"\t\tvoxel: \"1.000000 2.000000 3.000000\"\n"
+		"\t\tname: \"a \\\"quoted\\\" name\"\n"
+		"\t\tnumber: 42\n"
+		"\t\tquotedNumber: \"42\"\n"
+		"\t\tfactor: -0.5\n"
+		"\t\tword: 12abc\n"
+		"\t\textra: {\n"
+		"\t\t\tnested: 1\n"
+		"\t\t\tinner: { deep: \"}\" }\n"
+		"\t\t}\n"
+		"\t\tafterExtra: yes\n"
+		"\t}\n"
+		"\timage: image {\n"
+		"\t\tdata: 8 length: 4 nbands: 1 nrows: 2 ncolumns: 2 repn: ubyte voxel: \"1 1 1\"\n"
+		"\t}\n"
+		"\timage: image {\n"
+		"\t\tdata: 13 length: 8 nbands: 1 nrows: 1 ncolumns: 2 repn: long voxel: \"1 1 1\"\n"
+		"\t}\n"
+		"\timage: image {\n"
+		"\t\tdata: 21 length: 8 nbands: 1 nrows: 1 ncolumns: 1 repn: double voxel: \"1 1 1\"\n"
+		"\t}\n"
+		"}\n\f\n";
+	const unsigned char data[] = {
+		0x01, 0x02, 0x00, 0x03, 0xFF, 0xFE, 0x80, 0x00, // short: 258, 3, -2, -32768
+		1, 2, 3, 4, // ubyte
+		0, // padding, so the following isn't aligned
+		0x01, 0x02, 0x03, 0x04, 0xFF, 0xFF, 0xFF, 0xFF, // long: 0x01020304, -1
+		0x3F, 0xF8, 0, 0, 0, 0, 0, 0 // double: 1.5
+	};
+	return header + std::string( reinterpret_cast<const char *>( data ), sizeof( data ) );
+}
+
+/*
+ * a handcrafted functional vista file with three 2x2 slices of two timesteps each
+ * the slices are stored in the file in the order 2,0,1 of their position, the voxels hold 100*slice + 10*timestep + index in the plane
+ */
+std::string makeFunctionalFile( const float positions[3] )
+{
+	const size_t order[] = {2, 0, 1};
+	std::ostringstream header;
+	std::string data;
+	header << "V-data 2 {\n";
+
+	for( size_t i = 0; i < 3; i++ ) {
+		const size_t slice = order[i];
+		header
+				<< "\timage: image {\n"
+				<< "\t\tdata: " << data.length() << " length: 16 nbands: 2 nrows: 2 ncolumns: 2 repn: short\n"
+				<< "\t\tvoxel: \"1 1 1\" orientation: axial repetition_time: 1000\n"
+				<< "\t\tindexOrigin: \"0 0 " << positions[slice] << "\"\n"
+				<< "\t\tslice_time: " << 10 * ( slice + 1 ) << "\n"
+				<< "\t}\n";
+
+		for( size_t t = 0; t < 2; t++ )
+			for( size_t v = 0; v < 4; v++ ) {
+				const uint16_t val = 100 * slice + 10 * t + v;
+				data += char( val >> 8 );
+				data += char( val & 0xFF );
+			}
+	}
+
+	header << "}\n\f\n";
+	return header.str() + data;
+}
+
+BOOST_AUTO_TEST_SUITE ( imageIOVista_BaseTests )
+
+BOOST_AUTO_TEST_CASE( parser_test )
+{
+	const std::list<data::Chunk> chunks = loadVista( makeVistaFile() );
+	BOOST_REQUIRE_EQUAL( chunks.size(), 4 );
+	const data::Chunk &ch = chunks.front();
+
+	BOOST_CHECK_EQUAL( ch.getSizeAsVector()[0], 2 );
+	BOOST_CHECK_EQUAL( ch.getSizeAsVector()[1], 2 );
+	BOOST_CHECK_EQUAL( ch.getVolume(), 4 );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<util::fvector4>( "voxelSize" ), util::fvector4( 1, 2, 3, 1 ) );
+
+	// quoted strings are unescaped and stay strings
+	BOOST_REQUIRE( ch.propertyValue( "Vista/name" )->is<std::string>() );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<std::string>( "Vista/name" ), "a \"quoted\" name" );
+	BOOST_REQUIRE( ch.propertyValue( "Vista/quotedNumber" )->is<std::string>() );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<std::string>( "Vista/quotedNumber" ), "42" );
+
+	// unquoted numbers are stored as numbers
+	BOOST_REQUIRE( ch.propertyValue( "Vista/number" )->is<int32_t>() );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<int32_t>( "Vista/number" ), 42 );
+	BOOST_REQUIRE( ch.propertyValue( "Vista/factor" )->is<double>() );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<double>( "Vista/factor" ), -0.5 );
+	BOOST_REQUIRE( ch.propertyValue( "Vista/word" )->is<std::string>() );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<std::string>( "Vista/word" ), "12abc" );
+
+	// nested lists are skipped as a whole, the attributes after them are still read
+	BOOST_CHECK( !ch.hasProperty( "Vista/extra" ) );
+	BOOST_CHECK( !ch.hasProperty( "Vista/nested" ) );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<std::string>( "Vista/afterExtra" ), "yes" );
+
+	// the history is stored in every chunk
+	BOOST_FOREACH( const data::Chunk & c, chunks ) {
+		BOOST_CHECK_EQUAL( c.getPropertyAs<std::string>( "Vista/HistoryLine1" ), "vconvert:-in \"my file.v\"" );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( voxel_data_test )
+{
+	const std::list<data::Chunk> chunks = loadVista( makeVistaFile() );
+	BOOST_REQUIRE_EQUAL( chunks.size(), 4 );
+	std::list<data::Chunk>::const_iterator ch = chunks.begin();
+
+	// big endian data are swapped
+	BOOST_REQUIRE( ch->getTypeID() == data::ValuePtr<int16_t>::staticID );
+	BOOST_CHECK_EQUAL( ch->voxel<int16_t>( 0, 0 ), 258 );
+	BOOST_CHECK_EQUAL( ch->voxel<int16_t>( 1, 0 ), 3 );
+	BOOST_CHECK_EQUAL( ch->voxel<int16_t>( 0, 1 ), -2 );
+	BOOST_CHECK_EQUAL( ch->voxel<int16_t>( 1, 1 ), -32768 );
+
+	// byte data don't have an endianness
+	++ch;
+	BOOST_REQUIRE( ch->getTypeID() == data::ValuePtr<uint8_t>::staticID );
+
+	for( size_t i = 0; i < 4; i++ )
+		BOOST_CHECK_EQUAL( ch->voxel<uint8_t>( i % 2, i / 2 ), i + 1 );
+
+	// unaligned data are copied (and swapped)
+	++ch;
+	BOOST_REQUIRE( ch->getTypeID() == data::ValuePtr<int32_t>::staticID );
+	BOOST_CHECK_EQUAL( ch->voxel<int32_t>( 0 ), 0x01020304 );
+	BOOST_CHECK_EQUAL( ch->voxel<int32_t>( 1 ), -1 );
+
+	++ch;
+	BOOST_REQUIRE( ch->getTypeID() == data::ValuePtr<double>::staticID );
+	BOOST_CHECK_EQUAL( ch->voxel<double>( 0 ), 1.5 );
+}
+
+BOOST_AUTO_TEST_CASE( broken_file_test )
+{
+	const std::string file = makeVistaFile();
+
+	BOOST_CHECK_THROW( loadVista( "not a vista file" ), std::runtime_error );
+	BOOST_CHECK_THROW( loadVista( file.substr( 0, file.find( "afterExtra" ) ) ), std::runtime_error ); // header ends in the middle
+	BOOST_CHECK_THROW( loadVista( file.substr( 0, file.length() - 20 ) ), std::runtime_error ); // voxel data are missing
+}
+
+BOOST_AUTO_TEST_CASE( functional_volume_test )
+{
+	// equidistant slices are sorted by their position and copied into one volume-major chunk
+	const float positions[] = {0, 2, 4};
+	const std::list<data::Chunk> chunks = loadVista( makeFunctionalFile( positions ), "functional" );
+	BOOST_REQUIRE_EQUAL( chunks.size(), 1 );
+	const data::Chunk &ch = chunks.front();
+	BOOST_REQUIRE( ch.getTypeID() == data::ValuePtr<int16_t>::staticID );
+
+	const util::FixedVector<size_t, 4> size = ch.getSizeAsVector();
+	BOOST_CHECK_EQUAL( size[0], 2 );
+	BOOST_CHECK_EQUAL( size[1], 2 );
+	BOOST_CHECK_EQUAL( size[2], 3 );
+	BOOST_CHECK_EQUAL( size[3], 2 );
+
+	for( size_t t = 0; t < 2; t++ )
+		for( size_t z = 0; z < 3; z++ )
+			for( size_t v = 0; v < 4; v++ )
+				BOOST_CHECK_EQUAL( ch.voxel<int16_t>( v % 2, v / 2, z, t ), 100 * z + 10 * t + v );
+
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<util::fvector4>( "indexOrigin" ), util::fvector4( 0, 0, 0, 0 ) );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<util::fvector4>( "voxelGap" ), util::fvector4( 0, 0, 1, 0 ) );
+
+	// the acquisition times of the slices are kept in the order of the slices in the volume
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<float>( "acquisitionTime" ), 10 );
+	const util::dlist sliceTimes = ch.getPropertyAs<util::dlist>( "Vista/sliceTimes" );
+	BOOST_REQUIRE_EQUAL( sliceTimes.size(), 3 );
+	util::dlist::const_iterator stime = sliceTimes.begin();
+	BOOST_CHECK_EQUAL( *( stime++ ), 10 );
+	BOOST_CHECK_EQUAL( *( stime++ ), 20 );
+	BOOST_CHECK_EQUAL( *( stime++ ), 30 );
+}
+
+BOOST_AUTO_TEST_CASE( functional_slices_test )
+{
+	// slices which are not equidistant can't form a volume, so they are spliced into single planes
+	const float positions[] = {0, 1, 3};
+	const std::list<data::Chunk> chunks = loadVista( makeFunctionalFile( positions ), "functional" );
+	BOOST_REQUIRE_EQUAL( chunks.size(), 6 );
+
+	BOOST_FOREACH( const data::Chunk & ch, chunks ) {
+		BOOST_CHECK_EQUAL( ch.getVolume(), 4 );
+		BOOST_CHECK( !ch.hasProperty( "Vista/sliceTimes" ) );
+	}
+
+	// the planes of each slice are in the order of the file, and timestep by timestep
+	std::list<data::Chunk>::const_iterator ch = chunks.begin();
+	const size_t order[] = {2, 0, 1};
+
+	for( size_t i = 0; i < 3; i++ )
+		for( size_t t = 0; t < 2; t++, ++ch ) {
+			BOOST_CHECK_EQUAL( ch->voxel<int16_t>( 0, 0 ), 100 * order[i] + 10 * t );
+			BOOST_CHECK_EQUAL( ch->getPropertyAs<util::fvector4>( "indexOrigin" )[2], positions[order[i]] );
+		}
+}
+
+BOOST_AUTO_TEST_CASE( write_read_test )
+{
+	data::MemChunk<int16_t> org( 4, 3, 2 );
+
+	for( size_t i = 0; i < org.getVolume(); i++ )
+		org.voxel<int16_t>( i % 4, ( i / 4 ) % 3, i / 12 ) = i * 1000 - 10000;
+
+	org.setPropertyAs( "indexOrigin", util::fvector4( 1, 2, 3 ) );
+	org.setPropertyAs( "voxelSize", util::fvector4( 1, 2, 3 ) );
+	org.setPropertyAs( "rowVec", util::fvector4( 1, 0, 0 ) );
+	org.setPropertyAs( "columnVec", util::fvector4( 0, 1, 0 ) );
+	org.setPropertyAs( "sliceVec", util::fvector4( 0, 0, 1 ) );
+	org.setPropertyAs( "acquisitionNumber", ( uint32_t )0 );
+	org.setPropertyAs( "Vista/number", ( int32_t )42 );
+	org.setPropertyAs( "Vista/name", std::string( "a \"quoted\" name" ) );
+	const data::Image img( org );
+
+	util::TmpFile file( "", ".v" );
+	image_io::ImageFormat_Vista().write( img, file.file_string(), "" );
+	std::list<data::Chunk> chunks;
+	BOOST_REQUIRE_EQUAL( image_io::ImageFormat_Vista().load( chunks, file.file_string(), "" ), 1 );
+	const data::Chunk &ch = chunks.front();
+
+	BOOST_REQUIRE_EQUAL( ch.getSizeAsVector(), org.getSizeAsVector() );
+	BOOST_REQUIRE( ch.getTypeID() == org.getTypeID() );
+
+	for( size_t i = 0; i < org.getVolume(); i++ )
+		BOOST_CHECK_EQUAL( ch.voxel<int16_t>( i % 4, ( i / 4 ) % 3, i / 12 ), org.voxel<int16_t>( i % 4, ( i / 4 ) % 3, i / 12 ) );
+
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<util::fvector4>( "voxelSize" ), org.getPropertyAs<util::fvector4>( "voxelSize" ) );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<int32_t>( "Vista/number" ), 42 );
+	BOOST_CHECK_EQUAL( ch.getPropertyAs<std::string>( "Vista/name" ), "a \"quoted\" name" );
+}
+
+BOOST_AUTO_TEST_CASE( functional_write_read_test )
+{
+	const float positions[] = {0, 2, 4};
+	std::list<data::Chunk> org = loadVista( makeFunctionalFile( positions ), "functional" );
+	BOOST_REQUIRE_EQUAL( org.size(), 1 );
+	const data::Image img( org );
+
+	// the volume is written slice by slice and read back into a volume
+	util::TmpFile file( "", ".v" );
+	image_io::ImageFormat_Vista().write( img, file.file_string(), "functional" );
+	std::list<data::Chunk> chunks;
+	image_io::ImageFormat_Vista().load( chunks, file.file_string(), "functional" );
+	BOOST_REQUIRE_EQUAL( chunks.size(), 1 );
+	const data::Chunk &ch = chunks.front();
+
+	BOOST_REQUIRE_EQUAL( ch.getSizeAsVector(), org.front().getSizeAsVector() );
+
+	for( size_t t = 0; t < 2; t++ )
+		for( size_t z = 0; z < 3; z++ )
+			for( size_t v = 0; v < 4; v++ )
+				BOOST_CHECK_EQUAL( ch.voxel<int16_t>( v % 2, v / 2, z, t ), 100 * z + 10 * t + v );
+
+	// the slice times are written relative to the first one
+	const util::dlist sliceTimes = ch.getPropertyAs<util::dlist>( "Vista/sliceTimes" );
+	BOOST_REQUIRE_EQUAL( sliceTimes.size(), 3 );
+	util::dlist::const_iterator stime = sliceTimes.begin();
+	BOOST_CHECK_EQUAL( *( stime++ ), 0 );
+	BOOST_CHECK_EQUAL( *( stime++ ), 10 );
+	BOOST_CHECK_EQUAL( *( stime++ ), 20 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
 }
@@ -42,5 +42,26 @@ int main()
 				}
 
 	std::cout << tsteps *slices *slice_size *slice_size << " voxel set to 42 in " << timer.elapsed() << " sec" << std::endl;
+	timer.restart();
+
+	for ( size_t tstep = 0; tstep < tsteps; tstep++ )
+		for ( size_t slice = 0; slice < slices; slice++ )
+			for ( size_t column = 0; column < slice_size; column++ )
+				for ( size_t row = 0; row < slice_size; row++ ) {
+					img.voxelUnchecked<short>( row, column, slice, tstep ) = 43;
+				}
+
+	std::cout << tsteps *slices *slice_size *slice_size << " voxel set to 43 using voxelUnchecked in " << timer.elapsed() << " sec" << std::endl;
+	timer.restart();
+	data::Image::VoxelAccessor<short> acc = img.getVoxelAccessor<short>();
+
+	for ( size_t tstep = 0; tstep < tsteps; tstep++ )
+		for ( size_t slice = 0; slice < slices; slice++ )
+			for ( size_t column = 0; column < slice_size; column++ )
+				for ( size_t row = 0; row < slice_size; row++ ) {
+					acc( row, column, slice, tstep ) = 44;
+				}
+
+	std::cout << tsteps *slices *slice_size *slice_size << " voxel set to 44 using VoxelAccessor in " << timer.elapsed() << " sec" << std::endl;
 	return 0;
 }
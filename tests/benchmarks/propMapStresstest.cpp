@@ -0,0 +1,84 @@
+#include "CoreUtils/propmap.hpp"
+#include <boost/timer.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <sstream>
+
+using namespace isis;
+
+// build a PropertyMap looking like a typical dicom header (some hundred entries in a few branches)
+util::PropertyMap makeHeader()
+{
+	util::PropertyMap ret;
+	const char *strings[] = {"ORIGINAL", "PRIMARY", "M", "ND", "MOSAIC"};
+
+	for( int i = 0; i < 200; i++ ) {
+		const std::string num = boost::lexical_cast<std::string>( i );
+		ret.propertyValue( ( "DICOM/Tag" + num ).c_str() ) = std::string( "some value for tag " ) + num;
+		ret.propertyValue( ( "DICOM/CSAImageHeaderInfo/Entry" + num ).c_str() ) = util::dlist( 4, i / 3. );
+		ret.propertyValue( ( "DICOM/CSASeriesHeaderInfo/Entry" + num ).c_str() ) = util::slist( strings, strings + 5 );
+	}
+
+	ret.propertyValue( "indexOrigin" ) = util::fvector4( -100.5, 80.25, -3, 0 );
+	ret.propertyValue( "voxelSize" ) = util::fvector4( 3, 3, 3, 0 );
+	ret.propertyValue( "sequenceNumber" ) = ( uint16_t )5;
+	ret.propertyValue( "sequenceStart" ) = boost::posix_time::microsec_clock::local_time();
+	return ret;
+}
+
+int main()
+{
+	const util::PropertyMap header = makeHeader();
+	const int rounds = 1000;
+	boost::timer timer;
+	std::string binary, text;
+
+	timer.restart();
+
+	for( int i = 0; i < rounds; i++ ) {
+		std::stringstream buff;
+		header.writeBinary( buff );
+		binary = buff.str();
+	}
+
+	std::cout << "wrote " << rounds << " headers (" << binary.size() << " bytes each) with writeBinary in " << timer.elapsed() << " seconds" << std::endl;
+	timer.restart();
+
+	for( int i = 0; i < rounds; i++ ) {
+		std::stringstream buff( binary );
+		util::PropertyMap read;
+
+		if( !read.readBinary( buff ) ) {
+			std::cerr << "readBinary failed" << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout << "read " << rounds << " headers with readBinary in " << timer.elapsed() << " seconds" << std::endl;
+
+	// for comparison, the string based way (which does not even keep the types)
+	timer.restart();
+
+	for( int i = 0; i < rounds; i++ ) {
+		std::stringstream buff;
+		const util::PropertyMap::FlatMap flat = header.getFlatMap();
+
+		for( util::PropertyMap::FlatMap::const_iterator j = flat.begin(); j != flat.end(); j++ )
+			buff << j->first << "=" << j->second.toString() << std::endl;
+
+		text = buff.str();
+	}
+
+	std::cout << "wrote " << rounds << " headers (" << text.size() << " bytes each) as text in " << timer.elapsed() << " seconds" << std::endl;
+
+	std::stringstream buff( binary );
+	util::PropertyMap read;
+	read.readBinary( buff );
+
+	if( !header.getDifference( read ).empty() ) {
+		std::cerr << "the binary round trip changed the header" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
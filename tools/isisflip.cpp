@@ -11,16 +11,6 @@ using namespace isis;
 
 int main( int argc, char **argv )
 {
-	class : public data::ChunkOp
-	{
-	public:
-		data::dimensions dim;
-		bool operator()( data::Chunk &ch, util::FixedVector<size_t, 4> /*posInImage*/ ) {
-			ch.swapAlong( dim );
-			return true;
-		}
-	} flifu;
-
 	ENABLE_LOG( data::Runtime, util::DefaultMsgPrint, error );
 	std::map<std::string, unsigned int> alongMap = boost::assign::map_list_of
 			( "row", 0 ) ( "column", 1 ) ( "slice", 2 ) ( "x", 3 ) ( "y", 4 ) ( "z", 5 );
@@ -53,8 +43,17 @@ int main( int argc, char **argv )
 		data::Image newImage = refImage;
 
 		if ( app.parameters["flip"].toString() == "image" || app.parameters["flip"].toString() == "both" ) {
-			flifu.dim = static_cast<data::dimensions>( dim );
-			refImage.foreachChunk( flifu );
+			std::list<data::Chunk> chunks;
+
+			// walk through the voxels of each chunk backwards and write them into new memory
+			BOOST_FOREACH( const data::Chunk & ch, refImage.copyChunksToVector() ) {
+				data::ChunkView view = ch.getView();
+				view.flip( static_cast<data::dimensions>( dim ) );
+				chunks.push_back( view.materialize() );
+				// only the voxels are flipped, the geometry stays as it was
+				static_cast<util::PropertyMap &>( chunks.back() ) = static_cast<const util::PropertyMap &>( ch );
+			}
+			refImage = data::Image( chunks );
 		}
 
 		if ( app.parameters["flip"].toString() == "both" || app.parameters["flip"].toString() == "space" ) {